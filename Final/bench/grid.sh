@@ -0,0 +1,111 @@
+#!/bin/sh
+# Runs pideshop against hungryverymuch over a grid of pool sizes, courier
+# speeds, client counts and arrival rates. Each point records client-side
+# throughput and latency percentiles plus the server's CPU use and peak RSS.
+#
+# Usage: bench/grid.sh [output file]   (from the Final directory, after make)
+# Grid axes are space separated lists: COOKS_LIST COURIERS_LIST K_LIST
+# CLIENTS_LIST RATE_LIST (orders per second, 0 sends everything at once).
+# Other tunables: PORT UNIT (microseconds per time unit) P Q
+# FORMAT=json writes JSON instead of CSV. The default output file is
+# bench-grid-<commit>.<format> so results from different commits sit side by side.
+
+PORT=${PORT:-$((20000 + $$ % 20000))} # Fresh ports per run so earlier runs in TIME_WAIT never collide
+UNIT=${UNIT:-1000}
+P=${P:-20}
+Q=${Q:-20}
+COOKS_LIST=${COOKS_LIST:-"2 4 8"}
+COURIERS_LIST=${COURIERS_LIST:-"2 4 8"}
+K_LIST=${K_LIST:-"5"}
+CLIENTS_LIST=${CLIENTS_LIST:-"100"}
+RATE_LIST=${RATE_LIST:-"0 200"}
+FORMAT=${FORMAT:-csv}
+
+BIN=$(cd "$(dirname "$0")/.." && pwd)
+COMMIT=$(git -C "$BIN" rev-parse --short HEAD 2>/dev/null || echo unknown)
+OUT=${1:-bench-grid-$COMMIT.$FORMAT}
+case $OUT in
+/*) ;;
+*) OUT=$(pwd)/$OUT ;;
+esac
+TICKS=$(getconf CLK_TCK)
+
+WORK=$(mktemp -d)
+cd "$WORK" || exit 1
+
+# Prints utime + stime of a process in clock ticks
+cpuTicks() {
+    awk '{ print $14 + $15 }' "/proc/$1/stat"
+}
+
+if [ "$FORMAT" = json ]
+then
+    echo "[" > "$OUT"
+else
+    echo "commit,cooks,couriers,k,clients,rate,delivered,elapsed_s,throughput,p50_ms,p90_ms,p99_ms,cpu_s,cpu_util,rss_kb" > "$OUT"
+fi
+
+separator=""
+for cooks in $COOKS_LIST; do
+for couriers in $COURIERS_LIST; do
+for k in $K_LIST; do
+for clients in $CLIENTS_LIST; do
+for rate in $RATE_LIST; do
+    "$BIN/pideshop" -u "$UNIT" "$PORT" "$cooks" "$couriers" "$k" > pideshop.out 2>&1 &
+    server=$!
+    sleep 0.5
+    if ! kill -0 $server 2>/dev/null
+    then
+        echo "pideshop failed to start on port $PORT:" >&2
+        cat pideshop.out >&2
+        exit 1
+    fi
+    startTicks=$(cpuTicks $server)
+
+    summary=$("$BIN/hungryverymuch" -r "$rate" 127.0.0.1 "$PORT" "$clients" "$P" "$Q" | grep '^Summary:')
+
+    endTicks=$(cpuTicks $server)
+    rss=$(awk '/^VmHWM:/ { print $2 }' "/proc/$server/status")
+    kill -INT $server
+    wait $server 2>/dev/null
+
+    line=$(echo "$summary" | tr ' ' '\n' | awk -F= \
+        -v commit="$COMMIT" -v cooks="$cooks" -v couriers="$couriers" -v k="$k" -v clients="$clients" \
+        -v rate="$rate" -v ticks="$((endTicks - startTicks))" -v hz="$TICKS" -v rss="$rss" -v format="$FORMAT" '
+        { value[$1] = $2 }
+        END {
+            cpu = ticks / hz
+            util = value["elapsed"] > 0 ? cpu / value["elapsed"] : 0
+            if (format == "json")
+                printf "  {\"commit\": \"%s\", \"cooks\": %d, \"couriers\": %d, \"k\": %d, \"clients\": %d, \"rate\": %s, \"delivered\": %d, \"elapsed_s\": %s, \"throughput\": %s, \"p50_ms\": %s, \"p90_ms\": %s, \"p99_ms\": %s, \"cpu_s\": %.2f, \"cpu_util\": %.3f, \"rss_kb\": %d}",
+                    commit, cooks, couriers, k, clients, rate, value["delivered"], value["elapsed"], value["throughput"],
+                    value["p50_ms"], value["p90_ms"], value["p99_ms"], cpu, util, rss
+            else
+                printf "%s,%d,%d,%d,%d,%s,%d,%s,%s,%s,%s,%s,%.2f,%.3f,%d",
+                    commit, cooks, couriers, k, clients, rate, value["delivered"], value["elapsed"], value["throughput"],
+                    value["p50_ms"], value["p90_ms"], value["p99_ms"], cpu, util, rss
+        }')
+
+    if [ "$FORMAT" = json ]
+    then
+        printf "%s%s" "$separator" "$line" >> "$OUT"
+        separator=",
+"
+    else
+        echo "$line" >> "$OUT"
+    fi
+    echo "cooks=$cooks couriers=$couriers k=$k clients=$clients rate=$rate: $summary" >&2
+    PORT=$((PORT + 1))
+done
+done
+done
+done
+done
+
+if [ "$FORMAT" = json ]
+then
+    printf "\n]\n" >> "$OUT"
+fi
+
+rm -rf "$WORK"
+echo "Results written to $OUT" >&2
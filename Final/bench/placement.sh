@@ -0,0 +1,38 @@
+#!/bin/sh
+# Runs pideshop under every thread placement policy and reports client-side
+# throughput and latency percentiles for each.
+#
+# Usage: bench/placement.sh   (from the Final directory, after make)
+# Tunables: PORT CLIENTS COOKS COURIERS K UNIT (microseconds per time unit) P Q
+
+PORT=${PORT:-5600}
+CLIENTS=${CLIENTS:-200}
+COOKS=${COOKS:-8}
+COURIERS=${COURIERS:-8}
+K=${K:-5}
+UNIT=${UNIT:-1000}
+P=${P:-20}
+Q=${Q:-20}
+
+BIN=$(cd "$(dirname "$0")/.." && pwd)
+WORK=$(mktemp -d)
+cd "$WORK" || exit 1
+
+printf "%-8s %10s %10s %10s %10s\n" policy orders/s p50_ms p90_ms p99_ms
+for policy in none compact split spread
+do
+    "$BIN/pideshop" -a $policy -u "$UNIT" "$PORT" "$COOKS" "$COURIERS" "$K" > pideshop.out 2>&1 &
+    server=$!
+    sleep 0.5
+
+    summary=$("$BIN/hungryverymuch" 127.0.0.1 "$PORT" "$CLIENTS" "$P" "$Q" | grep '^Summary:')
+    kill -INT $server
+    wait $server 2>/dev/null
+
+    echo "$summary" | tr ' ' '\n' | awk -F= -v policy=$policy '
+        { value[$1] = $2 }
+        END { printf "%-8s %10s %10s %10s %10s\n", policy, value["throughput"], value["p50_ms"], value["p90_ms"], value["p99_ms"] }'
+    PORT=$((PORT + 1))
+done
+
+rm -rf "$WORK"
@@ -0,0 +1,220 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/syscall.h>
+
+#include "eventlog.h"
+#include "lockprof.h"
+#include "perfstat.h"
+
+#define EVENTLOG_BUFFER_RECORDS 2048        // Records collected before a write
+#define EVENTLOG_FLUSH_NS 1000000000ULL     // Write at least this often while events arrive
+
+const char *eventNames[EV_TYPE_COUNT] = {
+    "UNKNOWN", "SERVER_STARTED", "SERVER_TERMINATED", "CLIENT_CONNECTED", "RECEIVE_FAILED",
+    "ORDER_RECEIVED", "COOK_STARTED", "ORDER_READY", "OUT_FOR_DELIVERY", "ORDER_DELIVERED"};
+
+static pthread_mutex_t logMutex = PTHREAD_MUTEX_INITIALIZER; // Protects everything below
+static char logPath[4096];                                   // Current log file
+static int logFd = -1;                                       // Current log file descriptor
+static uint64_t maxFileBytes;                                // Rotation size
+static uint64_t fileBytes;                                   // Bytes in the current file
+static uint32_t fileIndex;                                   // Rotations so far
+static uint64_t lastFlushNs;                                 // When the buffer was last written
+static eventRecord buffer[EVENTLOG_BUFFER_RECORDS];          // Records not yet written
+static int buffered = 0;                                     // Records in buffer
+static __thread uint32_t threadID = 0;                       // Cached gettid of the caller
+
+static uint64_t clockNs(clockid_t clock)
+{
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// Function to start a fresh file with its header, called with the mutex held
+static int startFile(int flags)
+{
+    logFd = open(logPath, O_WRONLY | O_CREAT | flags, 0644);
+    if (logFd < 0)
+    {
+        perror("Failed to open log file");
+        return -1;
+    }
+
+    eventLogHeader header = {0};
+    header.magic = EVENTLOG_MAGIC;
+    header.version = EVENTLOG_VERSION;
+    header.recordSize = sizeof(eventRecord);
+    header.realtimeNs = clockNs(CLOCK_REALTIME);
+    header.monotonicNs = clockNs(CLOCK_MONOTONIC);
+    header.fileIndex = fileIndex;
+    header.pid = getpid();
+    if (write(logFd, &header, sizeof(header)) != sizeof(header))
+    {
+        perror("Failed to write log header");
+    }
+    fileBytes = sizeof(header);
+    return 0;
+}
+
+// Function to shift path -> path.1 -> path.2 ..., dropping the oldest file
+static int shiftFiles(void)
+{
+    char from[4200], to[4200];
+    for (int i = EVENTLOG_KEEP_FILES - 1; i >= 1; i--)
+    {
+        snprintf(from, sizeof(from), "%s.%d", logPath, i);
+        snprintf(to, sizeof(to), "%s.%d", logPath, i + 1);
+        rename(from, to);
+    }
+    snprintf(to, sizeof(to), "%s.1", logPath);
+    if (rename(logPath, to) < 0 && errno != ENOENT)
+    {
+        perror("Failed to rotate log file");
+        return -1;
+    }
+    return 0;
+}
+
+// Function to move the full file out of the way and start a new one
+static void rotate(void)
+{
+    close(logFd);
+    logFd = -1;
+    shiftFiles();
+    fileIndex++;
+    startFile(O_TRUNC); // Truncates only if the full file could not be moved
+}
+
+// Function to write the buffered records, called with the mutex held
+static void flushLocked(void)
+{
+    if (logFd < 0 || buffered == 0)
+    {
+        buffered = 0;
+        return;
+    }
+
+    // Only whole records go into a file, so every file stays indexable
+    int written = 0;
+    while (written < buffered)
+    {
+        uint64_t room = fileBytes < maxFileBytes ? (maxFileBytes - fileBytes) / sizeof(eventRecord) : 0;
+        if (room == 0)
+        {
+            rotate();
+            if (logFd < 0)
+            {
+                break;
+            }
+            continue;
+        }
+
+        int count = buffered - written < (int)room ? buffered - written : (int)room;
+        const char *data = (const char *)&buffer[written];
+        size_t length = count * sizeof(eventRecord), done = 0;
+        while (done < length)
+        {
+            ssize_t bytes = write(logFd, data + done, length - done);
+            if (bytes < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            if (bytes <= 0)
+            {
+                break;
+            }
+            done += bytes;
+        }
+        if (done < length)
+        {
+            // Cut a partial record off again, the remaining records are lost
+            perror("Failed to write to log file");
+            done -= done % sizeof(eventRecord);
+            if (ftruncate(logFd, fileBytes + done) < 0 || lseek(logFd, fileBytes + done, SEEK_SET) < 0)
+            {
+                perror("Failed to trim log file");
+            }
+            fileBytes += done;
+            break;
+        }
+        fileBytes += done;
+        written += count;
+    }
+    buffered = 0;
+    lastFlushNs = clockNs(CLOCK_MONOTONIC);
+}
+
+int eventLogOpen(const char *path, uint64_t maxBytes)
+{
+    snprintf(logPath, sizeof(logPath), "%s", path);
+    maxFileBytes = maxBytes > sizeof(eventLogHeader) + sizeof(eventRecord) ? maxBytes : sizeof(eventLogHeader) + sizeof(eventRecord);
+    fileIndex = 0;
+    lastFlushNs = clockNs(CLOCK_MONOTONIC);
+
+    // The previous run's files move down one place, like a rotation, so a restart never
+    // overwrites them; O_EXCL makes sure a file that is still in place is never reused.
+    if (shiftFiles() < 0)
+    {
+        return -1;
+    }
+    return startFile(O_EXCL);
+}
+
+void eventLogWrite(eventType type, uint32_t orderID, uint16_t arg, int32_t p0, int32_t p1, int32_t p2)
+{
+    eventLogWriteAt(0, type, orderID, arg, p0, p1, p2);
+}
+
+void eventLogWriteAt(uint64_t timestamp, eventType type, uint32_t orderID, uint16_t arg, int32_t p0, int32_t p1, int32_t p2)
+{
+    if (threadID == 0)
+    {
+        threadID = syscall(SYS_gettid);
+    }
+
+    perfScopeBegin(PERF_LOG);
+    uint64_t now = clockNs(CLOCK_MONOTONIC);
+    MUTEX_LOCK(&logMutex);
+    eventRecord *record = &buffer[buffered++];
+    record->timestamp = timestamp != 0 ? timestamp : now;
+    record->orderID = orderID;
+    record->tid = threadID;
+    record->type = type;
+    record->arg = arg;
+    record->payload[0] = p0;
+    record->payload[1] = p1;
+    record->payload[2] = p2;
+    if (buffered == EVENTLOG_BUFFER_RECORDS || now - lastFlushNs > EVENTLOG_FLUSH_NS)
+    {
+        flushLocked();
+    }
+    MUTEX_UNLOCK(&logMutex);
+    perfScopeEnd(PERF_LOG);
+}
+
+void eventLogFlush(void)
+{
+    MUTEX_LOCK(&logMutex);
+    flushLocked();
+    MUTEX_UNLOCK(&logMutex);
+}
+
+void eventLogClose(void)
+{
+    MUTEX_LOCK(&logMutex);
+    flushLocked();
+    if (logFd >= 0)
+    {
+        close(logFd);
+        logFd = -1;
+    }
+    MUTEX_UNLOCK(&logMutex);
+}
@@ -0,0 +1,65 @@
+#ifndef EVENTLOG_H
+#define EVENTLOG_H
+
+#include <stdint.h>
+
+// Binary event log shared by pideshop (writer) and pideshop-logdump (reader).
+// A log file is one eventLogHeader followed by fixed-size eventRecords, so a
+// reader can mmap it and index records directly. When a file reaches its size
+// limit it is renamed to <path>.1 (older ones shift to .2, .3 ...) and a new
+// file is started. A restarted server moves the previous run's file the same
+// way before it starts its own, so earlier runs are never overwritten.
+
+#define EVENTLOG_MAGIC 0x474f4c50u        // "PLOG" in little endian
+#define EVENTLOG_VERSION 1
+#define EVENTLOG_DEFAULT_MAX_BYTES (64 << 20) // Rotate after 64 MB
+#define EVENTLOG_KEEP_FILES 4                 // Rotated files kept besides the current one
+
+typedef enum
+{
+    EV_SERVER_STARTED = 1,  // payload: port, cooks, couriers
+    EV_SERVER_TERMINATED,   // payload: none
+    EV_CLIENT_CONNECTED,    // payload: IPv4 address (network order), port
+    EV_RECEIVE_FAILED,      // payload: none
+    EV_ORDER_RECEIVED,      // arg: tier, payload: x, y, pending orders
+    EV_COOK_STARTED,        // arg: cook, payload: preparing time
+    EV_ORDER_READY,         // arg: cook
+    EV_OUT_FOR_DELIVERY,    // arg: courier, payload: delivery time
+    EV_ORDER_DELIVERED,     // arg: courier, payload: x, y
+    EV_TYPE_COUNT
+} eventType;
+
+typedef struct
+{
+    uint32_t magic;           // EVENTLOG_MAGIC
+    uint16_t version;         // EVENTLOG_VERSION
+    uint16_t recordSize;      // sizeof(eventRecord)
+    uint64_t realtimeNs;      // Wall clock when the file was started
+    uint64_t monotonicNs;     // Monotonic clock at the same moment
+    uint32_t fileIndex;       // 0 for the first file of a run, +1 per rotation
+    uint32_t pid;             // Process that wrote the file
+    uint8_t reserved[32];     // Pads the header to 64 bytes
+} eventLogHeader;
+
+typedef struct
+{
+    uint64_t timestamp;  // Monotonic nanoseconds
+    uint32_t orderID;    // 0 when the event is not about an order
+    uint32_t tid;        // Kernel thread ID of the writer
+    uint16_t type;       // eventType
+    uint16_t arg;        // Small per-type argument (tier, cook or courier index)
+    int32_t payload[3];  // Per-type values, see eventType
+} eventRecord;
+
+_Static_assert(sizeof(eventLogHeader) == 64, "eventLogHeader must stay 64 bytes");
+_Static_assert(sizeof(eventRecord) == 32, "eventRecord must stay 32 bytes");
+
+extern const char *eventNames[EV_TYPE_COUNT];
+
+int eventLogOpen(const char *path, uint64_t maxBytes); // -1 on failure
+void eventLogWrite(eventType type, uint32_t orderID, uint16_t arg, int32_t p0, int32_t p1, int32_t p2);
+void eventLogWriteAt(uint64_t timestamp, eventType type, uint32_t orderID, uint16_t arg, int32_t p0, int32_t p1, int32_t p2); // Stamped with an earlier monotonic time, 0 for now
+void eventLogFlush(void);
+void eventLogClose(void);
+
+#endif
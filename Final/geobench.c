@@ -0,0 +1,105 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+
+#include "geometry.h"
+
+// Compares the per-order calculateDistance of pideshop with the batch
+// kernels of every backend this CPU supports.
+
+#define BENCH_POINTS 512   // Orders per batch
+#define BENCH_ROUNDS 20000 // Batches timed per backend
+#define BENCH_K 5.0        // Courier speed used for ETAs
+
+// The function pideshop used before the geometry module, kept here as the baseline
+double calculateDistance(int x1, int y1, int x2, int y2)
+{
+    return sqrt(pow(x2 - x1, 2) + pow(y2 - y1, 2));
+}
+
+static double nowSeconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(void)
+{
+    static int xi[BENCH_POINTS], yi[BENCH_POINTS];
+    static double xs[BENCH_POINTS], ys[BENCH_POINTS], expected[BENCH_POINTS], out[BENCH_POINTS];
+    static double matrix[BENCH_POINTS * BENCH_POINTS];
+    volatile double sink = 0;
+
+    srand(344);
+    for (int i = 0; i < BENCH_POINTS; i++)
+    {
+        xi[i] = rand() % 1000 - 500;
+        yi[i] = rand() % 1000 - 500;
+        xs[i] = xi[i];
+        ys[i] = yi[i];
+    }
+
+    double start = nowSeconds();
+    for (int round = 0; round < BENCH_ROUNDS; round++)
+    {
+        for (int i = 0; i < BENCH_POINTS; i++)
+        {
+            expected[i] = calculateDistance(round & 7, 0, xi[i], yi[i]);
+        }
+        sink += expected[round % BENCH_POINTS];
+    }
+    double baseline = (nowSeconds() - start) * 1e9 / ((double)BENCH_ROUNDS * BENCH_POINTS);
+    printf("%d points x %d rounds\n", BENCH_POINTS, BENCH_ROUNDS);
+    printf("%-18s %12s %10s %14s %14s\n", "kernel", "ns/distance", "speedup", "ns/eta", "ns/matrix cell");
+    printf("%-18s %12.3f %10s %14s %14s\n", "calculateDistance", baseline, "1.00x", "-", "-");
+
+    const char *backends[] = {"scalar", "sse2", "avx2"};
+    for (int b = 0; b < 3; b++)
+    {
+        if (geometrySetBackend(backends[b]) < 0)
+        {
+            printf("%-18s %12s\n", backends[b], "unsupported");
+            continue;
+        }
+
+        start = nowSeconds();
+        for (int round = 0; round < BENCH_ROUNDS; round++)
+        {
+            distanceBatch(xs, ys, BENCH_POINTS, round & 7, 0, out);
+            sink += out[round % BENCH_POINTS];
+        }
+        double distanceNs = (nowSeconds() - start) * 1e9 / ((double)BENCH_ROUNDS * BENCH_POINTS);
+
+        // The last round used origin ((BENCH_ROUNDS - 1) & 7, 0), same as expected[]
+        double maxError = 0;
+        for (int i = 0; i < BENCH_POINTS; i++)
+        {
+            maxError = fmax(maxError, fabs(out[i] - expected[i]));
+        }
+
+        start = nowSeconds();
+        for (int round = 0; round < BENCH_ROUNDS; round++)
+        {
+            etaBatch(xs, ys, BENCH_POINTS, round & 7, 0, BENCH_K, out);
+            sink += out[round % BENCH_POINTS];
+        }
+        double etaNs = (nowSeconds() - start) * 1e9 / ((double)BENCH_ROUNDS * BENCH_POINTS);
+
+        int matrixRounds = BENCH_ROUNDS / BENCH_POINTS;
+        start = nowSeconds();
+        for (int round = 0; round < matrixRounds; round++)
+        {
+            distanceMatrix(xs, ys, BENCH_POINTS, matrix);
+            sink += matrix[round];
+        }
+        double matrixNs = (nowSeconds() - start) * 1e9 / ((double)matrixRounds * BENCH_POINTS * BENCH_POINTS);
+
+        char speedup[16];
+        snprintf(speedup, sizeof(speedup), "%.2fx", baseline / distanceNs);
+        printf("%-18s %12.3f %10s %14.3f %14.3f  (max error vs baseline %g)\n", backends[b], distanceNs, speedup, etaNs, matrixNs, maxError);
+    }
+
+    return sink == 0 ? 1 : 0;
+}
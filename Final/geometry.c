@@ -0,0 +1,139 @@
+#include <string.h>
+
+#include "geometry.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define GEOMETRY_X86 1
+#endif
+
+typedef void (*distanceKernel)(const double *xs, const double *ys, size_t count, double originX, double originY, double divisor, double *out);
+
+// Function to compute distance / divisor for every point, one at a time
+static void distanceScalar(const double *xs, const double *ys, size_t count, double originX, double originY, double divisor, double *out)
+{
+    if (divisor == 1.0) // Plain distances skip the division, which costs as much as the sqrt
+    {
+        for (size_t i = 0; i < count; i++)
+        {
+            out[i] = pointDistance(originX, originY, xs[i], ys[i]);
+        }
+        return;
+    }
+    for (size_t i = 0; i < count; i++)
+    {
+        out[i] = pointDistance(originX, originY, xs[i], ys[i]) / divisor;
+    }
+}
+
+#ifdef GEOMETRY_X86
+// Function to compute distance / divisor for two points per instruction
+static void distanceSse2(const double *xs, const double *ys, size_t count, double originX, double originY, double divisor, double *out)
+{
+    __m128d ox = _mm_set1_pd(originX), oy = _mm_set1_pd(originY), divide = _mm_set1_pd(divisor);
+    size_t i = 0;
+    for (; i + 2 <= count; i += 2)
+    {
+        __m128d dx = _mm_sub_pd(_mm_loadu_pd(xs + i), ox);
+        __m128d dy = _mm_sub_pd(_mm_loadu_pd(ys + i), oy);
+        __m128d distance = _mm_sqrt_pd(_mm_add_pd(_mm_mul_pd(dx, dx), _mm_mul_pd(dy, dy)));
+        _mm_storeu_pd(out + i, _mm_div_pd(distance, divide));
+    }
+    distanceScalar(xs + i, ys + i, count - i, originX, originY, divisor, out + i);
+}
+
+// Function to compute distance / divisor for four points per instruction
+__attribute__((target("avx2"))) static void distanceAvx2(const double *xs, const double *ys, size_t count, double originX, double originY, double divisor, double *out)
+{
+    __m256d ox = _mm256_set1_pd(originX), oy = _mm256_set1_pd(originY), divide = _mm256_set1_pd(divisor);
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        __m256d dx = _mm256_sub_pd(_mm256_loadu_pd(xs + i), ox);
+        __m256d dy = _mm256_sub_pd(_mm256_loadu_pd(ys + i), oy);
+        // Separate multiply and add (no FMA) so results match the scalar path bit for bit
+        __m256d distance = _mm256_sqrt_pd(_mm256_add_pd(_mm256_mul_pd(dx, dx), _mm256_mul_pd(dy, dy)));
+        _mm256_storeu_pd(out + i, _mm256_div_pd(distance, divide));
+    }
+    distanceSse2(xs + i, ys + i, count - i, originX, originY, divisor, out + i);
+}
+#endif
+
+static distanceKernel kernel = NULL;     // Selected backend, chosen on first use
+static const char *kernelName = "scalar";
+
+static void selectBackend(void)
+{
+    if (kernel != NULL)
+    {
+        return;
+    }
+    kernel = distanceScalar;
+    kernelName = "scalar";
+#ifdef GEOMETRY_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+    {
+        kernel = distanceAvx2;
+        kernelName = "avx2";
+    }
+    else if (__builtin_cpu_supports("sse2"))
+    {
+        kernel = distanceSse2;
+        kernelName = "sse2";
+    }
+#endif
+}
+
+const char *geometryBackend(void)
+{
+    selectBackend();
+    return kernelName;
+}
+
+int geometrySetBackend(const char *name)
+{
+    if (strcmp(name, "scalar") == 0)
+    {
+        kernel = distanceScalar;
+        kernelName = "scalar";
+        return 0;
+    }
+#ifdef GEOMETRY_X86
+    __builtin_cpu_init();
+    if (strcmp(name, "sse2") == 0 && __builtin_cpu_supports("sse2"))
+    {
+        kernel = distanceSse2;
+        kernelName = "sse2";
+        return 0;
+    }
+    if (strcmp(name, "avx2") == 0 && __builtin_cpu_supports("avx2"))
+    {
+        kernel = distanceAvx2;
+        kernelName = "avx2";
+        return 0;
+    }
+#endif
+    return -1;
+}
+
+void distanceBatch(const double *xs, const double *ys, size_t count, double originX, double originY, double *out)
+{
+    selectBackend();
+    kernel(xs, ys, count, originX, originY, 1.0, out);
+}
+
+void etaBatch(const double *xs, const double *ys, size_t count, double originX, double originY, double k, double *out)
+{
+    selectBackend();
+    kernel(xs, ys, count, originX, originY, k, out);
+}
+
+void distanceMatrix(const double *xs, const double *ys, size_t count, double *out)
+{
+    selectBackend();
+    for (size_t i = 0; i < count; i++) // Each row is a batch with point i as the origin
+    {
+        kernel(xs, ys, count, xs[i], ys[i], 1.0, out + i * count);
+    }
+}
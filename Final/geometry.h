@@ -0,0 +1,30 @@
+#ifndef GEOMETRY_H
+#define GEOMETRY_H
+
+#include <math.h>
+#include <stddef.h>
+
+// Batch distance and ETA kernels over order coordinates in struct-of-arrays
+// layout (xs[i], ys[i]). The AVX2 and SSE2 paths compute sqrt(dx*dx + dy*dy)
+// exactly like the scalar one, so every backend returns identical results.
+
+// Function to compute the distance between two points
+static inline double pointDistance(double x1, double y1, double x2, double y2)
+{
+    double dx = x2 - x1, dy = y2 - y1;
+    return sqrt(dx * dx + dy * dy);
+}
+
+const char *geometryBackend(void);           // Name of the backend in use: avx2, sse2 or scalar
+int geometrySetBackend(const char *name);    // Force a backend, -1 if this CPU lacks it
+
+// out[i] = distance from (originX, originY) to (xs[i], ys[i])
+void distanceBatch(const double *xs, const double *ys, size_t count, double originX, double originY, double *out);
+
+// out[i] = distance from (originX, originY) to (xs[i], ys[i]) divided by speed k
+void etaBatch(const double *xs, const double *ys, size_t count, double originX, double originY, double k, double *out);
+
+// out[i * count + j] = distance between point i and point j (count x count, row-major)
+void distanceMatrix(const double *xs, const double *ys, size_t count, double *out);
+
+#endif
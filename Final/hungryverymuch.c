@@ -6,6 +6,7 @@
 #include <time.h>
 #include <string.h>
 #include <arpa/inet.h>
+#include <math.h>
 
 typedef struct
 {
@@ -14,12 +15,51 @@ typedef struct
     int serverPort;
     int x;
     int y;
+    int tier; // 0 - regular, 1 - express, 2 - vip
 } clientData;
 
 volatile sig_atomic_t stop = 0;
 int *clientSockets;
 pthread_t *clients;
 int numClients;
+double *latencies; // Seconds from connect to delivery notification, negative if no delivery
+
+double nowSeconds()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int compareDoubles(const void *a, const void *b)
+{
+    double left = *(const double *)a, right = *(const double *)b;
+    return (left > right) - (left < right);
+}
+
+// Function to print throughput and latency percentiles of the delivered orders
+void printSummary(double elapsed)
+{
+    int delivered = 0;
+    for (int i = 0; i < numClients; i++)
+    {
+        if (latencies[i] >= 0)
+        {
+            latencies[delivered++] = latencies[i];
+        }
+    }
+    qsort(latencies, delivered, sizeof(double), compareDoubles);
+
+    double p50 = 0, p90 = 0, p99 = 0;
+    if (delivered > 0)
+    {
+        p50 = latencies[(int)(0.50 * (delivered - 1))];
+        p90 = latencies[(int)(0.90 * (delivered - 1))];
+        p99 = latencies[(int)(0.99 * (delivered - 1))];
+    }
+    printf("Summary: delivered=%d elapsed=%.3f throughput=%.2f p50_ms=%.3f p90_ms=%.3f p99_ms=%.3f\n",
+           delivered, elapsed, elapsed > 0 ? delivered / elapsed : 0.0, p50 * 1000, p90 * 1000, p99 * 1000);
+}
 
 void handleSigInt(int sig)
 {
@@ -44,6 +84,7 @@ void *clientThread(void *arg)
 {
     clientData *data = (clientData *)arg;
     struct sockaddr_in serverAddr;
+    double start = nowSeconds();
 
     // Create socket
     int sock = socket(AF_INET, SOCK_STREAM, 0);
@@ -72,7 +113,7 @@ void *clientThread(void *arg)
 
     // Send x and y to server
     char buffer[128];
-    sprintf(buffer, "X:%d,Y:%d", data->x, data->y);
+    sprintf(buffer, "X:%d,Y:%d,T:%d", data->x, data->y, data->tier);
     if (send(sock, buffer, strlen(buffer), 0) < 0)
     {
         perror("Send failed");
@@ -101,6 +142,7 @@ void *clientThread(void *arg)
         else
         {
             printf("%s", buffer);
+            latencies[data->id] = nowSeconds() - start;
         }
     }
 
@@ -113,23 +155,46 @@ void *clientThread(void *arg)
 
 int main(int argc, char *argv[])
 {
-    if (argc != 6)
+    int opt, badOption = 0;
+    int expressPercent = 0, vipPercent = 0;
+    double arrivalRate = 0; // Orders per second, 0 places all of them at once
+    while ((opt = getopt(argc, argv, "e:v:r:")) != -1)
     {
-        fprintf(stderr, "Usage: %s <IP> <Port> <Number of Clients> <p> <q>\n", argv[0]);
+        switch (opt)
+        {
+        case 'e': // Percentage of orders placed as express
+            expressPercent = atoi(optarg);
+            break;
+        case 'v': // Percentage of orders placed as vip
+            vipPercent = atoi(optarg);
+            break;
+        case 'r': // Mean arrival rate of a Poisson stream of orders
+            arrivalRate = atof(optarg);
+            break;
+        default:
+            badOption = 1;
+            break;
+        }
+    }
+
+    if (badOption || argc - optind != 5)
+    {
+        fprintf(stderr, "Usage: %s [-e <Express %%>] [-v <VIP %%>] [-r <Orders per second>] <IP> <Port> <Number of Clients> <p> <q>\n", argv[0]);
         exit(EXIT_FAILURE);
     }
 
-    char *serverIP = argv[1];
-    int serverPort = atoi(argv[2]);
-    numClients = atoi(argv[3]);
-    int p = atoi(argv[4]);
-    int q = atoi(argv[5]);
+    char *serverIP = argv[optind];
+    int serverPort = atoi(argv[optind + 1]);
+    numClients = atoi(argv[optind + 2]);
+    int p = atoi(argv[optind + 3]);
+    int q = atoi(argv[optind + 4]);
 
     // Dynamic memory allocation for client sockets and threads
     clientSockets = malloc(numClients * sizeof(int));
     clients = malloc(numClients * sizeof(pthread_t));
+    latencies = malloc(numClients * sizeof(double));
 
-    if (clientSockets == NULL || clients == NULL)
+    if (clientSockets == NULL || clients == NULL || latencies == NULL)
     {
         fprintf(stderr, "Memory allocation failed\n");
         exit(EXIT_FAILURE);
@@ -146,8 +211,11 @@ int main(int argc, char *argv[])
     }
 
     srand(time(NULL));
+    double start = nowSeconds();
     for (int i = 0; i < numClients; i++)
     {
+        latencies[i] = -1;
+        clientSockets[i] = 0;
         clientData *data = malloc(sizeof(clientData));
         if (data == NULL)
         {
@@ -160,7 +228,18 @@ int main(int argc, char *argv[])
         data->x = (rand() % p) - (p / 2);
         data->y = (rand() % q) - (q / 2);
 
+        int roll = rand() % 100;
+        data->tier = roll < vipPercent ? 2 : (roll < vipPercent + expressPercent ? 1 : 0);
+
         pthread_create(&clients[i], NULL, clientThread, (void *)data);
+
+        if (arrivalRate > 0)
+        {
+            // Exponential gaps between orders give a Poisson arrival process
+            double gap = -log(1.0 - rand() / (RAND_MAX + 1.0)) / arrivalRate;
+            struct timespec ts = {(time_t)gap, (long)((gap - (time_t)gap) * 1e9)};
+            nanosleep(&ts, NULL);
+        }
     }
 
     for (int i = 0; i < numClients; i++)
@@ -168,8 +247,11 @@ int main(int argc, char *argv[])
         pthread_join(clients[i], NULL);
     }
 
+    printSummary(nowSeconds() - start);
+
     free(clientSockets);
     free(clients);
+    free(latencies);
 
     return 0;
 }
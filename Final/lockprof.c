@@ -0,0 +1,294 @@
+#include "lockprof.h"
+
+#ifdef LOCKPROF
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+typedef struct
+{
+    const char *file;       // Source file of the call site
+    int line;               // Line of the call site
+    uint64_t acquisitions;  // Acquisitions made from this site
+    uint64_t contended;     // Acquisitions from this site that had to wait
+    uint64_t waitNs;        // Total time this site spent waiting
+} lockSite;
+
+typedef struct
+{
+    const void *addr;                     // Address of the pthread object
+    const char *name;                     // Variable name as written at the call site
+    int isCond;                           // 1 for condition variables, 0 for mutexes
+    uint64_t acquisitions;                // Successful locks (or waits for condvars)
+    uint64_t contended;                   // Locks that found the mutex already held
+    uint64_t signals;                     // Signals and broadcasts (condvars only)
+    uint64_t waitNs;                      // Total time spent waiting
+    uint64_t holdNs;                      // Total time the mutex was held
+    uint64_t acquiredAt;                  // When the current holder acquired the mutex
+    uint64_t waitHist[LOCKPROF_BUCKETS];  // Wait time histogram
+    uint64_t holdHist[LOCKPROF_BUCKETS];  // Hold time histogram
+    lockSite sites[LOCKPROF_MAX_SITES];   // Call sites that acquired this lock
+    int siteCount;                        // Number of used entries in sites
+} lockStat;
+
+static lockStat locks[LOCKPROF_MAX_LOCKS];                       // Every lock seen so far
+static int lockCount = 0;                                        // Number of used entries in locks
+static pthread_mutex_t registryMutex = PTHREAD_MUTEX_INITIALIZER; // Protects lock and site registration
+
+static uint64_t nowNs(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// Function to map a duration to its power-of-two histogram bucket
+static int bucketOf(uint64_t ns)
+{
+    int bucket = 0;
+    while (ns > 1 && bucket < LOCKPROF_BUCKETS - 1)
+    {
+        ns >>= 1;
+        bucket++;
+    }
+    return bucket;
+}
+
+static void addSample(uint64_t *hist, uint64_t *total, uint64_t ns)
+{
+    __atomic_fetch_add(&hist[bucketOf(ns)], 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(total, ns, __ATOMIC_RELAXED);
+}
+
+// Function to find the stats of a lock, registering it on first use
+static lockStat *findLock(const void *addr, const char *name, int isCond)
+{
+    int count = __atomic_load_n(&lockCount, __ATOMIC_ACQUIRE);
+    for (int i = 0; i < count; i++)
+    {
+        if (locks[i].addr == addr)
+        {
+            return &locks[i];
+        }
+    }
+
+    lockStat *stat = NULL;
+    pthread_mutex_lock(&registryMutex);
+    for (int i = 0; i < lockCount; i++) // Another thread may have registered it meanwhile
+    {
+        if (locks[i].addr == addr)
+        {
+            stat = &locks[i];
+        }
+    }
+    if (stat == NULL && lockCount < LOCKPROF_MAX_LOCKS)
+    {
+        stat = &locks[lockCount];
+        stat->addr = addr;
+        stat->name = name[0] == '&' ? name + 1 : name;
+        stat->isCond = isCond;
+        __atomic_store_n(&lockCount, lockCount + 1, __ATOMIC_RELEASE);
+    }
+    pthread_mutex_unlock(&registryMutex);
+    return stat;
+}
+
+// Function to find the stats of a call site, registering it on first use
+static lockSite *findSite(lockStat *stat, const char *file, int line)
+{
+    int count = __atomic_load_n(&stat->siteCount, __ATOMIC_ACQUIRE);
+    for (int i = 0; i < count; i++)
+    {
+        if (stat->sites[i].line == line && stat->sites[i].file == file)
+        {
+            return &stat->sites[i];
+        }
+    }
+
+    lockSite *site = NULL;
+    pthread_mutex_lock(&registryMutex);
+    for (int i = 0; i < stat->siteCount; i++)
+    {
+        if (stat->sites[i].line == line && stat->sites[i].file == file)
+        {
+            site = &stat->sites[i];
+        }
+    }
+    if (site == NULL && stat->siteCount < LOCKPROF_MAX_SITES)
+    {
+        site = &stat->sites[stat->siteCount];
+        site->file = file;
+        site->line = line;
+        __atomic_store_n(&stat->siteCount, stat->siteCount + 1, __ATOMIC_RELEASE);
+    }
+    pthread_mutex_unlock(&registryMutex);
+    return site;
+}
+
+int lockprofLock(pthread_mutex_t *mutex, const char *name, const char *file, int line)
+{
+    lockStat *stat = findLock(mutex, name, 0);
+    if (stat == NULL)
+    {
+        return pthread_mutex_lock(mutex);
+    }
+    lockSite *site = findSite(stat, file, line);
+
+    uint64_t waitNs = 0;
+    int contended = 0;
+    int result = pthread_mutex_trylock(mutex);
+    if (result != 0) // Someone holds it, time how long we block
+    {
+        contended = 1;
+        uint64_t start = nowNs();
+        result = pthread_mutex_lock(mutex);
+        waitNs = nowNs() - start;
+    }
+    if (result != 0)
+    {
+        return result;
+    }
+
+    stat->acquiredAt = nowNs();
+    __atomic_fetch_add(&stat->acquisitions, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&stat->contended, contended, __ATOMIC_RELAXED);
+    addSample(stat->waitHist, &stat->waitNs, waitNs);
+    if (site != NULL)
+    {
+        __atomic_fetch_add(&site->acquisitions, 1, __ATOMIC_RELAXED);
+        __atomic_fetch_add(&site->contended, contended, __ATOMIC_RELAXED);
+        __atomic_fetch_add(&site->waitNs, waitNs, __ATOMIC_RELAXED);
+    }
+    return 0;
+}
+
+int lockprofUnlock(pthread_mutex_t *mutex, const char *name)
+{
+    lockStat *stat = findLock(mutex, name, 0);
+    if (stat != NULL && stat->acquiredAt != 0)
+    {
+        addSample(stat->holdHist, &stat->holdNs, nowNs() - stat->acquiredAt);
+    }
+    return pthread_mutex_unlock(mutex);
+}
+
+int lockprofCondWait(pthread_cond_t *cond, pthread_mutex_t *mutex, const char *condName, const char *mutexName, const char *file, int line)
+{
+    lockStat *condStat = findLock(cond, condName, 1);
+    lockStat *mutexStat = findLock(mutex, mutexName, 0);
+
+    // The mutex is released while waiting, so the current hold ends here
+    uint64_t start = nowNs();
+    if (mutexStat != NULL && mutexStat->acquiredAt != 0)
+    {
+        addSample(mutexStat->holdHist, &mutexStat->holdNs, start - mutexStat->acquiredAt);
+    }
+
+    int result = pthread_cond_wait(cond, mutex);
+    uint64_t end = nowNs();
+
+    if (mutexStat != NULL)
+    {
+        mutexStat->acquiredAt = end;
+    }
+    if (condStat != NULL)
+    {
+        __atomic_fetch_add(&condStat->acquisitions, 1, __ATOMIC_RELAXED);
+        addSample(condStat->waitHist, &condStat->waitNs, end - start);
+        lockSite *site = findSite(condStat, file, line);
+        if (site != NULL)
+        {
+            __atomic_fetch_add(&site->acquisitions, 1, __ATOMIC_RELAXED);
+            __atomic_fetch_add(&site->waitNs, end - start, __ATOMIC_RELAXED);
+        }
+    }
+    return result;
+}
+
+int lockprofCondSignal(pthread_cond_t *cond, const char *name, int broadcast)
+{
+    lockStat *stat = findLock(cond, name, 1);
+    if (stat != NULL)
+    {
+        __atomic_fetch_add(&stat->signals, 1, __ATOMIC_RELAXED);
+    }
+    return broadcast ? pthread_cond_broadcast(cond) : pthread_cond_signal(cond);
+}
+
+// Function to estimate a percentile from a histogram (upper bound of the bucket)
+static uint64_t percentile(const uint64_t *hist, double fraction)
+{
+    uint64_t total = 0;
+    for (int i = 0; i < LOCKPROF_BUCKETS; i++)
+    {
+        total += hist[i];
+    }
+    if (total == 0)
+    {
+        return 0;
+    }
+
+    uint64_t target = (uint64_t)(total * fraction);
+    uint64_t seen = 0;
+    for (int i = 0; i < LOCKPROF_BUCKETS; i++)
+    {
+        seen += hist[i];
+        if (seen > target)
+        {
+            return 1ULL << i;
+        }
+    }
+    return 1ULL << (LOCKPROF_BUCKETS - 1);
+}
+
+static int compareByWait(const void *a, const void *b)
+{
+    const lockStat *left = *(const lockStat *const *)a;
+    const lockStat *right = *(const lockStat *const *)b;
+    return (left->waitNs < right->waitNs) - (left->waitNs > right->waitNs);
+}
+
+void lockprofReport(void)
+{
+    int count = __atomic_load_n(&lockCount, __ATOMIC_ACQUIRE);
+    lockStat *ranked[LOCKPROF_MAX_LOCKS];
+    for (int i = 0; i < count; i++)
+    {
+        ranked[i] = &locks[i];
+    }
+    qsort(ranked, count, sizeof(ranked[0]), compareByWait);
+
+    printf("\n---------------LOCK CONTENTION (ranked by total wait)---------------\n");
+    for (int i = 0; i < count; i++)
+    {
+        lockStat *stat = ranked[i];
+        if (stat->isCond)
+        {
+            printf("%2d. cond  %-20s waits: %lu signals: %lu total wait: %.3f ms wait p50/p99: %lu/%lu ns\n",
+                   i + 1, stat->name, stat->acquisitions, stat->signals, stat->waitNs / 1e6,
+                   percentile(stat->waitHist, 0.50), percentile(stat->waitHist, 0.99));
+        }
+        else
+        {
+            printf("%2d. mutex %-20s acquisitions: %lu contended: %lu (%.1f%%) total wait: %.3f ms total hold: %.3f ms\n",
+                   i + 1, stat->name, stat->acquisitions, stat->contended,
+                   stat->acquisitions ? 100.0 * stat->contended / stat->acquisitions : 0.0,
+                   stat->waitNs / 1e6, stat->holdNs / 1e6);
+            printf("    wait p50/p99: %lu/%lu ns hold p50/p99: %lu/%lu ns\n",
+                   percentile(stat->waitHist, 0.50), percentile(stat->waitHist, 0.99),
+                   percentile(stat->holdHist, 0.50), percentile(stat->holdHist, 0.99));
+        }
+
+        for (int j = 0; j < stat->siteCount; j++)
+        {
+            lockSite *site = &stat->sites[j];
+            printf("    %s:%d  count: %lu contended: %lu wait: %.3f ms\n",
+                   site->file, site->line, site->acquisitions, site->contended, site->waitNs / 1e6);
+        }
+    }
+}
+
+#endif
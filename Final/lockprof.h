@@ -0,0 +1,38 @@
+#ifndef LOCKPROF_H
+#define LOCKPROF_H
+
+#include <pthread.h>
+
+// Build with `make LOCKPROF=1` to profile every named mutex and condition
+// variable. Without it the macros below are plain pthread calls.
+#ifdef LOCKPROF
+
+#define LOCKPROF_MAX_LOCKS 32  // Distinct mutexes and condition variables that can be tracked
+#define LOCKPROF_MAX_SITES 16  // Distinct call sites tracked per lock
+#define LOCKPROF_BUCKETS 40    // Power-of-two nanosecond histogram buckets
+
+#define MUTEX_LOCK(m) lockprofLock((m), #m, __FILE__, __LINE__)
+#define MUTEX_UNLOCK(m) lockprofUnlock((m), #m)
+#define COND_WAIT(c, m) lockprofCondWait((c), (m), #c, #m, __FILE__, __LINE__)
+#define COND_SIGNAL(c) lockprofCondSignal((c), #c, 0)
+#define COND_BROADCAST(c) lockprofCondSignal((c), #c, 1)
+
+int lockprofLock(pthread_mutex_t *mutex, const char *name, const char *file, int line);
+int lockprofUnlock(pthread_mutex_t *mutex, const char *name);
+int lockprofCondWait(pthread_cond_t *cond, pthread_mutex_t *mutex, const char *condName, const char *mutexName, const char *file, int line);
+int lockprofCondSignal(pthread_cond_t *cond, const char *name, int broadcast);
+void lockprofReport(void); // Print every lock ranked by total wait time
+
+#else
+
+#define MUTEX_LOCK(m) pthread_mutex_lock(m)
+#define MUTEX_UNLOCK(m) pthread_mutex_unlock(m)
+#define COND_WAIT(c, m) pthread_cond_wait((c), (m))
+#define COND_SIGNAL(c) pthread_cond_signal(c)
+#define COND_BROADCAST(c) pthread_cond_broadcast(c)
+
+static inline void lockprofReport(void) {}
+
+#endif
+
+#endif
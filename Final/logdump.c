@@ -0,0 +1,361 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <arpa/inet.h>
+
+#include "eventlog.h"
+
+// Decodes pideshop binary event logs to text or CSV, or computes per-stage
+// latency percentiles from them. Pass rotated files oldest first
+// (serverLog.bin.2 serverLog.bin.1 serverLog.bin) to keep events in order.
+// Files of earlier server runs may be among them, each run is decoded on its own.
+
+typedef enum
+{
+    STAGE_RECEIVED,
+    STAGE_COOK_STARTED,
+    STAGE_READY,
+    STAGE_OUT_FOR_DELIVERY,
+    STAGE_DELIVERED,
+    STAGE_COUNT
+} orderStage;
+
+typedef struct
+{
+    uint64_t at[STAGE_COUNT]; // Timestamp of each stage, 0 if not seen
+    int tier;                 // Tier from ORDER_RECEIVED
+} orderTimeline;
+
+typedef struct
+{
+    double *values; // Latencies in milliseconds
+    size_t count;
+    size_t capacity;
+} sampleList;
+
+orderTimeline *timelines = NULL; // Indexed by order ID
+size_t timelineCapacity = 0;
+uint64_t firstTimestamp = 0;     // Monotonic time of the run's first file header, for relative times
+
+// Each stage runs from one event to the next one of the same order
+const char *stageNames[STAGE_COUNT - 1] = {"order queue wait", "kitchen", "delivery queue wait", "delivery"};
+sampleList stageSamples[STAGE_COUNT - 1], totalSamples, tierSamples[3]; // Latencies of every run so far
+size_t incomplete = 0;                                                    // Orders received but never delivered
+size_t outOfOrder[STAGE_COUNT - 1];                                       // Stages whose end was logged before their start
+
+const char *tierLabels[3] = {"regular", "express", "vip"};
+
+void addSample(sampleList *list, double value)
+{
+    if (list->count == list->capacity)
+    {
+        list->capacity = list->capacity ? list->capacity * 2 : 1024;
+        list->values = realloc(list->values, list->capacity * sizeof(double));
+        if (list->values == NULL)
+        {
+            fprintf(stderr, "Memory allocation failed\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    list->values[list->count++] = value;
+}
+
+int compareDoubles(const void *a, const void *b)
+{
+    double left = *(const double *)a, right = *(const double *)b;
+    return (left > right) - (left < right);
+}
+
+void printSamples(const char *name, sampleList *list)
+{
+    if (list->count == 0)
+    {
+        printf("%-22s %8d\n", name, 0);
+        return;
+    }
+    qsort(list->values, list->count, sizeof(double), compareDoubles);
+    double sum = 0;
+    for (size_t i = 0; i < list->count; i++)
+    {
+        sum += list->values[i];
+    }
+    printf("%-22s %8zu %10.3f %10.3f %10.3f %10.3f %10.3f\n", name, list->count, sum / list->count,
+           list->values[(size_t)(0.50 * (list->count - 1))], list->values[(size_t)(0.90 * (list->count - 1))],
+           list->values[(size_t)(0.99 * (list->count - 1))], list->values[list->count - 1]);
+}
+
+orderTimeline *timelineFor(uint32_t orderID)
+{
+    if (orderID >= timelineCapacity)
+    {
+        size_t capacity = timelineCapacity ? timelineCapacity : 1024;
+        while (capacity <= orderID)
+        {
+            capacity *= 2;
+        }
+        timelines = realloc(timelines, capacity * sizeof(orderTimeline));
+        if (timelines == NULL)
+        {
+            fprintf(stderr, "Memory allocation failed\n");
+            exit(EXIT_FAILURE);
+        }
+        memset(timelines + timelineCapacity, 0, (capacity - timelineCapacity) * sizeof(orderTimeline));
+        timelineCapacity = capacity;
+    }
+    return &timelines[orderID];
+}
+
+void printText(const eventRecord *record)
+{
+    const char *name = record->type < EV_TYPE_COUNT ? eventNames[record->type] : "UNKNOWN";
+    printf("+%.6f tid %-7u %-17s", (record->timestamp - firstTimestamp) / 1e9, record->tid, name);
+    if (record->orderID != 0)
+    {
+        printf(" order %u", record->orderID);
+    }
+
+    switch (record->type)
+    {
+    case EV_SERVER_STARTED:
+        printf(" port %d cooks %d couriers %d", record->payload[0], record->payload[1], record->payload[2]);
+        break;
+    case EV_CLIENT_CONNECTED:
+    {
+        struct in_addr address = {.s_addr = (uint32_t)record->payload[0]};
+        printf(" from %s:%d", inet_ntoa(address), record->payload[1]);
+        break;
+    }
+    case EV_ORDER_RECEIVED:
+        printf(" x=%d y=%d tier=%s pending=%d", record->payload[0], record->payload[1],
+               record->arg < 3 ? tierLabels[record->arg] : "?", record->payload[2]);
+        break;
+    case EV_COOK_STARTED:
+        printf(" cook %u preparing time %d", record->arg, record->payload[0]);
+        break;
+    case EV_ORDER_READY:
+        printf(" cook %u", record->arg);
+        break;
+    case EV_OUT_FOR_DELIVERY:
+        printf(" courier %u delivery time %d", record->arg, record->payload[0]);
+        break;
+    case EV_ORDER_DELIVERED:
+        printf(" courier %u to (%d, %d)", record->arg, record->payload[0], record->payload[1]);
+        break;
+    }
+    printf("\n");
+}
+
+void printCsv(const eventRecord *record)
+{
+    const char *name = record->type < EV_TYPE_COUNT ? eventNames[record->type] : "UNKNOWN";
+    printf("%lu,%s,%u,%u,%u,%d,%d,%d\n", record->timestamp, name, record->orderID, record->tid, record->arg,
+           record->payload[0], record->payload[1], record->payload[2]);
+}
+
+void collectStats(const eventRecord *record)
+{
+    if (record->orderID == 0)
+    {
+        return;
+    }
+
+    orderTimeline *timeline = timelineFor(record->orderID);
+    switch (record->type)
+    {
+    case EV_ORDER_RECEIVED:
+        timeline->at[STAGE_RECEIVED] = record->timestamp;
+        timeline->tier = record->arg;
+        break;
+    case EV_COOK_STARTED:
+        timeline->at[STAGE_COOK_STARTED] = record->timestamp;
+        break;
+    case EV_ORDER_READY:
+        timeline->at[STAGE_READY] = record->timestamp;
+        break;
+    case EV_OUT_FOR_DELIVERY:
+        timeline->at[STAGE_OUT_FOR_DELIVERY] = record->timestamp;
+        break;
+    case EV_ORDER_DELIVERED:
+        timeline->at[STAGE_DELIVERED] = record->timestamp;
+        break;
+    }
+}
+
+// Function to turn the timelines of one run into samples; order IDs restart with every
+// run, so timelines are cleared before the next run's events come in
+void foldTimelines()
+{
+    for (size_t id = 0; id < timelineCapacity; id++)
+    {
+        orderTimeline *timeline = &timelines[id];
+        if (timeline->at[STAGE_RECEIVED] == 0)
+        {
+            continue;
+        }
+        for (int stage = 0; stage < STAGE_COUNT - 1; stage++)
+        {
+            if (timeline->at[stage] == 0 || timeline->at[stage + 1] == 0)
+            {
+                continue;
+            }
+            if (timeline->at[stage + 1] >= timeline->at[stage])
+            {
+                addSample(&stageSamples[stage], (timeline->at[stage + 1] - timeline->at[stage]) / 1e6);
+            }
+            else
+            {
+                outOfOrder[stage]++;
+            }
+        }
+        if (timeline->at[STAGE_DELIVERED] == 0)
+        {
+            incomplete++;
+            continue;
+        }
+        double latency = (timeline->at[STAGE_DELIVERED] - timeline->at[STAGE_RECEIVED]) / 1e6;
+        addSample(&totalSamples, latency);
+        if (timeline->tier >= 0 && timeline->tier < 3)
+        {
+            addSample(&tierSamples[timeline->tier], latency);
+        }
+    }
+    if (timelines != NULL)
+    {
+        memset(timelines, 0, timelineCapacity * sizeof(orderTimeline));
+    }
+}
+
+void printStats()
+{
+    foldTimelines();
+
+    printf("%-22s %8s %10s %10s %10s %10s %10s\n", "stage (ms)", "orders", "mean", "p50", "p90", "p99", "max");
+    for (int stage = 0; stage < STAGE_COUNT - 1; stage++)
+    {
+        printSamples(stageNames[stage], &stageSamples[stage]);
+    }
+    printSamples("total", &totalSamples);
+    for (int tier = 0; tier < 3; tier++)
+    {
+        char name[32];
+        snprintf(name, sizeof(name), "total (%s)", tierLabels[tier]);
+        printSamples(name, &tierSamples[tier]);
+    }
+    printf("Orders not delivered in this log: %zu\n", incomplete);
+    for (int stage = 0; stage < STAGE_COUNT - 1; stage++)
+    {
+        if (outOfOrder[stage] > 0)
+        {
+            printf("Orders whose %s ended before it started: %zu\n", stageNames[stage], outOfOrder[stage]);
+        }
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    int opt;
+    const char *format = "text";
+    while ((opt = getopt(argc, argv, "f:")) != -1)
+    {
+        if (opt == 'f')
+        {
+            format = optarg;
+        }
+        else
+        {
+            argc = 0;
+        }
+    }
+
+    int isText = strcmp(format, "text") == 0, isCsv = strcmp(format, "csv") == 0, isStats = strcmp(format, "stats") == 0;
+    if (optind >= argc || !(isText || isCsv || isStats))
+    {
+        fprintf(stderr, "Usage: %s [-f text|csv|stats] <Log File>...\n", argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    if (isCsv)
+    {
+        printf("timestamp_ns,type,order,tid,arg,p0,p1,p2\n");
+    }
+
+    uint32_t runPid = 0; // Process that wrote the current run
+    for (int i = optind; i < argc; i++)
+    {
+        int fd = open(argv[i], O_RDONLY);
+        struct stat statbuf;
+        if (fd < 0 || fstat(fd, &statbuf) < 0)
+        {
+            perror(argv[i]);
+            continue;
+        }
+        if ((size_t)statbuf.st_size < sizeof(eventLogHeader))
+        {
+            fprintf(stderr, "%s: too short to be an event log\n", argv[i]);
+            close(fd);
+            continue;
+        }
+
+        const char *map = mmap(NULL, statbuf.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (map == MAP_FAILED)
+        {
+            perror("mmap");
+            continue;
+        }
+
+        const eventLogHeader *header = (const eventLogHeader *)map;
+        if (header->magic != EVENTLOG_MAGIC || header->version != EVENTLOG_VERSION || header->recordSize != sizeof(eventRecord))
+        {
+            fprintf(stderr, "%s: not a version %d pideshop event log\n", argv[i], EVENTLOG_VERSION);
+            munmap((void *)map, statbuf.st_size);
+            continue;
+        }
+        // Every run starts at file index 0, older runs' files may be passed along with it
+        if (firstTimestamp == 0 || header->fileIndex == 0 || header->pid != runPid)
+        {
+            if (firstTimestamp != 0 && isStats)
+            {
+                foldTimelines();
+            }
+            else if (firstTimestamp != 0 && isText)
+            {
+                printf("--- run of pid %u\n", header->pid);
+            }
+            firstTimestamp = header->monotonicNs;
+            runPid = header->pid;
+        }
+
+        // A file cut short by a crash may end in a partial record, which is skipped
+        const eventRecord *records = (const eventRecord *)(map + sizeof(eventLogHeader));
+        size_t count = (statbuf.st_size - sizeof(eventLogHeader)) / sizeof(eventRecord);
+        for (size_t j = 0; j < count; j++)
+        {
+            if (isText)
+            {
+                printText(&records[j]);
+            }
+            else if (isCsv)
+            {
+                printCsv(&records[j]);
+            }
+            else
+            {
+                collectStats(&records[j]);
+            }
+        }
+        munmap((void *)map, statbuf.st_size);
+    }
+
+    if (isStats)
+    {
+        printStats();
+    }
+    free(timelines);
+    return 0;
+}
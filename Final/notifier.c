@@ -0,0 +1,502 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#include "lockprof.h"
+#include "notifier.h"
+#include "perfstat.h"
+#include "placement.h"
+#include "trace.h"
+
+#define NOTIFIER_MAX_IOV 64    // Messages coalesced into one writev
+#define NOTIFIER_MAX_EVENTS 64 // Events handled per epoll_wait
+#define NOTIFIER_MAX_CLOSES 256 // Sockets waiting to be closed after their final message could not be queued
+
+typedef struct notifyMessage
+{
+    struct notifyMessage *next; // Next message for the same socket, or next request
+    int clientSocket;           // Target socket
+    int isWatch;                // Request to take ownership of the socket rather than a message
+    int closeAfter;             // Close the socket once this message is flushed
+    size_t length;              // Bytes in data
+    size_t offset;              // Bytes of data already written
+    char data[];                // Message contents
+} notifyMessage;
+
+typedef struct
+{
+    int watched;          // The notifier owns this socket
+    int gone;             // Client hung up or was dropped, output is discarded
+    int closeAfter;       // Final message has been queued
+    int wantWrite;        // EPOLLOUT is armed
+    int dirty;            // Got new output since the last flush pass
+    size_t queuedBytes;   // Bytes waiting in output
+    notifyMessage *head;  // Oldest unsent message
+    notifyMessage *tail;  // Newest unsent message
+} connection;
+
+static pthread_mutex_t requestMutex = PTHREAD_MUTEX_INITIALIZER; // Protects the request list
+static notifyMessage *requestHead = NULL;                        // Requests not yet seen by the notifier
+static notifyMessage *requestTail = NULL;
+static int pendingCloses[NOTIFIER_MAX_CLOSES];                   // Sockets to close without a message, protected by requestMutex
+static int pendingCloseCount = 0;
+static int wakeFd = -1;                                          // eventfd that wakes the notifier
+static int epollFd = -1;                                         // Watches client sockets and wakeFd
+static size_t limit = NOTIFIER_DEFAULT_LIMIT;                    // Per-socket output limit
+
+static connection *connections = NULL; // Indexed by socket, only touched by the notifier thread
+static int connectionCapacity = 0;
+static int *dirtySockets = NULL;       // Sockets that got new output since the last flush pass
+static int dirtyCount = 0;
+
+static uint64_t messagesSent = 0;  // Messages fully written
+static uint64_t bytesSent = 0;     // Bytes written to clients
+static uint64_t writevCalls = 0;   // writev system calls made
+static uint64_t dropped = 0;       // Clients dropped for exceeding the output limit
+static uint64_t hangups = 0;       // Clients that hung up before their delivery
+
+static connection *getConnection(int fd)
+{
+    if (fd >= connectionCapacity)
+    {
+        int capacity = connectionCapacity ? connectionCapacity : 256;
+        while (capacity <= fd)
+        {
+            capacity *= 2;
+        }
+        connection *grown = realloc(connections, capacity * sizeof(connection));
+        if (grown == NULL)
+        {
+            return NULL;
+        }
+        memset(grown + connectionCapacity, 0, (capacity - connectionCapacity) * sizeof(connection));
+        connections = grown;
+
+        int *grownDirty = realloc(dirtySockets, capacity * sizeof(int)); // A socket is listed at most once
+        if (grownDirty == NULL)
+        {
+            return NULL;
+        }
+        dirtySockets = grownDirty;
+        connectionCapacity = capacity;
+    }
+    return &connections[fd];
+}
+
+static void discardOutput(connection *conn)
+{
+    while (conn->head != NULL)
+    {
+        notifyMessage *next = conn->head->next;
+        free(conn->head);
+        conn->head = next;
+    }
+    conn->tail = NULL;
+    conn->queuedBytes = 0;
+}
+
+static void closeConnection(int fd, connection *conn)
+{
+    discardOutput(conn);
+    if (!conn->gone)
+    {
+        epoll_ctl(epollFd, EPOLL_CTL_DEL, fd, NULL);
+    }
+    close(fd);
+    int dirty = conn->dirty; // The socket may still be listed in dirtySockets
+    memset(conn, 0, sizeof(*conn));
+    conn->dirty = dirty;
+}
+
+// Function to stop talking to a client but keep its fd reserved until its delivery completes
+static void abandonConnection(int fd, connection *conn)
+{
+    discardOutput(conn);
+    if (!conn->gone)
+    {
+        epoll_ctl(epollFd, EPOLL_CTL_DEL, fd, NULL);
+        shutdown(fd, SHUT_RDWR);
+        conn->gone = 1;
+    }
+    if (conn->closeAfter)
+    {
+        closeConnection(fd, conn);
+    }
+}
+
+static void armWrite(int fd, connection *conn, int wantWrite)
+{
+    if (conn->wantWrite != wantWrite && !conn->gone)
+    {
+        struct epoll_event event = {.events = EPOLLIN | EPOLLRDHUP | (wantWrite ? EPOLLOUT : 0), .data.fd = fd};
+        epoll_ctl(epollFd, EPOLL_CTL_MOD, fd, &event);
+        conn->wantWrite = wantWrite;
+    }
+}
+
+// Function to write as much queued output as the socket takes, coalescing messages
+static void flushConnection(int fd, connection *conn)
+{
+    while (conn->head != NULL)
+    {
+        struct iovec iov[NOTIFIER_MAX_IOV];
+        int count = 0;
+        for (notifyMessage *message = conn->head; message != NULL && count < NOTIFIER_MAX_IOV; message = message->next)
+        {
+            iov[count].iov_base = message->data + message->offset;
+            iov[count].iov_len = message->length - message->offset;
+            count++;
+        }
+
+        ssize_t written = writev(fd, iov, count);
+        writevCalls++;
+        if (written < 0)
+        {
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+            {
+                armWrite(fd, conn, 1);
+                return;
+            }
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            hangups++;
+            abandonConnection(fd, conn);
+            return;
+        }
+
+        bytesSent += written;
+        conn->queuedBytes -= written;
+        while (written > 0)
+        {
+            notifyMessage *message = conn->head;
+            size_t remaining = message->length - message->offset;
+            if ((size_t)written < remaining)
+            {
+                message->offset += written;
+                break;
+            }
+            written -= remaining;
+            conn->head = message->next;
+            free(message);
+            messagesSent++;
+        }
+        if (conn->head == NULL)
+        {
+            conn->tail = NULL;
+        }
+    }
+
+    armWrite(fd, conn, 0);
+    if (conn->closeAfter)
+    {
+        closeConnection(fd, conn);
+    }
+}
+
+static void handleRequest(notifyMessage *request)
+{
+    int fd = request->clientSocket;
+    connection *conn = getConnection(fd);
+    if (conn == NULL)
+    {
+        free(request);
+        return;
+    }
+
+    if (request->isWatch)
+    {
+        free(request);
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+        int dirty = conn->dirty;
+        memset(conn, 0, sizeof(*conn));
+        conn->dirty = dirty;
+        conn->watched = 1;
+        struct epoll_event event = {.events = EPOLLIN | EPOLLRDHUP, .data.fd = fd};
+        epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event);
+        return;
+    }
+
+    if (!conn->watched) // Not ours, the caller keeps ownership
+    {
+        free(request);
+        return;
+    }
+
+    conn->closeAfter |= request->closeAfter;
+    if (conn->gone)
+    {
+        free(request);
+        if (conn->closeAfter)
+        {
+            closeConnection(fd, conn);
+        }
+        return;
+    }
+
+    if (conn->queuedBytes + request->length > limit)
+    {
+        free(request);
+        dropped++;
+        abandonConnection(fd, conn);
+        return;
+    }
+
+    request->next = NULL;
+    if (conn->tail != NULL)
+    {
+        conn->tail->next = request;
+    }
+    else
+    {
+        conn->head = request;
+    }
+    conn->tail = request;
+    conn->queuedBytes += request->length;
+    if (!conn->dirty)
+    {
+        conn->dirty = 1;
+        dirtySockets[dirtyCount++] = fd;
+    }
+}
+
+// Function to close a socket whose final message could not be allocated, once its queued output is flushed
+static void handleClose(int fd)
+{
+    connection *conn = getConnection(fd);
+    if (conn == NULL || !conn->watched)
+    {
+        return;
+    }
+    conn->closeAfter = 1;
+    if (conn->gone || conn->head == NULL)
+    {
+        closeConnection(fd, conn);
+    }
+}
+
+// Function to read whatever the client sent; only hangups matter
+static void handleReadable(int fd, connection *conn)
+{
+    char buffer[256];
+    while (1)
+    {
+        ssize_t length = recv(fd, buffer, sizeof(buffer), 0);
+        if (length > 0)
+        {
+            continue; // CANCEL or stray input, delivery goes ahead regardless
+        }
+        if (length < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        {
+            return;
+        }
+        if (length < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        hangups++;
+        abandonConnection(fd, conn);
+        return;
+    }
+}
+
+static void *notifierThread(void *arg)
+{
+    (void)arg;
+    traceThreadName("notifier");
+    placementApply(ROLE_IO);
+
+    struct epoll_event events[NOTIFIER_MAX_EVENTS];
+    while (1)
+    {
+        int count = epoll_wait(epollFd, events, NOTIFIER_MAX_EVENTS, -1);
+        if (count < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            perror("epoll_wait");
+            return NULL;
+        }
+
+        for (int i = 0; i < count; i++)
+        {
+            int fd = events[i].data.fd;
+            if (fd == wakeFd)
+            {
+                uint64_t wakeups;
+                if (read(wakeFd, &wakeups, sizeof(wakeups)) < 0 && errno != EAGAIN)
+                {
+                    perror("read eventfd");
+                }
+
+                perfScopeBegin(PERF_NOTIFY);
+                MUTEX_LOCK(&requestMutex);
+                notifyMessage *request = requestHead;
+                requestHead = requestTail = NULL;
+                int closes[NOTIFIER_MAX_CLOSES];
+                int closeCount = pendingCloseCount;
+                memcpy(closes, pendingCloses, closeCount * sizeof(int));
+                pendingCloseCount = 0;
+                MUTEX_UNLOCK(&requestMutex);
+
+                // Queue everything first, then flush each touched socket once
+                while (request != NULL)
+                {
+                    notifyMessage *next = request->next;
+                    handleRequest(request);
+                    request = next;
+                }
+                for (int j = 0; j < closeCount; j++)
+                {
+                    handleClose(closes[j]);
+                }
+                for (int j = 0; j < dirtyCount; j++)
+                {
+                    connection *conn = &connections[dirtySockets[j]];
+                    conn->dirty = 0;
+                    if (conn->watched && !conn->gone && conn->head != NULL && !conn->wantWrite)
+                    {
+                        flushConnection(dirtySockets[j], conn);
+                    }
+                }
+                dirtyCount = 0;
+                perfScopeEnd(PERF_NOTIFY);
+                continue;
+            }
+
+            connection *conn = getConnection(fd);
+            if (conn == NULL || !conn->watched || conn->gone)
+            {
+                continue;
+            }
+            if (events[i].events & EPOLLOUT)
+            {
+                perfScopeBegin(PERF_NOTIFY);
+                flushConnection(fd, conn);
+                perfScopeEnd(PERF_NOTIFY);
+            }
+            if (conn->watched && !conn->gone && (events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)))
+            {
+                handleReadable(fd, conn);
+            }
+        }
+    }
+    return NULL;
+}
+
+static void pushRequest(notifyMessage *request)
+{
+    request->next = NULL;
+    MUTEX_LOCK(&requestMutex);
+    if (requestTail != NULL)
+    {
+        requestTail->next = request;
+    }
+    else
+    {
+        requestHead = request;
+    }
+    requestTail = request;
+    MUTEX_UNLOCK(&requestMutex);
+
+    uint64_t one = 1;
+    if (write(wakeFd, &one, sizeof(one)) < 0)
+    {
+        perror("write eventfd");
+    }
+}
+
+int notifierStart(size_t outputLimit)
+{
+    limit = outputLimit;
+    wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    epollFd = epoll_create1(EPOLL_CLOEXEC);
+    if (wakeFd < 0 || epollFd < 0)
+    {
+        perror("notifier setup");
+        return -1;
+    }
+
+    struct epoll_event event = {.events = EPOLLIN, .data.fd = wakeFd};
+    epoll_ctl(epollFd, EPOLL_CTL_ADD, wakeFd, &event);
+
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, notifierThread, NULL) != 0)
+    {
+        return -1;
+    }
+    pthread_detach(thread);
+    return 0;
+}
+
+int notifierWatch(int clientSocket)
+{
+    notifyMessage *request = calloc(1, sizeof(notifyMessage));
+    if (request == NULL)
+    {
+        return -1; // The notifier never saw the socket, the caller still owns it
+    }
+    request->clientSocket = clientSocket;
+    request->isWatch = 1;
+    pushRequest(request);
+    return 0;
+}
+
+void notifierSend(int clientSocket, const char *message, size_t length, int closeAfter)
+{
+    notifyMessage *request = malloc(sizeof(notifyMessage) + length);
+    if (request == NULL)
+    {
+        // The notifier owns the socket, so only it may close it: pass the fd on without a message.
+        // If even that list is full, shut the socket down so the client at least sees EOF.
+        perror("notifier");
+        if (!closeAfter)
+        {
+            return;
+        }
+        MUTEX_LOCK(&requestMutex);
+        int listed = pendingCloseCount < NOTIFIER_MAX_CLOSES;
+        if (listed)
+        {
+            pendingCloses[pendingCloseCount++] = clientSocket;
+        }
+        MUTEX_UNLOCK(&requestMutex);
+        if (!listed)
+        {
+            shutdown(clientSocket, SHUT_RDWR);
+            return;
+        }
+        uint64_t one = 1;
+        if (write(wakeFd, &one, sizeof(one)) < 0)
+        {
+            perror("write eventfd");
+        }
+        return;
+    }
+    request->clientSocket = clientSocket;
+    request->isWatch = 0;
+    request->closeAfter = closeAfter;
+    request->length = length;
+    request->offset = 0;
+    memcpy(request->data, message, length);
+    pushRequest(request);
+}
+
+void notifierReport(void)
+{
+    printf("Notifier: %lu messages, %lu bytes in %lu writev calls, %lu clients dropped over the %zu byte limit, %lu hangups\n",
+           messagesSent, bytesSent, writevCalls, dropped, limit, hangups);
+}
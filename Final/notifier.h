@@ -0,0 +1,21 @@
+#ifndef NOTIFIER_H
+#define NOTIFIER_H
+
+#include <stddef.h>
+
+#define NOTIFIER_DEFAULT_LIMIT 65536 // Default bytes that may be queued for one client
+
+// The notifier thread owns every client socket handed to it. It writes
+// queued messages with non-blocking writev and closes the socket once the
+// final message is flushed, so callers never block on a slow client.
+//
+// A socket is only closed after its final message was processed, even if
+// the client hung up or went over its limit earlier. This keeps the fd
+// number from being reused while an order still refers to it.
+
+int notifierStart(size_t outputLimit);                                 // Start the notifier thread, -1 on failure
+int notifierWatch(int clientSocket);                                   // Hand a client socket over to the notifier, -1 if it stays with the caller
+void notifierSend(int clientSocket, const char *message, size_t length, int closeAfter); // Queue a message, never blocks on I/O
+void notifierReport(void);                                             // Print notifier statistics
+
+#endif
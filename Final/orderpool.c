@@ -0,0 +1,165 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "lockprof.h"
+#include "orderpool.h"
+
+#define HANDLE_QUEUE_INITIAL 64 // Capacity of a handle queue on its first push
+
+// The chunk pointer is loaded atomically since orderGet runs without the mutex while
+// growPool may be publishing a new chunk; the chunks array itself never moves
+static orderSlot *slotAt(orderPool *pool, uint32_t index)
+{
+    orderSlot *chunk = __atomic_load_n(&pool->chunks[index / ORDER_POOL_CHUNK], __ATOMIC_ACQUIRE);
+    return chunk == NULL ? NULL : &chunk[index % ORDER_POOL_CHUNK];
+}
+
+void orderPoolInit(orderPool *pool)
+{
+    memset(pool, 0, sizeof(*pool));
+    pthread_mutex_init(&pool->mutex, NULL);
+}
+
+void orderPoolDestroy(orderPool *pool)
+{
+    for (uint32_t i = 0; i < pool->chunkCount; i++)
+    {
+        free(pool->chunks[i]);
+    }
+    pthread_mutex_destroy(&pool->mutex);
+}
+
+// Function to add one chunk of free slots to the pool, called with the mutex held
+static int growPool(orderPool *pool)
+{
+    if (pool->chunkCount == ORDER_POOL_MAX_CHUNKS)
+    {
+        return -1;
+    }
+
+    orderSlot *chunk = calloc(ORDER_POOL_CHUNK, sizeof(orderSlot));
+    if (chunk == NULL)
+    {
+        return -1;
+    }
+
+    // Thread the new slots onto the free list, lowest index first
+    uint32_t base = pool->chunkCount * ORDER_POOL_CHUNK;
+    for (uint32_t i = 0; i < ORDER_POOL_CHUNK; i++)
+    {
+        chunk[i].generation = 1;
+        chunk[i].nextFree = i + 1 < ORDER_POOL_CHUNK ? base + i + 2 : pool->freeHead;
+    }
+    __atomic_store_n(&pool->chunks[pool->chunkCount++], chunk, __ATOMIC_RELEASE); // Slots are ready before readers see them
+    pool->freeHead = base + 1;
+    return 0;
+}
+
+orderHandle orderAlloc(orderPool *pool)
+{
+    MUTEX_LOCK(&pool->mutex);
+    if (pool->freeHead == 0 && growPool(pool) < 0)
+    {
+        MUTEX_UNLOCK(&pool->mutex);
+        return ORDER_HANDLE_NONE;
+    }
+
+    uint32_t index = pool->freeHead - 1;
+    orderSlot *slot = slotAt(pool, index);
+    pool->freeHead = slot->nextFree;
+    pool->allocations++;
+    if (++pool->live > pool->peak)
+    {
+        pool->peak = pool->live;
+    }
+    MUTEX_UNLOCK(&pool->mutex);
+
+    memset(&slot->order, 0, sizeof(slot->order));
+    return (slot->generation << ORDER_HANDLE_INDEX_BITS) | index;
+}
+
+orderStruct *orderGet(orderPool *pool, orderHandle handle)
+{
+    uint32_t index = handle & ORDER_HANDLE_INDEX_MASK;
+    if (handle == ORDER_HANDLE_NONE || index / ORDER_POOL_CHUNK >= ORDER_POOL_MAX_CHUNKS)
+    {
+        return NULL;
+    }
+
+    orderSlot *slot = slotAt(pool, index);
+    if (slot == NULL || __atomic_load_n(&slot->generation, __ATOMIC_ACQUIRE) != handle >> ORDER_HANDLE_INDEX_BITS)
+    {
+        return NULL;
+    }
+    return &slot->order;
+}
+
+void orderFree(orderPool *pool, orderHandle handle)
+{
+    uint32_t index = handle & ORDER_HANDLE_INDEX_MASK;
+    if (handle == ORDER_HANDLE_NONE || index / ORDER_POOL_CHUNK >= ORDER_POOL_MAX_CHUNKS)
+    {
+        return;
+    }
+
+    // Validate under the mutex, so of two frees of one handle only the first bumps the generation
+    MUTEX_LOCK(&pool->mutex);
+    orderSlot *slot = slotAt(pool, index);
+    if (slot == NULL || slot->generation != handle >> ORDER_HANDLE_INDEX_BITS)
+    {
+        MUTEX_UNLOCK(&pool->mutex);
+        return; // Stale handle, the order was already freed
+    }
+    uint32_t maxGeneration = (1u << (32 - ORDER_HANDLE_INDEX_BITS)) - 1;
+    __atomic_store_n(&slot->generation, slot->generation == maxGeneration ? 1 : slot->generation + 1, __ATOMIC_RELEASE); // Skip 0 so NONE stays invalid
+    slot->nextFree = pool->freeHead;
+    pool->freeHead = index + 1;
+    pool->live--;
+    MUTEX_UNLOCK(&pool->mutex);
+}
+
+int handleQueuePush(handleQueue *queue, orderHandle handle)
+{
+    if (queue->count == queue->capacity)
+    {
+        uint32_t capacity = queue->capacity ? queue->capacity * 2 : HANDLE_QUEUE_INITIAL;
+        orderHandle *items = malloc(capacity * sizeof(orderHandle));
+        if (items == NULL)
+        {
+            return -1;
+        }
+
+        // Unwrap the ring so the oldest handle lands at index 0
+        for (uint32_t i = 0; i < queue->count; i++)
+        {
+            items[i] = queue->items[(queue->head + i) & (queue->capacity - 1)];
+        }
+        free(queue->items);
+        queue->items = items;
+        queue->capacity = capacity;
+        queue->head = 0;
+    }
+
+    queue->items[(queue->head + queue->count) & (queue->capacity - 1)] = handle;
+    queue->count++;
+    return 0;
+}
+
+orderHandle handleQueuePop(handleQueue *queue)
+{
+    if (queue->count == 0)
+    {
+        return ORDER_HANDLE_NONE;
+    }
+
+    orderHandle handle = queue->items[queue->head];
+    queue->head = (queue->head + 1) & (queue->capacity - 1);
+    queue->count--;
+    return handle;
+}
+
+void handleQueueDestroy(handleQueue *queue)
+{
+    free(queue->items);
+    memset(queue, 0, sizeof(*queue));
+}
@@ -0,0 +1,64 @@
+#ifndef ORDERPOOL_H
+#define ORDERPOOL_H
+
+#include <stdint.h>
+#include <pthread.h>
+
+#define ORDER_POOL_CHUNK 256                                         // Orders allocated at once when the pool grows
+#define ORDER_HANDLE_INDEX_BITS 20                                   // Low bits of a handle hold the slot index
+#define ORDER_HANDLE_INDEX_MASK ((1u << ORDER_HANDLE_INDEX_BITS) - 1) // Mask for the slot index
+#define ORDER_POOL_MAX_CHUNKS ((1u << ORDER_HANDLE_INDEX_BITS) / ORDER_POOL_CHUNK)
+#define ORDER_HANDLE_NONE 0 // Never handed out, generations start at 1
+
+typedef struct
+{
+    int orderID;
+    int x;
+    int y;
+    int clientSocket;
+    int status;          // Status of the order: 0 - pending, 1 - cooking, 2 - ready for delivery, 3 - delivered
+    int tier;            // Priority tier, see orderTier
+    uint64_t receivedAt; // Monotonic time the order was received, in nanoseconds
+} orderStruct;
+
+// Handle to a pooled order: high bits are the slot generation, low bits the slot index.
+// A handle whose order was freed no longer resolves, even after the slot is reused.
+typedef uint32_t orderHandle;
+
+typedef struct
+{
+    orderStruct order;   // The order record itself
+    uint32_t generation; // Bumped every time the slot is freed
+    uint32_t nextFree;   // Index of the next free slot, valid while on the free list
+} orderSlot;
+
+typedef struct
+{
+    orderSlot *chunks[ORDER_POOL_MAX_CHUNKS]; // Chunks never move once allocated
+    uint32_t chunkCount;                      // Number of allocated chunks
+    uint32_t freeHead;                        // First free slot index + 1, 0 when the free list is empty
+    uint32_t live;                            // Orders currently allocated
+    uint32_t peak;                            // Highest value live has reached
+    uint64_t allocations;                     // Orders handed out so far
+    pthread_mutex_t mutex;                    // Protects everything above
+} orderPool;
+
+typedef struct // Growable FIFO of order handles, callers provide the locking
+{
+    orderHandle *items; // Ring storage
+    uint32_t capacity;  // Size of items, always a power of two
+    uint32_t head;      // Index of the oldest handle
+    uint32_t count;     // Number of queued handles
+} handleQueue;
+
+void orderPoolInit(orderPool *pool);
+void orderPoolDestroy(orderPool *pool);
+orderHandle orderAlloc(orderPool *pool);                  // ORDER_HANDLE_NONE when the pool is exhausted
+orderStruct *orderGet(orderPool *pool, orderHandle handle); // NULL for stale or invalid handles
+void orderFree(orderPool *pool, orderHandle handle);
+
+int handleQueuePush(handleQueue *queue, orderHandle handle); // -1 when growing the ring fails
+orderHandle handleQueuePop(handleQueue *queue);            // ORDER_HANDLE_NONE when empty
+void handleQueueDestroy(handleQueue *queue);
+
+#endif
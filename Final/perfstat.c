@@ -0,0 +1,267 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#include "perfstat.h"
+
+typedef struct perfThread
+{
+    int leader;                                                 // Group leader fd, -1 if no counter opened
+    int fds[PERF_COUNTER_COUNT];                                // Counter fds, -1 if unavailable
+    int position[PERF_COUNTER_COUNT];                           // Index of each counter in a group read
+    int opened;                                                 // Number of counters in the group
+    uint64_t begin[PERF_STAGE_COUNT][PERF_COUNTER_COUNT];       // Counter values when each open scope began
+    uint64_t total[PERF_STAGE_COUNT][PERF_COUNTER_COUNT];       // Counter deltas summed over closed scopes
+    uint64_t scopes[PERF_STAGE_COUNT];                          // Closed scopes per stage
+    struct perfThread *next;                                    // Next live thread in the registry
+} perfThread;
+
+static const char *stageNames[PERF_STAGE_COUNT] = {"accept", "parse", "queue ops", "log", "notify"};
+
+static const struct
+{
+    uint32_t type;
+    uint64_t config;
+    const char *name;
+} counterConfigs[PERF_COUNTER_COUNT] = {
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES, "cycles"},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS, "instructions"},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES, "cache-misses"},
+    {PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES, "context-switches"},
+    {PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK, "task-clock"}};
+
+int perfEnabled = 0;
+
+static perfThread *threads = NULL;                                // Threads with open counters
+static perfThread retired;                                        // Totals of threads that have exited
+static int available[PERF_COUNTER_COUNT];                         // Counters any thread managed to open
+static pthread_mutex_t threadsMutex = PTHREAD_MUTEX_INITIALIZER; // Protects threads, retired and available
+static pthread_key_t threadKey;                                   // Runs retireThread when a thread exits
+static __thread perfThread *localThread = NULL;                   // Counters of the calling thread
+
+static int openCounter(perfCounter counter, int groupFd)
+{
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = counterConfigs[counter].type;
+    attr.config = counterConfigs[counter].config;
+    attr.read_format = PERF_FORMAT_GROUP;
+    // Hardware events count user space only, which perf_event_paranoid=2 allows.
+    // Context switches happen in the kernel, so software events keep it.
+    attr.exclude_kernel = attr.type == PERF_TYPE_HARDWARE;
+    attr.exclude_hv = 1;
+    return syscall(SYS_perf_event_open, &attr, 0, -1, groupFd, 0); // This thread, any CPU
+}
+
+// Function to fold an exiting thread's totals into the retired ones and close its counters
+static void retireThread(void *arg)
+{
+    perfThread *thread = arg;
+
+    pthread_mutex_lock(&threadsMutex);
+    for (perfThread **link = &threads; *link != NULL; link = &(*link)->next)
+    {
+        if (*link == thread)
+        {
+            *link = thread->next;
+            break;
+        }
+    }
+    for (int stage = 0; stage < PERF_STAGE_COUNT; stage++)
+    {
+        retired.scopes[stage] += thread->scopes[stage];
+        for (int counter = 0; counter < PERF_COUNTER_COUNT; counter++)
+        {
+            retired.total[stage][counter] += thread->total[stage][counter];
+        }
+    }
+    pthread_mutex_unlock(&threadsMutex);
+
+    for (int counter = 0; counter < PERF_COUNTER_COUNT; counter++)
+    {
+        if (thread->fds[counter] >= 0)
+        {
+            close(thread->fds[counter]);
+        }
+    }
+    free(thread);
+}
+
+// Function to get (and lazily open) the counters of the calling thread
+static perfThread *getThread(void)
+{
+    if (localThread != NULL)
+    {
+        return localThread;
+    }
+
+    perfThread *thread = calloc(1, sizeof(perfThread));
+    if (thread == NULL)
+    {
+        return NULL;
+    }
+
+    // The first counter that opens leads the group so one read returns all of them
+    thread->leader = -1;
+    for (int counter = 0; counter < PERF_COUNTER_COUNT; counter++)
+    {
+        thread->fds[counter] = openCounter(counter, thread->leader);
+        if (thread->fds[counter] < 0)
+        {
+            continue;
+        }
+        if (thread->leader < 0)
+        {
+            thread->leader = thread->fds[counter];
+        }
+        thread->position[counter] = thread->opened++;
+    }
+
+    pthread_mutex_lock(&threadsMutex);
+    for (int counter = 0; counter < PERF_COUNTER_COUNT; counter++)
+    {
+        available[counter] |= thread->fds[counter] >= 0;
+    }
+    thread->next = threads;
+    threads = thread;
+    pthread_mutex_unlock(&threadsMutex);
+
+    pthread_setspecific(threadKey, thread);
+    localThread = thread;
+    return thread;
+}
+
+// Function to read every counter of the calling thread in one system call
+static int readCounters(perfThread *thread, uint64_t values[PERF_COUNTER_COUNT])
+{
+    uint64_t buffer[1 + PERF_COUNTER_COUNT]; // nr followed by one value per group member
+    if (thread->leader < 0 || read(thread->leader, buffer, sizeof(buffer)) < (ssize_t)sizeof(uint64_t))
+    {
+        return -1;
+    }
+    for (int counter = 0; counter < PERF_COUNTER_COUNT; counter++)
+    {
+        int position = thread->position[counter];
+        values[counter] = thread->fds[counter] >= 0 && (uint64_t)position < buffer[0] ? buffer[1 + position] : 0;
+    }
+    return 0;
+}
+
+int perfStatInit(void)
+{
+    perfThread *thread;
+    if (pthread_key_create(&threadKey, retireThread) != 0)
+    {
+        return -1;
+    }
+    perfEnabled = 1;
+
+    // Open the main thread's counters now so an unusable perf_event_open is reported at startup
+    thread = getThread();
+    if (thread == NULL || thread->leader < 0)
+    {
+        perror("perf_event_open");
+        perfEnabled = 0;
+        return -1;
+    }
+    for (int counter = 0; counter < PERF_COUNTER_COUNT; counter++)
+    {
+        if (thread->fds[counter] < 0)
+        {
+            printf("perf counter %s is not available, reported as n/a\n", counterConfigs[counter].name);
+        }
+    }
+    return 0;
+}
+
+void perfScopeBegin(perfStage stage)
+{
+    if (!perfEnabled)
+    {
+        return;
+    }
+    perfThread *thread = getThread();
+    if (thread != NULL)
+    {
+        readCounters(thread, thread->begin[stage]);
+    }
+}
+
+void perfScopeEnd(perfStage stage)
+{
+    if (!perfEnabled)
+    {
+        return;
+    }
+    perfThread *thread = getThread();
+    uint64_t now[PERF_COUNTER_COUNT];
+    if (thread == NULL || readCounters(thread, now) < 0)
+    {
+        return;
+    }
+    for (int counter = 0; counter < PERF_COUNTER_COUNT; counter++)
+    {
+        thread->total[stage][counter] += now[counter] - thread->begin[stage][counter];
+    }
+    thread->scopes[stage]++;
+}
+
+void perfStatReport(uint64_t orders)
+{
+    if (!perfEnabled)
+    {
+        return;
+    }
+
+    // Live threads are still counting, so their totals are a snapshot
+    perfThread sum = retired;
+    pthread_mutex_lock(&threadsMutex);
+    for (perfThread *thread = threads; thread != NULL; thread = thread->next)
+    {
+        for (int stage = 0; stage < PERF_STAGE_COUNT; stage++)
+        {
+            sum.scopes[stage] += thread->scopes[stage];
+            for (int counter = 0; counter < PERF_COUNTER_COUNT; counter++)
+            {
+                sum.total[stage][counter] += thread->total[stage][counter];
+            }
+        }
+    }
+    pthread_mutex_unlock(&threadsMutex);
+
+    double perOrder = orders > 0 ? 1.0 / orders : 0;
+    printf("\nHardware counters per stage over %lu orders (user-space cycles/instructions/misses):\n", orders);
+    printf("%-10s %9s %8s %14s %14s %14s %14s\n", "stage", "scopes", "IPC", "cycles/order", "misses/order", "switches/order", "cpu us/order");
+    for (int stage = 0; stage < PERF_STAGE_COUNT; stage++)
+    {
+        uint64_t *total = sum.total[stage];
+        char ipc[16] = "n/a", cycles[16] = "n/a", misses[16] = "n/a", switches[16] = "n/a", cpu[16] = "n/a";
+        if (available[PERF_CYCLES] && available[PERF_INSTRUCTIONS] && total[PERF_CYCLES] > 0)
+        {
+            snprintf(ipc, sizeof(ipc), "%.2f", (double)total[PERF_INSTRUCTIONS] / total[PERF_CYCLES]);
+        }
+        if (available[PERF_CYCLES])
+        {
+            snprintf(cycles, sizeof(cycles), "%.0f", total[PERF_CYCLES] * perOrder);
+        }
+        if (available[PERF_CACHE_MISSES])
+        {
+            snprintf(misses, sizeof(misses), "%.2f", total[PERF_CACHE_MISSES] * perOrder);
+        }
+        if (available[PERF_CONTEXT_SWITCHES])
+        {
+            snprintf(switches, sizeof(switches), "%.3f", total[PERF_CONTEXT_SWITCHES] * perOrder);
+        }
+        if (available[PERF_TASK_CLOCK])
+        {
+            snprintf(cpu, sizeof(cpu), "%.2f", total[PERF_TASK_CLOCK] * perOrder / 1000.0);
+        }
+        printf("%-10s %9lu %8s %14s %14s %14s %14s\n", stageNames[stage], sum.scopes[stage], ipc, cycles, misses, switches, cpu);
+    }
+}
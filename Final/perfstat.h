@@ -0,0 +1,33 @@
+#ifndef PERFSTAT_H
+#define PERFSTAT_H
+
+#include <stdint.h>
+
+typedef enum // Server stages that hardware counters are attributed to
+{
+    PERF_ACCEPT, // Accepting a connection and handing it to a manager thread
+    PERF_PARSE,  // Receiving and parsing an order
+    PERF_QUEUE,  // Locking and pushing to or popping from the order and delivery queues
+    PERF_LOG,    // Writing event log records
+    PERF_NOTIFY, // Queuing and writing delivery notifications
+    PERF_STAGE_COUNT
+} perfStage;
+
+typedef enum // Counters opened for every thread that enters a scope
+{
+    PERF_CYCLES,
+    PERF_INSTRUCTIONS,
+    PERF_CACHE_MISSES,
+    PERF_CONTEXT_SWITCHES,
+    PERF_TASK_CLOCK, // Nanoseconds on CPU, still available when the hardware PMU is not
+    PERF_COUNTER_COUNT
+} perfCounter;
+
+extern int perfEnabled; // Set by perfStatInit
+
+int perfStatInit(void);               // Enable counting, -1 if perf_event_open is unusable
+void perfScopeBegin(perfStage stage); // Start attributing the calling thread's counters to stage
+void perfScopeEnd(perfStage stage);   // Stop attributing them, adding the difference to stage
+void perfStatReport(uint64_t orders); // Print per-stage IPC, and misses and switches per order
+
+#endif
@@ -11,29 +11,30 @@
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <fcntl.h>
+#include <stdint.h>
+#include <errno.h>
+
+#include "eventlog.h"
+#include "geometry.h"
+#include "perfstat.h"
+#include "lockprof.h"
+#include "notifier.h"
+#include "orderpool.h"
+#include "placement.h"
+#include "tierqueue.h"
+#include "trace.h"
 
-#define MAX_ORDERS 1000
 #define SHOVEL_COUNT 3
 #define MAX_cookThreads 100
 #define MAX_DELIVERY_THREADS 100
 
-typedef struct
-{
-    int orderID;
-    int x;
-    int y;
-    int clientSocket;
-    int status; // Status of the order: 0 - pending, 1 - cooking, 2 - ready for delivery, 3 - delivered
-} orderStruct;
-
 pthread_mutex_t orderQueueMutex = PTHREAD_MUTEX_INITIALIZER; //  Mutex for order queue
 pthread_cond_t isOrderAvailable = PTHREAD_COND_INITIALIZER;  // Condition variable for order availability
 pthread_cond_t isDeliveryReady = PTHREAD_COND_INITIALIZER;   // Condition variable for delivery readiness
 
-orderStruct orderQueue[MAX_ORDERS];    // Order queue for pending orders
-orderStruct deliveryQueue[MAX_ORDERS]; // Order queue for orders ready for delivery
-int orderCount = 0;                    // Number of orders in the pending queue
-int deliveryCount = 0;                 // Number of orders in the delivery queue
+orderPool orders;          // Pool that owns every order record
+tierQueue orderQueue;      // Handles of pending orders, one FIFO per tier
+tierQueue deliveryQueue;   // Handles of orders ready for delivery, one FIFO per tier
 
 pthread_mutex_t shovelMutex = PTHREAD_MUTEX_INITIALIZER;     // Mutex for shovels
 pthread_cond_t isShovelAvailable = PTHREAD_COND_INITIALIZER; // Condition variable for shovel availability
@@ -41,31 +42,78 @@ int shovels = SHOVEL_COUNT;                                  // Number of availa
 
 volatile sig_atomic_t stop = 0; // Flag to indicate termination
 int serverSocket;               // Server socket
+int shutdownPipe[2];            // The SIGINT handler writes the signal number here, the shutdown thread reports and exits
 int k;                          // Delivery constant
 int cookThreadPoolSize;         // Number of cook threads
 int deliveryPoolSize;           // Number of delivery threads
 int orderCounter = 1;           // Starting order ID counter
+int timeUnitUsec = 1000000;     // Length of one simulated time unit in microseconds
+int kitchenX = 0;               // X coordinate of the kitchen on the map
+int kitchenY = 0;               // Y coordinate of the kitchen on the map
+int slaUnits[TIER_COUNT] = {30, 15, 10}; // Delivery target of each tier in time units
+
+latencyHist tierLatency[TIER_COUNT]; // End-to-end latency of delivered orders per tier
+uint64_t cookBusyNs = 0;             // Time cooks spent on orders, for kitchen utilisation
+uint64_t serverStartNs;              // When the server started accepting orders
 
 pthread_t *cookThreads;     // Array to store cook threads
 pthread_t *deliveryThreads; // Array to store delivery threads
 
-int logFile;                                    // Log file descriptor
-int deliveredCount[MAX_DELIVERY_THREADS] = {0}; // Array to store delivered order count for each delivery thread
+typedef struct
+{
+    int count;
+} __attribute__((aligned(64))) paddedCounter; // One cache line per counter so couriers don't share lines
+
+paddedCounter deliveredCount[MAX_DELIVERY_THREADS] = {0}; // Delivered order count for each delivery thread
 
-// Function to handle logging
-void serverLog(const char *message)
+
+uint64_t monotonicNs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// Function to print latency percentiles of every tier and the kitchen utilisation
+void printTierReport()
 {
-    pthread_mutex_lock(&orderQueueMutex);
-    int writtenBytes = write(logFile, message, strlen(message));
-    if (writtenBytes < 0)
+    double elapsed = (monotonicNs() - serverStartNs) / 1e9;
+    printf("\n---------------TIER LATENCY---------------\n");
+    printf("Kitchen utilisation: %.1f%% (%d cooks, %.1f s)\n",
+           elapsed > 0 ? 100.0 * cookBusyNs / 1e9 / (cookThreadPoolSize * elapsed) : 0.0, cookThreadPoolSize, elapsed);
+    for (int tier = 0; tier < TIER_COUNT; tier++)
     {
-        perror("Failed to write to log file");
+        latencyHist *hist = &tierLatency[tier];
+        printf("%-8s orders: %6lu p50: %9.1f ms p90: %9.1f ms p99: %9.1f ms max: %9.1f ms SLA %.1f ms missed: %.1f%%\n",
+               tierNames[tier], hist->count, latencyPercentile(hist, 0.50) / 1e6, latencyPercentile(hist, 0.90) / 1e6,
+               latencyPercentile(hist, 0.99) / 1e6, hist->max / 1e6, tierSlaNs[tier] / 1e6,
+               hist->count ? 100.0 * hist->slaMisses / hist->count : 0.0);
     }
-    pthread_mutex_unlock(&orderQueueMutex);
 }
 
 void handleSigInt(int sig)
 {
+    // Only async-signal-safe work here, the interrupted thread may hold the log or queue mutex
+    char signalNumber = sig;
+    write(shutdownPipe[1], &signalNumber, 1);
+}
+
+// Thread that waits for the SIGINT handler, then reports and exits outside signal context
+void *shutdownThread(void *arg)
+{
+    (void)arg;
+    char signalNumber;
+    ssize_t got;
+    while ((got = read(shutdownPipe[0], &signalNumber, 1)) != 1)
+    {
+        if (got < 0 && errno != EINTR)
+        {
+            perror("Shutdown pipe read failed");
+            return NULL;
+        }
+    }
+    int sig = signalNumber;
+
     // Print a termination message with signal number
     printf("\nTermination signal received: %d\n", sig);
 
@@ -74,17 +122,17 @@ void handleSigInt(int sig)
     int i;
     for (i = 0; i < deliveryPoolSize; i++)
     {
-        if (deliveredCount[i] > maxDelivered)
+        if (deliveredCount[i].count > maxDelivered)
         {
-            maxDelivered = deliveredCount[i];
+            maxDelivered = deliveredCount[i].count;
         }
     }
     printf("Most delivered orders by a delivery thread: %d by the %dth thread\n", maxDelivered, i);
 
     // Set the stop flag to indicate termination
-    pthread_mutex_lock(&orderQueueMutex);
+    MUTEX_LOCK(&orderQueueMutex);
     stop = 1;
-    pthread_mutex_unlock(&orderQueueMutex);
+    MUTEX_UNLOCK(&orderQueueMutex);
 
     // Close the server socket
     close(serverSocket);
@@ -92,88 +140,158 @@ void handleSigInt(int sig)
     // Print a termination message
     printf("\nServer terminated.\n");
 
-    serverLog("Server terminated.\n");
+    eventLogWrite(EV_SERVER_TERMINATED, 0, 0, 0, 0, 0);
+
+    printTierReport();
+    notifierReport();
 
-    // Close log file
-    close(logFile);
+    // Write the trace before exiting, if tracing was requested
+    traceDump();
+
+    // Print the per-stage hardware counters, if -P was given
+    perfStatReport(orderCounter - 1);
+
+    // Print the lock contention report (empty unless built with LOCKPROF=1)
+    lockprofReport();
+
+    // Flush and close the event log
+    eventLogClose();
 
     // Exit the process
     exit(0);
 }
 
+// Function to simulate work that takes the given number of time units
+void simulateWork(int units)
+{
+    long long usec = (long long)units * timeUnitUsec;
+    if (usec > 0)
+    {
+        struct timespec duration = {.tv_sec = usec / 1000000, .tv_nsec = (usec % 1000000) * 1000};
+        nanosleep(&duration, NULL);
+    }
+}
+
 double calculateDistance(int x1, int y1, int x2, int y2)
 {
-    return sqrt(pow(x2 - x1, 2) + pow(y2 - y1, 2));
+    return pointDistance(x1, y1, x2, y2);
 }
 
-void *cookThread()
+// Function to drop an order that could not be queued: the client is told it was cancelled
+// and the notifier closes its socket, then the record goes back to the pool
+void cancelOrder(orderHandle handle, const char *queueName)
 {
-    while (stop == 0)
+    orderStruct *order = orderGet(&orders, handle);
+    if (order == NULL)
     {
-        orderStruct order;
+        return;
+    }
+    printf("Failed to queue order %d for %s, cancelling it\n", order->orderID, queueName);
+    notifierSend(order->clientSocket, "CANCEL", strlen("CANCEL"), 1);
+    orderFree(&orders, handle);
+}
 
-        pthread_mutex_lock(&orderQueueMutex);
-        while (orderCount == 0 && stop == 0)
+void *cookThread(void *arg)
+{
+    int threadIndex = *(int *)arg;
+    free(arg);
+
+    char threadName[32];
+    snprintf(threadName, sizeof(threadName), "cook %d", threadIndex);
+    traceThreadName(threadName);
+    placementApply(ROLE_COOK);
+
+    while (stop == 0)
+    {
+        MUTEX_LOCK(&orderQueueMutex);
+        while (orderQueue.count == 0 && stop == 0)
         {
-            pthread_cond_wait(&isOrderAvailable, &orderQueueMutex);
+            COND_WAIT(&isOrderAvailable, &orderQueueMutex);
         }
         if (stop)
         {
-            pthread_mutex_unlock(&orderQueueMutex);
+            MUTEX_UNLOCK(&orderQueueMutex);
             break;
         }
 
-        order = orderQueue[--orderCount];
-        pthread_mutex_unlock(&orderQueueMutex);
+        perfScopeBegin(PERF_QUEUE);
+        orderHandle handle = tierQueuePop(&orderQueue, &orders, monotonicNs());
+        MUTEX_UNLOCK(&orderQueueMutex);
+        perfScopeEnd(PERF_QUEUE);
+        uint64_t cookStart = monotonicNs();
+
+        orderStruct *order = orderGet(&orders, handle);
+        if (order == NULL)
+        {
+            printf("Stale order handle %u.\n", handle);
+            continue;
+        }
+        traceEnd(TRACE_ORDER_QUEUE_WAIT, order->orderID);
 
         // Check order status before proceeding
-        if (order.status != 0)
+        if (order->status != 0)
         {
-            printf("Order %d is not in pending state.\n", order.orderID);
+            printf("Order %d is not in pending state.\n", order->orderID);
             continue;
         }
 
         // Mark order as cooking
-        order.status = 1;
+        order->status = 1;
 
         // Prepare the pide
         int preparingTime = rand() % 5 + 1;
-        printf("Cook is preparing order %d. Cooking time: %d\n", order.orderID, preparingTime);
-        sleep(preparingTime);
+        eventLogWrite(EV_COOK_STARTED, order->orderID, threadIndex, preparingTime, 0, 0);
+        printf("Cook is preparing order %d. Cooking time: %d\n", order->orderID, preparingTime);
+        traceBegin(TRACE_PREP, order->orderID);
+        simulateWork(preparingTime);
+        traceEnd(TRACE_PREP, order->orderID);
 
         // Acquire a shovel
-        pthread_mutex_lock(&shovelMutex);
+        traceBegin(TRACE_SHOVEL_ACQUIRE, order->orderID);
+        MUTEX_LOCK(&shovelMutex);
         while (shovels == 0)
         {
-            pthread_cond_wait(&isShovelAvailable, &shovelMutex);
+            COND_WAIT(&isShovelAvailable, &shovelMutex);
         }
         shovels--;
-        pthread_mutex_unlock(&shovelMutex);
+        MUTEX_UNLOCK(&shovelMutex);
+        traceEnd(TRACE_SHOVEL_ACQUIRE, order->orderID);
 
         // Simulate putting pide in the oven (using a shovel)
-        printf("Cook is putting order %d into the oven.\n", order.orderID);
+        printf("Cook is putting order %d into the oven.\n", order->orderID);
         int cookingTime = preparingTime / 2;
-        sleep(cookingTime);
+        traceBegin(TRACE_OVEN, order->orderID);
+        simulateWork(cookingTime);
+        traceEnd(TRACE_OVEN, order->orderID);
 
         // Release the shovel
-        pthread_mutex_lock(&shovelMutex);
+        MUTEX_LOCK(&shovelMutex);
         shovels++;
-        pthread_mutex_unlock(&shovelMutex);
-        pthread_cond_signal(&isShovelAvailable);
+        MUTEX_UNLOCK(&shovelMutex);
+        COND_SIGNAL(&isShovelAvailable);
 
         // Mark order as ready for delivery
-        pthread_mutex_lock(&orderQueueMutex);
-        order.status = 2;                       // Ready for delivery
-        deliveryQueue[deliveryCount++] = order; // Move to delivery queue
-        pthread_mutex_unlock(&orderQueueMutex);
+        int orderID = order->orderID; // A courier may free the record once it is queued
+        order->status = 2;            // Ready for delivery
+        traceBegin(TRACE_DELIVERY_QUEUE_WAIT, orderID);
+        perfScopeBegin(PERF_QUEUE);
+        MUTEX_LOCK(&orderQueueMutex);
+        int queued = tierQueuePush(&deliveryQueue, handle, order->tier); // Move to delivery queue
+        MUTEX_UNLOCK(&orderQueueMutex);
+        perfScopeEnd(PERF_QUEUE);
+        __atomic_fetch_add(&cookBusyNs, monotonicNs() - cookStart, __ATOMIC_RELAXED);
+        if (queued < 0)
+        {
+            traceEnd(TRACE_DELIVERY_QUEUE_WAIT, orderID);
+            cancelOrder(handle, "delivery");
+            continue;
+        }
 
         // Log order state change
-        char logMsg[128];
-        snprintf(logMsg, sizeof(logMsg), "Order %d is ready for delivery.\n", order.orderID);
-        serverLog(logMsg);
+        eventLogWrite(EV_ORDER_READY, orderID, threadIndex, 0, 0, 0);
 
-        printf("Order %d is ready for delivery.\n", order.orderID);
-        pthread_cond_signal(&isDeliveryReady);
+        printf("Order %d is ready for delivery.\n", orderID);
+        COND_SIGNAL(&isDeliveryReady);
     }
     return NULL;
 }
@@ -183,45 +301,69 @@ void *deliveryThread(void *arg)
     int threadIndex = *(int *)arg;
     free(arg);
 
+    char threadName[32];
+    snprintf(threadName, sizeof(threadName), "courier %d", threadIndex);
+    traceThreadName(threadName);
+    placementApply(ROLE_COURIER);
+
     while (stop == 0)
     {
-        orderStruct order;
-
-        pthread_mutex_lock(&orderQueueMutex);
-        while (deliveryCount == 0 && stop == 0)
+        MUTEX_LOCK(&orderQueueMutex);
+        while (deliveryQueue.count == 0 && stop == 0)
         {
-            pthread_cond_wait(&isDeliveryReady, &orderQueueMutex);
+            COND_WAIT(&isDeliveryReady, &orderQueueMutex);
         }
         if (stop)
         {
-            pthread_mutex_unlock(&orderQueueMutex);
+            MUTEX_UNLOCK(&orderQueueMutex);
             break;
         }
 
-        order = deliveryQueue[--deliveryCount];
-        pthread_mutex_unlock(&orderQueueMutex);
+        perfScopeBegin(PERF_QUEUE);
+        orderHandle handle = tierQueuePop(&deliveryQueue, &orders, monotonicNs());
+        MUTEX_UNLOCK(&orderQueueMutex);
+        perfScopeEnd(PERF_QUEUE);
+
+        orderStruct *order = orderGet(&orders, handle);
+        if (order == NULL)
+        {
+            printf("Stale order handle %u.\n", handle);
+            continue;
+        }
+        traceEnd(TRACE_DELIVERY_QUEUE_WAIT, order->orderID);
 
         // Simulate delivery time
         // calculate distance between the restaurant and the delivery location
-        double distance = calculateDistance(0, 0, order.x, order.y);
+        double distance = calculateDistance(kitchenX, kitchenY, order->x, order->y);
         int deliveryTime = distance / k;
-        printf("Delivery thread %d is delivering order %d. Delivery time: %d\n", threadIndex, order.orderID, deliveryTime);
-        sleep(deliveryTime);
+        eventLogWrite(EV_OUT_FOR_DELIVERY, order->orderID, threadIndex, deliveryTime, 0, 0);
+        printf("Delivery thread %d is delivering order %d. Delivery time: %d\n", threadIndex, order->orderID, deliveryTime);
+        traceBegin(TRACE_DELIVERY, order->orderID);
+        simulateWork(deliveryTime);
+        traceEnd(TRACE_DELIVERY, order->orderID);
 
         // Notify client about delivery
         char deliveryMessage[128];
-        snprintf(deliveryMessage, sizeof(deliveryMessage), "Order %d delivered to (%d, %d).\n", order.orderID, order.x, order.y);
-        send(order.clientSocket, deliveryMessage, strlen(deliveryMessage), 0);
+        snprintf(deliveryMessage, sizeof(deliveryMessage), "Order %d delivered to (%d, %d).\n", order->orderID, order->x, order->y);
+        traceBegin(TRACE_NOTIFY, order->orderID);
+        perfScopeBegin(PERF_NOTIFY);
+        notifierSend(order->clientSocket, deliveryMessage, strlen(deliveryMessage), 1); // Closes the socket once sent
+        perfScopeEnd(PERF_NOTIFY);
+        traceEnd(TRACE_NOTIFY, order->orderID);
 
         // Log delivery
-        snprintf(deliveryMessage, sizeof(deliveryMessage), "Order %d delivered to (%d, %d).\n", order.orderID, order.x, order.y);
-        serverLog(deliveryMessage);
+        eventLogWrite(EV_ORDER_DELIVERED, order->orderID, threadIndex, order->x, order->y, 0);
 
         // Increment delivery count for this thread
-        deliveredCount[threadIndex]++;
+        deliveredCount[threadIndex].count++;
 
         // Print delivery count for this thread
-        printf("Delivery thread %d delivered %d orders.\n", threadIndex, deliveredCount[threadIndex]);
+        printf("Delivery thread %d delivered %d orders.\n", threadIndex, deliveredCount[threadIndex].count);
+
+        // The order is done, record its latency and give its record back to the pool
+        latencyRecord(&tierLatency[order->tier], monotonicNs() - order->receivedAt, tierSlaNs[order->tier]);
+        order->status = 3;
+        orderFree(&orders, handle);
     }
 
     return NULL;
@@ -229,38 +371,77 @@ void *deliveryThread(void *arg)
 
 void *managerThread(void *arg)
 {
-    int clientSocket = *(int *)arg;
-    free(arg);
+    int clientSocket = (int)(intptr_t)arg;
+
+    traceThreadName("manager");
+    placementApply(ROLE_IO);
 
     char buffer[128];
-    int len = recv(clientSocket, buffer, sizeof(buffer), 0);
+    traceBegin(TRACE_RECEIVE, 0);
+    perfScopeBegin(PERF_PARSE);
+    int len = recv(clientSocket, buffer, sizeof(buffer) - 1, 0);
     if (len > 0)
     {
 
         buffer[len] = '\0';
-        int x, y;
-        sscanf(buffer, "X:%d,Y:%d", &x, &y);
+        int x = 0, y = 0, tier = TIER_REGULAR;
+        sscanf(buffer, "X:%d,Y:%d,T:%d", &x, &y, &tier); // The tier is optional
+        if (tier < 0 || tier >= TIER_COUNT)
+        {
+            tier = TIER_REGULAR;
+        }
 
-        orderStruct order = {.orderID = orderCounter++, .x = x, .y = y, .clientSocket = clientSocket, .status = 0};
-        printf("Received order %d: x=%d, y=%d\n", order.orderID, x, y);
+        orderHandle handle = orderAlloc(&orders);
+        orderStruct *order = orderGet(&orders, handle);
+        if (order == NULL)
+        {
+            traceEnd(TRACE_RECEIVE, 0);
+            perfScopeEnd(PERF_PARSE);
+            close(clientSocket);
+            printf("Order pool exhausted, dropping client\n");
+            pthread_exit(NULL);
+        }
+        *order = (orderStruct){.orderID = __atomic_fetch_add(&orderCounter, 1, __ATOMIC_RELAXED), .x = x, .y = y, .clientSocket = clientSocket, .status = 0, .tier = tier, .receivedAt = monotonicNs()};
+        traceEnd(TRACE_RECEIVE, order->orderID);
+        perfScopeEnd(PERF_PARSE);
+        printf("Received order %d: x=%d, y=%d\n", order->orderID, x, y);
 
-        pthread_mutex_lock(&orderQueueMutex);
-        orderQueue[orderCount++] = order;
-        pthread_mutex_unlock(&orderQueueMutex);
+        // From here on the notifier owns the socket and closes it after delivery
+        if (notifierWatch(clientSocket) < 0)
+        {
+            orderFree(&orders, handle);
+            close(clientSocket);
+            printf("Failed to hand client over to the notifier, dropping client\n");
+            pthread_exit(NULL);
+        }
 
-        pthread_cond_signal(&isOrderAvailable);
+        int orderID = order->orderID; // The record belongs to the kitchen once queued
+        uint64_t receivedAt = order->receivedAt;
+        traceBegin(TRACE_ORDER_QUEUE_WAIT, orderID);
+        perfScopeBegin(PERF_QUEUE);
+        MUTEX_LOCK(&orderQueueMutex);
+        int queued = tierQueuePush(&orderQueue, handle, tier);
+        int pendingCount = orderQueue.count;
+        MUTEX_UNLOCK(&orderQueueMutex);
+        perfScopeEnd(PERF_QUEUE);
+        if (queued < 0)
+        {
+            traceEnd(TRACE_ORDER_QUEUE_WAIT, orderID);
+            cancelOrder(handle, "order");
+            pthread_exit(NULL);
+        }
 
-        // Log order reception
-        char logMsg[128];
-        snprintf(logMsg, sizeof(logMsg), "Received order %d: x=%d, y=%d\n", order.orderID, x, y);
-        serverLog(logMsg);
+        COND_SIGNAL(&isOrderAvailable);
 
-        // Print connection message and current client count
-        snprintf(logMsg, sizeof(logMsg), "Client connected. Current number of clients: %d\n", orderCount);
-        serverLog(logMsg);
+        // Log order reception with the current number of pending orders, stamped with the time it
+        // was received since a cook may already have logged COOK_STARTED for it
+        eventLogWriteAt(receivedAt, EV_ORDER_RECEIVED, orderID, tier, x, y, pendingCount);
     }
     else
     {
+        traceEnd(TRACE_RECEIVE, 0);
+        perfScopeEnd(PERF_PARSE);
+        eventLogWrite(EV_RECEIVE_FAILED, 0, 0, 0, 0, 0);
         close(clientSocket);
         printf("Failed to receive data from client\n");
     }
@@ -270,25 +451,124 @@ void *managerThread(void *arg)
 
 int main(int argc, char *argv[])
 {
-    if (argc != 5)
+    int opt, badOption = 0;
+    const char *policy = "none";
+    char *roleSpecs[ROLE_COUNT];
+    int roleSpecCount = 0;
+    const char *logPath = "serverLog.bin";
+    uint64_t logMaxBytes = EVENTLOG_DEFAULT_MAX_BYTES;
+    size_t outputLimit = NOTIFIER_DEFAULT_LIMIT;
+    while ((opt = getopt(argc, argv, "t:a:A:u:o:l:L:S:W:O:P")) != -1)
+    {
+        switch (opt)
+        {
+        case 't': // Record every order's lifecycle and dump it as Chrome trace JSON on shutdown
+            if (traceInit(optarg) < 0)
+            {
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'P': // Count cycles, instructions, cache misses and context switches per stage
+            if (perfStatInit() < 0)
+            {
+                fprintf(stderr, "Hardware counters unavailable, continuing without -P\n");
+            }
+            break;
+        case 'a': // Thread placement policy: none, compact, split or spread
+            policy = optarg;
+            break;
+        case 'A': // Pin one pool to explicit cores, e.g. cook=0-3
+            if (roleSpecCount < ROLE_COUNT)
+            {
+                roleSpecs[roleSpecCount++] = optarg;
+            }
+            break;
+        case 'u': // Microseconds per simulated time unit (default one second)
+            timeUnitUsec = atoi(optarg);
+            break;
+        case 'o': // Kitchen location, deliveries are measured from here
+            if (sscanf(optarg, "%d,%d", &kitchenX, &kitchenY) != 2)
+            {
+                badOption = 1;
+            }
+            break;
+        case 'l': // Event log file path
+            logPath = optarg;
+            break;
+        case 'L': // Event log size in bytes before it is rotated
+            logMaxBytes = strtoull(optarg, NULL, 10);
+            break;
+        case 'S': // Delivery targets of the regular, express and vip tiers in time units
+            if (sscanf(optarg, "%d,%d,%d", &slaUnits[TIER_REGULAR], &slaUnits[TIER_EXPRESS], &slaUnits[TIER_VIP]) != 3)
+            {
+                badOption = 1;
+            }
+            break;
+        case 'O': // Bytes that may be queued for one client before it is dropped
+            outputLimit = strtoul(optarg, NULL, 10);
+            break;
+        case 'W': // Dequeue weights of the regular, express and vip tiers
+            if (sscanf(optarg, "%d,%d,%d", &tierWeights[TIER_REGULAR], &tierWeights[TIER_EXPRESS], &tierWeights[TIER_VIP]) != 3 ||
+                tierWeights[TIER_REGULAR] <= 0 || tierWeights[TIER_EXPRESS] <= 0 || tierWeights[TIER_VIP] <= 0)
+            {
+                badOption = 1;
+            }
+            break;
+        default:
+            badOption = 1;
+            break;
+        }
+    }
+
+    if (badOption || argc - optind != 4)
     {
-        fprintf(stderr, "Usage: %s <Port> <Cook Thread Pool Size> <Delivery Pool Size> <k>\n", argv[0]);
+        fprintf(stderr, "Usage: %s [-t <Trace File>] [-a none|compact|split|spread] [-A io|cook|courier=<cpus>] [-u <usec per unit>] [-o <x>,<y>] [-l <Log File>] [-L <Log Rotate Bytes>] [-S <sla>,<sla>,<sla>] [-W <w>,<w>,<w>] [-O <Output Limit>] [-P] <Port> <Cook Thread Pool Size> <Delivery Pool Size> <k>\n", argv[0]);
         exit(EXIT_FAILURE);
     }
 
-    int port = atoi(argv[1]);
-    cookThreadPoolSize = atoi(argv[2]);
-    deliveryPoolSize = atoi(argv[3]);
-    k = atoi(argv[4]);
+    int port = atoi(argv[optind]);
+    cookThreadPoolSize = atoi(argv[optind + 1]);
+    deliveryPoolSize = atoi(argv[optind + 2]);
+    k = atoi(argv[optind + 3]);
+
+    for (int tier = 0; tier < TIER_COUNT; tier++)
+    {
+        tierSlaNs[tier] = (uint64_t)slaUnits[tier] * timeUnitUsec * 1000;
+    }
+
+    if (placementInit(policy) < 0)
+    {
+        fprintf(stderr, "Unknown placement policy: %s\n", policy);
+        exit(EXIT_FAILURE);
+    }
+    for (int i = 0; i < roleSpecCount; i++)
+    {
+        if (placementSetRole(roleSpecs[i]) < 0)
+        {
+            fprintf(stderr, "Invalid core set: %s\n", roleSpecs[i]);
+            exit(EXIT_FAILURE);
+        }
+    }
+    placementApply(ROLE_IO);
+    placementDescribe();
 
     struct sockaddr_in server_addr, client_addr;
     socklen_t client_len = sizeof(client_addr);
 
+    pthread_t shutdowner;
+    if (pipe(shutdownPipe) < 0 || pthread_create(&shutdowner, NULL, shutdownThread, NULL) != 0)
+    {
+        perror("Failed to start the shutdown thread");
+        exit(EXIT_FAILURE);
+    }
+    pthread_detach(shutdowner);
+
     struct sigaction action;
     action.sa_handler = handleSigInt;
     sigemptyset(&action.sa_mask);
     action.sa_flags = 0;
     sigaction(SIGINT, &action, NULL);
+    signal(SIGPIPE, SIG_IGN); // A client that hung up must not kill the server
 
     // Create socket
     serverSocket = socket(AF_INET, SOCK_STREAM, 0);
@@ -298,12 +578,15 @@ int main(int argc, char *argv[])
         exit(EXIT_FAILURE);
     }
 
-    logFile = open("serverLog.txt", O_WRONLY | O_CREAT | O_APPEND, 0644);
-    if (logFile < 0)
+    if (eventLogOpen(logPath, logMaxBytes) < 0)
     {
-        perror("Failed to open log file");
         exit(EXIT_FAILURE);
     }
+    eventLogWrite(EV_SERVER_STARTED, 0, 0, port, cookThreadPoolSize, deliveryPoolSize);
+
+    // Benchmark runs restart the server on the same port while old connections sit in TIME_WAIT
+    int reuse = 1;
+    setsockopt(serverSocket, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
 
     server_addr.sin_family = AF_INET;
     server_addr.sin_addr.s_addr = INADDR_ANY;
@@ -316,7 +599,7 @@ int main(int argc, char *argv[])
         exit(EXIT_FAILURE);
     }
 
-    if (listen(serverSocket, 10) < 0)
+    if (listen(serverSocket, SOMAXCONN) < 0)
     {
         perror("Listen failed");
         close(serverSocket);
@@ -332,6 +615,15 @@ int main(int argc, char *argv[])
     IPbuffer = inet_ntoa(*((struct in_addr *)host_entry->h_addr_list[0]));
     printf("Server is running on IP: %s, Port: %d\n", IPbuffer, port);
 
+    orderPoolInit(&orders);
+    serverStartNs = monotonicNs();
+
+    if (notifierStart(outputLimit) < 0)
+    {
+        fprintf(stderr, "Failed to start the notifier\n");
+        exit(EXIT_FAILURE);
+    }
+
     cookThreads = malloc(cookThreadPoolSize * sizeof(pthread_t));
     deliveryThreads = malloc(deliveryPoolSize * sizeof(pthread_t));
 
@@ -343,9 +635,13 @@ int main(int argc, char *argv[])
 
     for (int i = 0; i < cookThreadPoolSize; i++)
     {
-        pthread_create(&cookThreads[i], NULL, cookThread, NULL);
+        int *threadIndex = malloc(sizeof(int));
+        *threadIndex = i;
+        pthread_create(&cookThreads[i], NULL, cookThread, threadIndex);
     }
 
+    traceThreadName("acceptor");
+
     for (int i = 0; i < deliveryPoolSize; i++)
     {
         int *threadIndex = malloc(sizeof(int));
@@ -355,27 +651,26 @@ int main(int argc, char *argv[])
 
     while (stop == 0)
     {
-        int *clientSocket = malloc(sizeof(int));
-        *clientSocket = accept(serverSocket, (struct sockaddr *)&client_addr, &client_len);
-        if (*clientSocket < 0)
+        perfScopeBegin(PERF_ACCEPT);
+        int clientSocket = accept(serverSocket, (struct sockaddr *)&client_addr, &client_len);
+        if (clientSocket < 0)
         {
+            perfScopeEnd(PERF_ACCEPT);
             perror("Accept failed");
-            free(clientSocket);
             continue;
         }
 
         printf("Client connected\n");
 
         pthread_t manager;
-        pthread_create(&manager, NULL, managerThread, clientSocket);
+        pthread_create(&manager, NULL, managerThread, (void *)(intptr_t)clientSocket);
         pthread_detach(manager);
+        perfScopeEnd(PERF_ACCEPT);
 
-        pthread_cond_signal(&isOrderAvailable); // Signal order availability
+        COND_SIGNAL(&isOrderAvailable); // Signal order availability
 
         // Log client connection
-        char logMsg[128];
-        snprintf(logMsg, sizeof(logMsg), "Client connected from %s:%d\n", inet_ntoa(client_addr.sin_addr), ntohs(client_addr.sin_port));
-        serverLog(logMsg);
+        eventLogWrite(EV_CLIENT_CONNECTED, 0, 0, (int32_t)client_addr.sin_addr.s_addr, ntohs(client_addr.sin_port), 0);
     }
 
     for (int i = 0; i < cookThreadPoolSize; i++)
@@ -391,7 +686,11 @@ int main(int argc, char *argv[])
     free(cookThreads);
     free(deliveryThreads);
 
+    tierQueueDestroy(&orderQueue);
+    tierQueueDestroy(&deliveryQueue);
+    orderPoolDestroy(&orders);
+
     close(serverSocket);
-    close(logFile);
+    eventLogClose();
     return 0;
 }
@@ -0,0 +1,431 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <signal.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <math.h>
+#include <poll.h>
+#include <time.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
+
+#include "geometry.h"
+
+#define MAX_SHARDS 64 // Maximum number of pideshop shards
+
+typedef struct
+{
+    pid_t pid;             // Process ID of the shard
+    int port;              // Port the shard listens on
+    int originX;           // Kitchen location of the shard
+    int originY;           // Kitchen location of the shard
+    long orders;           // Orders routed to this shard
+    double distance;       // Sum of delivery distances from this shard's kitchen
+    double originDistance; // Sum of the same deliveries' distances from (0,0)
+    long failures;         // Orders the shard could not take
+} shardStruct;
+
+shardStruct shards[MAX_SHARDS];                              // Every shard process
+int shardCount;                                              // Number of shards
+int columns, rows;                                           // Region grid, columns * rows == shardCount
+int p, q;                                                    // Map size
+pthread_mutex_t statsMutex = PTHREAD_MUTEX_INITIALIZER;       // Mutex for shard statistics
+int serverSocket;                                            // Router socket
+
+double calculateDistance(int x1, int y1, int x2, int y2)
+{
+    return pointDistance(x1, y1, x2, y2);
+}
+
+// Function to print how evenly the orders were spread over the shards
+void printLoadBalance()
+{
+    long total = 0, most = 0;
+    double distance = 0, originDistance = 0;
+    pthread_mutex_lock(&statsMutex);
+    for (int i = 0; i < shardCount; i++)
+    {
+        total += shards[i].orders;
+        distance += shards[i].distance;
+        originDistance += shards[i].originDistance;
+        if (shards[i].orders > most)
+        {
+            most = shards[i].orders;
+        }
+    }
+
+    printf("\n---------------SHARD LOAD BALANCE---------------\n");
+    for (int i = 0; i < shardCount; i++)
+    {
+        printf("Shard %2d port %d kitchen (%d, %d): %ld orders (%.1f%%), avg distance %.2f, failures %ld\n",
+               i, shards[i].port, shards[i].originX, shards[i].originY, shards[i].orders,
+               total ? 100.0 * shards[i].orders / total : 0.0,
+               shards[i].orders ? shards[i].distance / shards[i].orders : 0.0, shards[i].failures);
+    }
+    double mean = (double)total / shardCount;
+    printf("Total orders: %ld, max/mean load: %.2f\n", total, mean > 0 ? most / mean : 0.0);
+    if (total > 0)
+    {
+        printf("Avg delivery distance: %.2f (single kitchen at (0,0): %.2f)\n", distance / total, originDistance / total);
+    }
+    pthread_mutex_unlock(&statsMutex);
+}
+
+void handleSigInt(int sig)
+{
+    printf("\nTermination signal received: %d\n", sig);
+
+    close(serverSocket);
+    printLoadBalance();
+
+    // Stop every shard and wait for it, so their reports are complete
+    for (int i = 0; i < shardCount; i++)
+    {
+        kill(shards[i].pid, SIGINT);
+    }
+    for (int i = 0; i < shardCount; i++)
+    {
+        waitpid(shards[i].pid, NULL, 0);
+    }
+
+    printf("Router terminated.\n");
+    exit(0);
+}
+
+// Function to split the p x q map into a grid with one region per shard,
+// choosing the factorisation whose cells are closest to square
+void planRegions()
+{
+    double best = -1;
+    for (int c = 1; c <= shardCount; c++)
+    {
+        if (shardCount % c != 0)
+        {
+            continue;
+        }
+        int r = shardCount / c;
+        double skew = fabs(log(((double)p / c) / ((double)q / r)));
+        if (best < 0 || skew < best)
+        {
+            best = skew;
+            columns = c;
+            rows = r;
+        }
+    }
+
+    // Clients draw x from [-p/2, p - p/2), put each kitchen in the middle of its cell
+    for (int i = 0; i < shardCount; i++)
+    {
+        int column = i % columns, row = i / columns;
+        shards[i].originX = -(p / 2) + (int)((column + 0.5) * p / columns);
+        shards[i].originY = -(q / 2) + (int)((row + 0.5) * q / rows);
+    }
+}
+
+// Function to find the shard whose region contains (x, y)
+int shardFor(int x, int y)
+{
+    int column = (int)((long)(x + p / 2) * columns / p);
+    int row = (int)((long)(y + q / 2) * rows / q);
+    column = column < 0 ? 0 : (column >= columns ? columns - 1 : column);
+    row = row < 0 ? 0 : (row >= rows ? rows - 1 : row);
+    return row * columns + column;
+}
+
+int connectToShard(int port)
+{
+    int sock = socket(AF_INET, SOCK_STREAM, 0);
+    if (sock < 0)
+    {
+        return -1;
+    }
+
+    struct sockaddr_in shardAddr = {0};
+    shardAddr.sin_family = AF_INET;
+    shardAddr.sin_port = htons(port);
+    shardAddr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (connect(sock, (struct sockaddr *)&shardAddr, sizeof(shardAddr)) < 0)
+    {
+        close(sock);
+        return -1;
+    }
+    return sock;
+}
+
+// Function to check whether something listens on a TCP port, without connecting to it;
+// a probe connection would reach the shard as an empty order
+int isListening(int port)
+{
+    FILE *table = fopen("/proc/net/tcp", "r");
+    if (table == NULL)
+    {
+        return 0;
+    }
+    char line[256];
+    unsigned int localPort, state;
+    int found = 0;
+    fgets(line, sizeof(line), table); // Column headers
+    while (!found && fgets(line, sizeof(line), table) != NULL)
+    {
+        found = sscanf(line, " %*d: %*x:%x %*x:%*x %x", &localPort, &state) == 2 && (int)localPort == port && state == 0x0A; // TCP_LISTEN
+    }
+    fclose(table);
+    return found;
+}
+
+// Function to start one pideshop process per region
+void startShards(const char *binary, int basePort, char *cooks, char *couriers, char *k, const char *timeUnit)
+{
+    for (int i = 0; i < shardCount; i++)
+    {
+        shards[i].port = basePort + i;
+
+        char port[16], origin[32], logPath[64];
+        snprintf(port, sizeof(port), "%d", shards[i].port);
+        snprintf(origin, sizeof(origin), "%d,%d", shards[i].originX, shards[i].originY);
+        snprintf(logPath, sizeof(logPath), "serverLog.shard%d.bin", i);
+
+        fflush(stdout); // Don't let the child inherit unwritten output
+        pid_t pid = fork();
+        if (pid < 0)
+        {
+            perror("fork");
+            exit(EXIT_FAILURE);
+        }
+        if (pid == 0)
+        {
+            // Shards print a line per event, keep the router's terminal readable
+            freopen("/dev/null", "w", stdout);
+            if (timeUnit != NULL)
+            {
+                execl(binary, binary, "-o", origin, "-l", logPath, "-u", timeUnit, port, cooks, couriers, k, (char *)NULL);
+            }
+            else
+            {
+                execl(binary, binary, "-o", origin, "-l", logPath, port, cooks, couriers, k, (char *)NULL);
+            }
+            perror("execl");
+            _exit(EXIT_FAILURE);
+        }
+        shards[i].pid = pid;
+    }
+
+    // Wait until every shard listens
+    for (int i = 0; i < shardCount; i++)
+    {
+        int listening = 0;
+        for (int attempt = 0; attempt < 100 && !listening; attempt++)
+        {
+            listening = isListening(shards[i].port);
+            if (!listening)
+            {
+                usleep(20000);
+            }
+        }
+        if (!listening)
+        {
+            fprintf(stderr, "Shard %d did not start on port %d\n", i, shards[i].port);
+            continue;
+        }
+        printf("Shard %d listening on port %d, kitchen at (%d, %d)\n", i, shards[i].port, shards[i].originX, shards[i].originY);
+    }
+}
+
+// Function to pass data in both directions until the order is answered or either side closes
+void relay(int clientSocket, int shardSocket)
+{
+    struct pollfd fds[2] = {{.fd = clientSocket, .events = POLLIN}, {.fd = shardSocket, .events = POLLIN}};
+    char buffer[256];
+
+    while (1)
+    {
+        if (poll(fds, 2, -1) < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue; // revents are stale after an interrupted poll
+            }
+            return;
+        }
+        if (fds[0].revents & (POLLIN | POLLHUP | POLLERR)) // Client cancelled or hung up
+        {
+            int len = recv(clientSocket, buffer, sizeof(buffer), 0);
+            if (len <= 0 || send(shardSocket, buffer, len, MSG_NOSIGNAL) < 0)
+            {
+                return;
+            }
+        }
+        if (fds[1].revents & (POLLIN | POLLHUP | POLLERR)) // Delivery notification, possibly in several segments
+        {
+            int len = recv(shardSocket, buffer, sizeof(buffer), 0);
+            if (len <= 0 || send(clientSocket, buffer, len, MSG_NOSIGNAL) < 0)
+            {
+                return; // The shard closes the connection once the order is delivered
+            }
+        }
+    }
+}
+
+void *routeThread(void *arg)
+{
+    int clientSocket = (int)(intptr_t)arg;
+
+    char buffer[128];
+    int len = recv(clientSocket, buffer, sizeof(buffer) - 1, 0);
+    int x, y;
+    if (len <= 0)
+    {
+        close(clientSocket);
+        return NULL;
+    }
+    buffer[len] = '\0';
+    if (sscanf(buffer, "X:%d,Y:%d", &x, &y) != 2)
+    {
+        printf("Malformed order: %s\n", buffer);
+        close(clientSocket);
+        return NULL;
+    }
+
+    int shard = shardFor(x, y);
+    int shardSocket = connectToShard(shards[shard].port);
+
+    // Forward the message unchanged so fields the router doesn't know about survive
+    if (shardSocket < 0 || send(shardSocket, buffer, len, MSG_NOSIGNAL) < 0)
+    {
+        pthread_mutex_lock(&statsMutex);
+        shards[shard].failures++;
+        pthread_mutex_unlock(&statsMutex);
+        if (shardSocket >= 0)
+        {
+            close(shardSocket);
+        }
+        close(clientSocket);
+        return NULL;
+    }
+
+    pthread_mutex_lock(&statsMutex);
+    shards[shard].orders++;
+    shards[shard].distance += calculateDistance(shards[shard].originX, shards[shard].originY, x, y);
+    shards[shard].originDistance += calculateDistance(0, 0, x, y);
+    pthread_mutex_unlock(&statsMutex);
+
+    relay(clientSocket, shardSocket);
+
+    close(shardSocket);
+    close(clientSocket);
+    return NULL;
+}
+
+int main(int argc, char *argv[])
+{
+    int opt, badOption = 0, basePort = 0;
+    const char *binary = NULL, *timeUnit = NULL;
+    while ((opt = getopt(argc, argv, "b:s:u:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'b': // pideshop executable to start for each shard
+            binary = optarg;
+            break;
+        case 's': // First shard port, shards use consecutive ports
+            basePort = atoi(optarg);
+            break;
+        case 'u': // Passed to every shard as its time unit
+            timeUnit = optarg;
+            break;
+        default:
+            badOption = 1;
+            break;
+        }
+    }
+
+    if (badOption || argc - optind != 7)
+    {
+        fprintf(stderr, "Usage: %s [-b <pideshop>] [-s <First Shard Port>] [-u <usec per unit>] <Port> <Shards> <p> <q> <Cook Thread Pool Size> <Delivery Pool Size> <k>\n", argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    int port = atoi(argv[optind]);
+    shardCount = atoi(argv[optind + 1]);
+    p = atoi(argv[optind + 2]);
+    q = atoi(argv[optind + 3]);
+    if (shardCount <= 0 || shardCount > MAX_SHARDS || p <= 0 || q <= 0)
+    {
+        fprintf(stderr, "Shards must be between 1 and %d, p and q must be positive\n", MAX_SHARDS);
+        exit(EXIT_FAILURE);
+    }
+    if (basePort == 0)
+    {
+        basePort = port + 1;
+    }
+
+    // Look for pideshop next to the router unless told otherwise
+    char binaryPath[4096];
+    if (binary == NULL)
+    {
+        const char *slash = strrchr(argv[0], '/');
+        snprintf(binaryPath, sizeof(binaryPath), "%.*spideshop", slash ? (int)(slash - argv[0] + 1) : 0, argv[0]);
+        if (slash == NULL)
+        {
+            snprintf(binaryPath, sizeof(binaryPath), "./pideshop");
+        }
+        binary = binaryPath;
+    }
+
+    struct sigaction action;
+    action.sa_handler = handleSigInt;
+    sigemptyset(&action.sa_mask);
+    action.sa_flags = 0;
+    sigaction(SIGINT, &action, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    planRegions();
+    printf("Map %dx%d split into %d x %d regions\n", p, q, columns, rows);
+    startShards(binary, basePort, argv[optind + 4], argv[optind + 5], argv[optind + 6], timeUnit);
+
+    serverSocket = socket(AF_INET, SOCK_STREAM, 0);
+    if (serverSocket < 0)
+    {
+        perror("Socket creation failed");
+        exit(EXIT_FAILURE);
+    }
+
+    int reuse = 1;
+    setsockopt(serverSocket, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+    struct sockaddr_in server_addr = {0};
+    server_addr.sin_family = AF_INET;
+    server_addr.sin_addr.s_addr = INADDR_ANY;
+    server_addr.sin_port = htons(port);
+
+    if (bind(serverSocket, (struct sockaddr *)&server_addr, sizeof(server_addr)) < 0 || listen(serverSocket, SOMAXCONN) < 0)
+    {
+        perror("Bind/listen failed");
+        close(serverSocket);
+        for (int i = 0; i < shardCount; i++)
+        {
+            kill(shards[i].pid, SIGINT);
+        }
+        exit(EXIT_FAILURE);
+    }
+    printf("Router is running on port %d\n", port);
+
+    while (1)
+    {
+        int clientSocket = accept(serverSocket, NULL, NULL);
+        if (clientSocket < 0)
+        {
+            perror("Accept failed");
+            continue;
+        }
+
+        pthread_t route;
+        pthread_create(&route, NULL, routeThread, (void *)(intptr_t)clientSocket);
+        pthread_detach(route);
+    }
+}
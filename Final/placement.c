@@ -0,0 +1,285 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sched.h>
+#include <pthread.h>
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+
+#include "placement.h"
+
+#define MAX_NODES 64 // NUMA nodes considered when reading the topology
+
+typedef struct
+{
+    cpu_set_t cpus; // Cores the pool may run on
+    int pinned;     // 0 when the pool is left to the scheduler
+} rolePlacement;
+
+static const char *roleNames[ROLE_COUNT] = {"io", "cook", "courier"};
+
+static cpu_set_t nodeCpus[MAX_NODES]; // Cores of every NUMA node
+static int nodeCount = 0;              // Number of NUMA nodes found
+static rolePlacement roles[ROLE_COUNT];
+static int memoryNode = -1; // Node queue and order memory is preferred on, -1 for the default policy
+
+// Function to parse a kernel style cpu list ("0-3,8,10-11") into a cpu set
+static int parseCpuList(const char *list, cpu_set_t *set)
+{
+    CPU_ZERO(set);
+    const char *cursor = list;
+    while (*cursor != '\0' && *cursor != '\n')
+    {
+        char *end;
+        long first = strtol(cursor, &end, 10);
+        if (end == cursor || first < 0 || first >= CPU_SETSIZE)
+        {
+            return -1;
+        }
+        long last = first;
+        if (*end == '-')
+        {
+            cursor = end + 1;
+            last = strtol(cursor, &end, 10);
+            if (end == cursor || last < first || last >= CPU_SETSIZE)
+            {
+                return -1;
+            }
+        }
+        for (long cpu = first; cpu <= last; cpu++)
+        {
+            CPU_SET(cpu, set);
+        }
+        cursor = *end == ',' ? end + 1 : end;
+    }
+    return CPU_COUNT(set) > 0 ? 0 : -1;
+}
+
+// Function to read the NUMA topology from sysfs, falling back to a single node
+static void readTopology(void)
+{
+    cpu_set_t allowed;
+    sched_getaffinity(0, sizeof(allowed), &allowed);
+
+    for (int node = 0; node < MAX_NODES; node++)
+    {
+        char path[64], list[1024];
+        snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", node);
+        FILE *file = fopen(path, "r");
+        if (file == NULL)
+        {
+            continue;
+        }
+        int ok = fgets(list, sizeof(list), file) != NULL;
+        fclose(file);
+
+        cpu_set_t cpus;
+        if (ok && parseCpuList(list, &cpus) == 0)
+        {
+            CPU_AND(&nodeCpus[nodeCount], &cpus, &allowed);
+            if (CPU_COUNT(&nodeCpus[nodeCount]) > 0) // Skip memory-only nodes and nodes we may not run on
+            {
+                nodeCount++;
+            }
+        }
+    }
+
+    if (nodeCount == 0)
+    {
+        nodeCpus[0] = allowed;
+        nodeCount = 1;
+    }
+}
+
+// Function to copy the cores of a set with index in [from, to) into another set
+static void sliceCpus(const cpu_set_t *source, int from, int to, cpu_set_t *slice)
+{
+    CPU_ZERO(slice);
+    int seen = 0;
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+    {
+        if (CPU_ISSET(cpu, source))
+        {
+            if (seen >= from && seen < to)
+            {
+                CPU_SET(cpu, slice);
+            }
+            seen++;
+        }
+    }
+}
+
+static void pinRole(threadRole role, const cpu_set_t *cpus)
+{
+    roles[role].cpus = *cpus;
+    roles[role].pinned = 1;
+}
+
+static int nodeOf(const cpu_set_t *cpus)
+{
+    for (int node = 0; node < nodeCount; node++)
+    {
+        cpu_set_t common;
+        CPU_AND(&common, &nodeCpus[node], cpus);
+        if (CPU_COUNT(&common) > 0)
+        {
+            return node;
+        }
+    }
+    return 0;
+}
+
+int placementInit(const char *policy)
+{
+    readTopology();
+    memset(roles, 0, sizeof(roles));
+
+    const cpu_set_t *home = &nodeCpus[0];
+    int homeCount = CPU_COUNT(home);
+    cpu_set_t io, workers, cooks, couriers;
+
+    // One core of the home node is kept for the network side, the rest cook and deliver
+    sliceCpus(home, 0, 1, &io);
+    if (homeCount > 1)
+    {
+        sliceCpus(home, 1, homeCount, &workers);
+    }
+    else
+    {
+        workers = *home;
+    }
+
+    if (strcmp(policy, "none") == 0)
+    {
+        return 0;
+    }
+    else if (strcmp(policy, "compact") == 0) // Everything on one node, workers share a core set
+    {
+        pinRole(ROLE_IO, &io);
+        pinRole(ROLE_COOK, &workers);
+        pinRole(ROLE_COURIER, &workers);
+    }
+    else if (strcmp(policy, "split") == 0) // Same node, but each pool gets its own cores
+    {
+        int workerCount = CPU_COUNT(&workers);
+        if (workerCount > 1)
+        {
+            sliceCpus(&workers, 0, workerCount / 2, &cooks);
+            sliceCpus(&workers, workerCount / 2, workerCount, &couriers);
+        }
+        else
+        {
+            cooks = couriers = workers;
+        }
+        pinRole(ROLE_IO, &io);
+        pinRole(ROLE_COOK, &cooks);
+        pinRole(ROLE_COURIER, &couriers);
+    }
+    else if (strcmp(policy, "spread") == 0) // Cooks and couriers as far apart as possible, for comparison
+    {
+        if (nodeCount > 1)
+        {
+            cooks = nodeCpus[0];
+            couriers = nodeCpus[nodeCount - 1];
+        }
+        else if (homeCount > 1)
+        {
+            sliceCpus(home, 0, homeCount / 2, &cooks);
+            sliceCpus(home, homeCount / 2, homeCount, &couriers);
+        }
+        else
+        {
+            cooks = couriers = *home;
+        }
+        pinRole(ROLE_COOK, &cooks);
+        pinRole(ROLE_COURIER, &couriers);
+    }
+    else
+    {
+        return -1;
+    }
+
+    memoryNode = nodeOf(&roles[ROLE_COOK].cpus);
+    return 0;
+}
+
+int placementSetRole(const char *spec)
+{
+    const char *equals = strchr(spec, '=');
+    if (equals == NULL)
+    {
+        return -1;
+    }
+
+    for (int role = 0; role < ROLE_COUNT; role++)
+    {
+        if (strlen(roleNames[role]) == (size_t)(equals - spec) && strncmp(spec, roleNames[role], equals - spec) == 0)
+        {
+            cpu_set_t cpus;
+            if (parseCpuList(equals + 1, &cpus) < 0)
+            {
+                return -1;
+            }
+            pinRole(role, &cpus);
+            if (role == ROLE_COOK || memoryNode < 0)
+            {
+                memoryNode = nodeOf(&cpus);
+            }
+            return 0;
+        }
+    }
+    return -1;
+}
+
+void placementApply(threadRole role)
+{
+    if (roles[role].pinned)
+    {
+        int result = pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &roles[role].cpus);
+        if (result != 0)
+        {
+            fprintf(stderr, "Failed to pin %s thread: %s\n", roleNames[role], strerror(result));
+        }
+    }
+
+    // Orders and queue rings are allocated by whichever thread touches them
+    // first, so every thread prefers the node the kitchen runs on
+    if (memoryNode >= 0 && nodeCount > 1)
+    {
+        unsigned long mask = 1UL << memoryNode;
+        if (syscall(SYS_set_mempolicy, MPOL_PREFERRED, &mask, sizeof(mask) * 8) < 0)
+        {
+            perror("set_mempolicy");
+        }
+    }
+}
+
+void placementDescribe(void)
+{
+    printf("NUMA nodes: %d", nodeCount);
+    if (memoryNode >= 0)
+    {
+        printf(", kitchen memory on node %d", memoryNode);
+    }
+    printf("\n");
+
+    for (int role = 0; role < ROLE_COUNT; role++)
+    {
+        printf("  %-8s", roleNames[role]);
+        if (!roles[role].pinned)
+        {
+            printf(" unpinned\n");
+            continue;
+        }
+        for (int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+        {
+            if (CPU_ISSET(cpu, &roles[role].cpus))
+            {
+                printf(" %d", cpu);
+            }
+        }
+        printf("\n");
+    }
+}
@@ -0,0 +1,17 @@
+#ifndef PLACEMENT_H
+#define PLACEMENT_H
+
+typedef enum // Thread pools that can be placed on their own core sets
+{
+    ROLE_IO,      // Acceptor, manager and other network/log threads
+    ROLE_COOK,    // Cook thread pool
+    ROLE_COURIER, // Delivery thread pool
+    ROLE_COUNT
+} threadRole;
+
+int placementInit(const char *policy);   // none, compact, split or spread; -1 if unknown
+int placementSetRole(const char *spec);  // Override one pool, e.g. "cook=0-3,8-11"; -1 if malformed
+void placementApply(threadRole role);    // Pin the calling thread and set its NUMA memory policy
+void placementDescribe(void);            // Print the resulting core sets
+
+#endif
@@ -0,0 +1,129 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "orderpool.h"
+
+// Compares moving orders through the kitchen by value (fixed arrays, one
+// malloc'd socket int per connection) with moving pooled handles.
+
+#define BENCH_ORDERS 1000000 // Orders pushed through each pipeline
+#define BENCH_BATCH 1000     // Orders in flight at once (the old MAX_ORDERS)
+
+// Called through a volatile pointer so the compiler cannot elide the malloc/free pair
+static void *(*volatile allocate)(size_t) = malloc;
+
+static double nowSeconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Function to run the original by-value pipeline: manager -> orderQueue -> cook -> deliveryQueue -> courier
+static void benchByValue(void)
+{
+    static orderStruct orderQueue[BENCH_BATCH];
+    static orderStruct deliveryQueue[BENCH_BATCH];
+    int orderCount = 0, deliveryCount = 0;
+    uint64_t allocations = 0, bytesCopied = 0;
+    long checksum = 0;
+
+    double start = nowSeconds();
+    for (int done = 0; done < BENCH_ORDERS; done += BENCH_BATCH)
+    {
+        for (int i = 0; i < BENCH_BATCH; i++) // Acceptor and managers
+        {
+            int *clientSocket = allocate(sizeof(int));
+            allocations++;
+            *clientSocket = i;
+            orderStruct order = {.orderID = done + i, .x = i, .y = -i, .clientSocket = *clientSocket, .status = 0};
+            free(clientSocket);
+            orderQueue[orderCount++] = order;
+            bytesCopied += sizeof(orderStruct);
+        }
+        while (orderCount > 0) // Cooks
+        {
+            orderStruct order = orderQueue[--orderCount];
+            order.status = 2;
+            deliveryQueue[deliveryCount++] = order;
+            bytesCopied += 2 * sizeof(orderStruct);
+        }
+        while (deliveryCount > 0) // Couriers
+        {
+            orderStruct order = deliveryQueue[--deliveryCount];
+            bytesCopied += sizeof(orderStruct);
+            checksum += order.orderID + order.x;
+        }
+    }
+    double elapsed = nowSeconds() - start;
+
+    printf("%-10s %12.1f %14.3f %16.1f %12.1f  (checksum %ld)\n", "by-value", BENCH_ORDERS / elapsed / 1e6,
+           elapsed * 1e9 / BENCH_ORDERS, (double)allocations / BENCH_ORDERS, (double)bytesCopied / BENCH_ORDERS, checksum);
+}
+
+// Function to run the pooled pipeline where queues only move 32-bit handles
+static void benchPooled(void)
+{
+    orderPool pool;
+    handleQueue orderQueue = {0}, deliveryQueue = {0};
+    uint64_t bytesCopied = 0;
+    long checksum = 0;
+    orderPoolInit(&pool);
+
+    double start = nowSeconds();
+    for (int done = 0; done < BENCH_ORDERS; done += BENCH_BATCH)
+    {
+        for (int i = 0; i < BENCH_BATCH; i++)
+        {
+            orderHandle handle = orderAlloc(&pool);
+            orderStruct *order = orderGet(&pool, handle);
+            order->orderID = done + i;
+            order->x = i;
+            order->y = -i;
+            order->clientSocket = i;
+            handleQueuePush(&orderQueue, handle);
+            bytesCopied += sizeof(orderHandle);
+        }
+        while (orderQueue.count > 0)
+        {
+            orderHandle handle = handleQueuePop(&orderQueue);
+            orderGet(&pool, handle)->status = 2;
+            handleQueuePush(&deliveryQueue, handle);
+            bytesCopied += 2 * sizeof(orderHandle);
+        }
+        while (deliveryQueue.count > 0)
+        {
+            orderHandle handle = handleQueuePop(&deliveryQueue);
+            orderStruct *order = orderGet(&pool, handle);
+            checksum += order->orderID + order->x;
+            orderFree(&pool, handle);
+            bytesCopied += sizeof(orderHandle);
+        }
+    }
+    double elapsed = nowSeconds() - start;
+
+    // Chunk allocations plus the ring buffers of both queues
+    uint64_t allocations = pool.chunkCount;
+    for (uint32_t capacity = 64; capacity <= orderQueue.capacity; capacity *= 2)
+    {
+        allocations += 2;
+    }
+    printf("%-10s %12.1f %14.3f %16.6f %12.1f  (checksum %ld, peak %u orders in %u chunks)\n", "pooled", BENCH_ORDERS / elapsed / 1e6,
+           elapsed * 1e9 / BENCH_ORDERS, (double)allocations / BENCH_ORDERS, (double)bytesCopied / BENCH_ORDERS, checksum, pool.peak, pool.chunkCount);
+
+    handleQueueDestroy(&orderQueue);
+    handleQueueDestroy(&deliveryQueue);
+    orderPoolDestroy(&pool);
+}
+
+int main(void)
+{
+    printf("%d orders, %d in flight\n", BENCH_ORDERS, BENCH_BATCH);
+    printf("%-10s %12s %14s %16s %12s\n", "pipeline", "Morders/s", "ns/order", "allocs/order", "bytes/order");
+    benchByValue();
+    benchPooled();
+    return 0;
+}
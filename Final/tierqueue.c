@@ -0,0 +1,141 @@
+#include <stdlib.h>
+
+#include "tierqueue.h"
+
+const char *tierNames[TIER_COUNT] = {"regular", "express", "vip"};
+int tierWeights[TIER_COUNT] = {1, 2, 4};
+uint64_t tierSlaNs[TIER_COUNT] = {30000000000ULL, 15000000000ULL, 10000000000ULL}; // Overridden by the server from -S
+int slaUrgentPercent = 75;
+
+int tierQueuePush(tierQueue *queue, orderHandle handle, orderTier tier)
+{
+    if (handleQueuePush(&queue->queues[tier], handle) < 0)
+    {
+        return -1;
+    }
+    queue->count++;
+    return 0;
+}
+
+static orderHandle popTier(tierQueue *queue, int tier)
+{
+    queue->count--;
+    return handleQueuePop(&queue->queues[tier]);
+}
+
+orderHandle tierQueuePop(tierQueue *queue, orderPool *pool, uint64_t now)
+{
+    if (queue->count == 0)
+    {
+        return ORDER_HANDLE_NONE;
+    }
+
+    // An order close to missing its SLA goes first, most overdue first.
+    // Each queue is FIFO, so only the heads can be the oldest of their tier.
+    int urgent = -1;
+    double urgency = 0;
+    for (int tier = 0; tier < TIER_COUNT; tier++)
+    {
+        handleQueue *fifo = &queue->queues[tier];
+        if (fifo->count == 0)
+        {
+            continue;
+        }
+        orderStruct *head = orderGet(pool, fifo->items[fifo->head]);
+        if (head == NULL || now < head->receivedAt)
+        {
+            continue;
+        }
+        double used = (double)(now - head->receivedAt) / tierSlaNs[tier];
+        if (used * 100 >= slaUrgentPercent && used > urgency)
+        {
+            urgent = tier;
+            urgency = used;
+        }
+    }
+    if (urgent >= 0)
+    {
+        return popTier(queue, urgent);
+    }
+
+    // Smooth weighted round robin over the tiers that have work, so lower
+    // tiers keep a guaranteed share and are never starved
+    int chosen = -1, totalWeight = 0;
+    for (int tier = 0; tier < TIER_COUNT; tier++)
+    {
+        if (queue->queues[tier].count == 0)
+        {
+            continue;
+        }
+        queue->current[tier] += tierWeights[tier];
+        totalWeight += tierWeights[tier];
+        if (chosen < 0 || queue->current[tier] > queue->current[chosen])
+        {
+            chosen = tier;
+        }
+    }
+    queue->current[chosen] -= totalWeight;
+    return popTier(queue, chosen);
+}
+
+void tierQueueDestroy(tierQueue *queue)
+{
+    for (int tier = 0; tier < TIER_COUNT; tier++)
+    {
+        handleQueueDestroy(&queue->queues[tier]);
+    }
+    queue->count = 0;
+}
+
+// Function to map a latency to its bucket: the power of two, then a linear step inside it
+static int bucketOf(uint64_t ns)
+{
+    if (ns < LATENCY_SUB_BUCKETS)
+    {
+        return (int)ns;
+    }
+    int power = 63 - __builtin_clzll(ns);
+    int step = (int)((ns >> (power - 3)) & (LATENCY_SUB_BUCKETS - 1)); // 3 == log2(LATENCY_SUB_BUCKETS)
+    return power * LATENCY_SUB_BUCKETS + step;
+}
+
+// Function to get the upper bound of a bucket
+static uint64_t bucketLimit(int bucket)
+{
+    int power = bucket / LATENCY_SUB_BUCKETS, step = bucket % LATENCY_SUB_BUCKETS;
+    if (power < 3)
+    {
+        return bucket;
+    }
+    return (1ULL << power) + ((uint64_t)(step + 1) << (power - 3)) - 1;
+}
+
+void latencyRecord(latencyHist *hist, uint64_t ns, uint64_t slaNs)
+{
+    __atomic_fetch_add(&hist->buckets[bucketOf(ns)], 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&hist->count, 1, __ATOMIC_RELAXED);
+    if (ns > slaNs)
+    {
+        __atomic_fetch_add(&hist->slaMisses, 1, __ATOMIC_RELAXED);
+    }
+
+    uint64_t max = __atomic_load_n(&hist->max, __ATOMIC_RELAXED);
+    while (ns > max && !__atomic_compare_exchange_n(&hist->max, &max, ns, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+    {
+    }
+}
+
+uint64_t latencyPercentile(const latencyHist *hist, double fraction)
+{
+    uint64_t target = (uint64_t)(hist->count * fraction), seen = 0;
+    for (int bucket = 0; bucket < LATENCY_BUCKETS; bucket++)
+    {
+        seen += hist->buckets[bucket];
+        if (seen > target)
+        {
+            uint64_t limit = bucketLimit(bucket);
+            return limit < hist->max ? limit : hist->max;
+        }
+    }
+    return hist->max;
+}
@@ -0,0 +1,46 @@
+#ifndef TIERQUEUE_H
+#define TIERQUEUE_H
+
+#include <stdint.h>
+
+#include "orderpool.h"
+
+#define LATENCY_SUB_BUCKETS 8                       // Linear steps inside each power of two
+#define LATENCY_BUCKETS (64 * LATENCY_SUB_BUCKETS)  // Enough to cover any 64-bit nanosecond value
+
+typedef enum
+{
+    TIER_REGULAR,
+    TIER_EXPRESS,
+    TIER_VIP,
+    TIER_COUNT
+} orderTier;
+
+typedef struct // One FIFO per tier, dequeued by smooth weighted round robin
+{
+    handleQueue queues[TIER_COUNT]; // Pending handles of each tier
+    int current[TIER_COUNT];        // Running round robin credit of each tier
+    uint32_t count;                 // Handles queued over all tiers
+} tierQueue;
+
+typedef struct // Log-linear latency histogram, safe to update from many threads
+{
+    uint64_t buckets[LATENCY_BUCKETS];
+    uint64_t count;
+    uint64_t max;
+    uint64_t slaMisses;
+} latencyHist;
+
+extern const char *tierNames[TIER_COUNT];
+extern int tierWeights[TIER_COUNT]; // Share of dequeues each tier gets while others are waiting
+extern uint64_t tierSlaNs[TIER_COUNT]; // End-to-end delivery target of each tier
+extern int slaUrgentPercent;         // Orders older than this share of their SLA jump every queue
+
+int tierQueuePush(tierQueue *queue, orderHandle handle, orderTier tier);
+orderHandle tierQueuePop(tierQueue *queue, orderPool *pool, uint64_t now); // ORDER_HANDLE_NONE when empty
+void tierQueueDestroy(tierQueue *queue);
+
+void latencyRecord(latencyHist *hist, uint64_t ns, uint64_t slaNs);
+uint64_t latencyPercentile(const latencyHist *hist, double fraction);
+
+#endif
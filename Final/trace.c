@@ -0,0 +1,255 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/syscall.h>
+
+#include "trace.h"
+
+typedef struct
+{
+    uint64_t timestamp; // Monotonic time in nanoseconds
+    int orderID;        // Order the event belongs to
+    unsigned char stage; // traceStage of the event
+    char phase;         // Chrome phase: B/E for thread-local spans, b/e for queue waits
+} traceEvent;
+
+typedef struct traceOwner
+{
+    pid_t tid;               // Kernel thread ID
+    char name[32];           // Thread name shown in the viewer
+    uint64_t first;          // Ring index of the thread's first event
+    struct traceOwner *next; // Previous owner of the same ring
+} traceOwner;
+
+typedef struct traceRing
+{
+    traceOwner *owners;                 // Threads that used the ring, the current one first
+    uint64_t head;                      // Number of events ever recorded
+    traceEvent events[TRACE_RING_SIZE]; // Circular event storage
+    struct traceRing *next;             // Next ring in the registry
+    struct traceRing *nextFree;         // Next ring whose owner has exited
+} traceRing;
+
+// Stage names as they appear in the trace viewer
+static const char *stageNames[TRACE_STAGE_COUNT] = {
+    "receive", "order queue wait", "prep", "shovel acquire",
+    "oven", "delivery queue wait", "delivery", "notify"};
+
+int traceEnabled = 0;
+
+static char tracePath[256];                                     // Output file for the dump
+static traceRing *rings = NULL;                                 // Every ring that was ever created
+static traceRing *freeRings = NULL;                             // Rings of exited threads, reused by new ones
+static pthread_mutex_t ringsMutex = PTHREAD_MUTEX_INITIALIZER; // Protects the ring registry and the free list
+static pthread_key_t ringKey;                                   // Runs retireRing when a thread exits
+static __thread traceRing *localRing = NULL;                    // Ring of the calling thread
+
+static uint64_t traceNow(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// Queue waits start on one thread and end on another, so they are async spans
+static int isAsyncStage(traceStage stage)
+{
+    return stage == TRACE_ORDER_QUEUE_WAIT || stage == TRACE_DELIVERY_QUEUE_WAIT;
+}
+
+// Function to hand the ring of an exiting thread to the next thread that needs one.
+// Its events stay in the dump, so ring memory follows the threads alive at once, not the orders.
+static void retireRing(void *arg)
+{
+    traceRing *ring = arg;
+
+    pthread_mutex_lock(&ringsMutex);
+    ring->nextFree = freeRings;
+    freeRings = ring;
+    pthread_mutex_unlock(&ringsMutex);
+}
+
+// Function to get (and lazily register or reuse) the ring of the calling thread
+static traceRing *getRing(void)
+{
+    if (localRing != NULL)
+    {
+        return localRing;
+    }
+
+    traceOwner *owner = calloc(1, sizeof(traceOwner));
+    if (owner == NULL)
+    {
+        return NULL;
+    }
+    owner->tid = syscall(SYS_gettid);
+    snprintf(owner->name, sizeof(owner->name), "thread %d", (int)owner->tid);
+
+    // A reused ring gives the new owner its own lane in the viewer, starting after the old events
+    pthread_mutex_lock(&ringsMutex);
+    traceRing *ring = freeRings;
+    if (ring != NULL)
+    {
+        freeRings = ring->nextFree;
+
+        // Owners whose every event was overwritten have nothing left to show
+        uint64_t oldest = ring->head > TRACE_RING_SIZE ? ring->head - TRACE_RING_SIZE : 0;
+        for (traceOwner *kept = ring->owners; kept != NULL; kept = kept->next)
+        {
+            if (kept->first <= oldest)
+            {
+                while (kept->next != NULL)
+                {
+                    traceOwner *gone = kept->next;
+                    kept->next = gone->next;
+                    free(gone);
+                }
+                break;
+            }
+        }
+    }
+    else
+    {
+        ring = calloc(1, sizeof(traceRing));
+        if (ring == NULL)
+        {
+            pthread_mutex_unlock(&ringsMutex);
+            free(owner);
+            return NULL;
+        }
+        ring->next = rings;
+        rings = ring;
+    }
+    owner->first = ring->head;
+    owner->next = ring->owners;
+    ring->owners = owner;
+    pthread_mutex_unlock(&ringsMutex);
+
+    pthread_setspecific(ringKey, ring);
+    localRing = ring;
+    return ring;
+}
+
+static void record(traceStage stage, int orderID, char phase)
+{
+    traceRing *ring = getRing();
+    if (ring == NULL)
+    {
+        return;
+    }
+
+    traceEvent *event = &ring->events[ring->head % TRACE_RING_SIZE];
+    event->timestamp = traceNow();
+    event->orderID = orderID;
+    event->stage = stage;
+    event->phase = phase;
+    ring->head++;
+}
+
+int traceInit(const char *path)
+{
+    // Fail now rather than after the whole run if the dump could not be written
+    FILE *out = fopen(path, "a");
+    if (out == NULL)
+    {
+        perror("Failed to open trace file");
+        return -1;
+    }
+    fclose(out);
+
+    if (pthread_key_create(&ringKey, retireRing) != 0)
+    {
+        perror("pthread_key_create");
+        return -1;
+    }
+    snprintf(tracePath, sizeof(tracePath), "%s", path);
+    traceEnabled = 1;
+    return 0;
+}
+
+void traceThreadName(const char *name)
+{
+    if (!traceEnabled)
+    {
+        return;
+    }
+
+    traceRing *ring = getRing();
+    if (ring != NULL)
+    {
+        snprintf(ring->owners->name, sizeof(ring->owners->name), "%s", name);
+    }
+}
+
+void traceBegin(traceStage stage, int orderID)
+{
+    if (traceEnabled)
+    {
+        record(stage, orderID, isAsyncStage(stage) ? 'b' : 'B');
+    }
+}
+
+void traceEnd(traceStage stage, int orderID)
+{
+    if (traceEnabled)
+    {
+        record(stage, orderID, isAsyncStage(stage) ? 'e' : 'E');
+    }
+}
+
+int traceDump(void)
+{
+    if (!traceEnabled)
+    {
+        return 0;
+    }
+
+    FILE *out = fopen(tracePath, "w");
+    if (out == NULL)
+    {
+        perror("Failed to open trace file");
+        return -1;
+    }
+
+    pid_t pid = getpid();
+    int first = 1;
+    fprintf(out, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+
+    pthread_mutex_lock(&ringsMutex);
+    for (traceRing *ring = rings; ring != NULL; ring = ring->next)
+    {
+        uint64_t head = ring->head;
+        uint64_t oldest = head > TRACE_RING_SIZE ? head - TRACE_RING_SIZE : 0;
+        uint64_t end = head; // Each owner's events run up to the next owner's first one
+        for (traceOwner *owner = ring->owners; owner != NULL && end > oldest; end = owner->first, owner = owner->next)
+        {
+            fprintf(out, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+                    first ? "" : ",\n", (int)pid, (int)owner->tid, owner->name);
+            first = 0;
+
+            // Oldest surviving event first, so B/E pairs stay in order
+            for (uint64_t i = owner->first > oldest ? owner->first : oldest; i < end; i++)
+            {
+                traceEvent *event = &ring->events[i % TRACE_RING_SIZE];
+                fprintf(out, ",\n{\"name\":\"%s\",\"cat\":\"order\",\"ph\":\"%c\",\"ts\":%.3f,\"pid\":%d,\"tid\":%d",
+                        stageNames[event->stage], event->phase, event->timestamp / 1000.0, (int)pid, (int)owner->tid);
+                if (event->phase == 'b' || event->phase == 'e')
+                {
+                    fprintf(out, ",\"id\":%d", event->orderID);
+                }
+                fprintf(out, ",\"args\":{\"order\":%d}}", event->orderID);
+            }
+        }
+    }
+    pthread_mutex_unlock(&ringsMutex);
+
+    fprintf(out, "\n]}\n");
+    fclose(out);
+    printf("Trace written to %s\n", tracePath);
+    return 0;
+}
@@ -0,0 +1,27 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#define TRACE_RING_SIZE 16384 // Number of events each thread keeps before the oldest are overwritten
+
+typedef enum // Pipeline stages an order goes through, in order
+{
+    TRACE_RECEIVE,
+    TRACE_ORDER_QUEUE_WAIT,
+    TRACE_PREP,
+    TRACE_SHOVEL_ACQUIRE,
+    TRACE_OVEN,
+    TRACE_DELIVERY_QUEUE_WAIT,
+    TRACE_DELIVERY,
+    TRACE_NOTIFY,
+    TRACE_STAGE_COUNT
+} traceStage;
+
+extern int traceEnabled; // Set when a trace file was requested
+
+int traceInit(const char *path);             // Enable tracing, events are dumped to path
+void traceThreadName(const char *name);      // Name the calling thread in the trace viewer
+void traceBegin(traceStage stage, int orderID); // Record the start of a stage for an order
+void traceEnd(traceStage stage, int orderID);   // Record the end of a stage for an order
+int traceDump(void);                         // Write every recorded event as Chrome trace JSON
+
+#endif
@@ -11,6 +11,8 @@
 #include <errno.h>
 #include <signal.h>
 
+#include "copyengine.h"
+
 #define MAX_BUFFER_SIZE 1024 // maximum buffer size
 #define PATH_MAX 4096        // maximum path length
 
@@ -114,15 +116,17 @@ int main(int argc, char *argv[])
     }
 
     gettimeofday(&end, NULL);                 // get the end time
-    long seconds = end.tv_sec - start.tv_sec; // calculate the total time
-    long miliseconds = (end.tv_usec - start.tv_usec) / 1000;
-    long minutes = seconds / 60;
-    seconds = seconds % 60;
+    long elapsed = (end.tv_sec - start.tv_sec) * 1000 + (end.tv_usec - start.tv_usec) / 1000; // calculate the total time in miliseconds
+    long miliseconds = elapsed % 1000;
+    long seconds = elapsed / 1000 % 60;
+    long minutes = elapsed / 60000;
 
     //  Print the statistics
     char *stdoutBuffer = (char *)malloc(4096);
     sprintf(stdoutBuffer, "All files copied successfully.\n\n---------------STATISTICS--------------------\nConsumers: %d - Buffer Size: %d\nNumber of Regular File: %d\nNumber of FIFO File: %d\nNumber of Directory: %d\nTOTAL BYTES COPIED: %ld\nTOTAL TIME: %02ld:%02ld.%03ld (min:sec.mili)\n", numberOfWorkers, bufferSize, numRegular, numFifo, numDir, totalBytes, minutes, seconds, miliseconds);
     write(STDOUT_FILENO, stdoutBuffer, strlen(stdoutBuffer));
+    copyStatsReport(stdoutBuffer, 4096); // bytes and throughput of each copy path
+    write(STDOUT_FILENO, stdoutBuffer, strlen(stdoutBuffer));
     free(stdoutBuffer);
     return 0;
 }
@@ -271,23 +275,22 @@ void *worker(void *arg)
         pthread_cond_signal(&bufferNotFull);           // signal that the buffer is not full
         pthread_mutex_unlock(&mutex);                  // unlock the mutex
 
+        copyPath path = COPY_PATH_COUNT;         // path that copied the file, none for FIFOs
         if (!filePair.isFifo && !filePair.isDir) // check if the file is a regular file
         {
-            char buffer[4096];
-            ssize_t bytes;
-            while ((bytes = read(filePair.srcFD, buffer, sizeof(buffer))) > 0) // read the content of the source file
+            struct timeval copyStart, copyEnd;                                  // start and end time of the copy
+            gettimeofday(&copyStart, NULL);                                     // get the start time
+            long long bytes = copyFileData(filePair.srcFD, filePair.destFD, &path); // copy the content of the source file in the kernel when possible
+            gettimeofday(&copyEnd, NULL);                                       // get the end time
+            if (bytes < 0)
             {
-                if (write(filePair.destFD, buffer, bytes) != bytes) // write the content of the source file to the destination file
-                {
-                    perror("write");
-                    break;
-                }
-                pthread_mutex_lock(&mutex);
-                totalBytes += bytes;
-                pthread_mutex_unlock(&mutex);
+                perror("copy");
+                bytes = 0;
             }
+            copyStatsRecord(path, bytes, (copyEnd.tv_sec - copyStart.tv_sec) + (copyEnd.tv_usec - copyStart.tv_usec) / 1e6);
 
             pthread_mutex_lock(&mutex); // lock the mutex
+            totalBytes += bytes;
             numRegular++;
             pthread_mutex_unlock(&mutex); // unlock the mutex
 
@@ -309,7 +312,14 @@ void *worker(void *arg)
         }
 
         char *stdoutBuffer = (char *)malloc(4096);
-        sprintf(stdoutBuffer, "Copied: %s -> %s\n", filePair.srcName, filePair.destName);
+        if (path < COPY_PATH_COUNT)
+        {
+            snprintf(stdoutBuffer, 4096, "Copied: %s -> %s (%s)\n", filePair.srcName, filePair.destName, copyPathNames[path]);
+        }
+        else
+        {
+            snprintf(stdoutBuffer, 4096, "Copied: %s -> %s\n", filePair.srcName, filePair.destName);
+        }
         write(STDOUT_FILENO, stdoutBuffer, strlen(stdoutBuffer));
         free(stdoutBuffer);
     }
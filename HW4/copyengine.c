@@ -0,0 +1,214 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/sendfile.h>
+
+#include "copyengine.h"
+
+const char *copyPathNames[COPY_PATH_COUNT] = {"copy_file_range", "sendfile", "splice", "read/write"};
+
+long long pathFiles[COPY_PATH_COUNT];                       // files completed by each path
+long long pathBytes[COPY_PATH_COUNT];                       // bytes copied by each path
+double pathSeconds[COPY_PATH_COUNT];                        // time spent copying by each path
+pthread_mutex_t statsMutex = PTHREAD_MUTEX_INITIALIZER;     // mutex for the statistics
+
+//  A kernel copy call failed in a way that means the next path may still work
+static int isUnsupported(int err)
+{
+    return err == EXDEV || err == EINVAL || err == ENOSYS || err == EOPNOTSUPP || err == EBADF || err == ESPIPE;
+}
+
+//  Copy with copy_file_range, returns 0 when done, 1 to fall back, -1 on error
+static int copyWithCopyFileRange(int srcFD, int destFD, long long *copied)
+{
+    while (1)
+    {
+        ssize_t bytes = copy_file_range(srcFD, NULL, destFD, NULL, COPY_CHUNK, 0); // offsets of both files advance
+        if (bytes == 0)
+        {
+            return 0;
+        }
+        if (bytes < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return isUnsupported(errno) ? 1 : -1;
+        }
+        *copied += bytes;
+    }
+}
+
+//  Copy with sendfile, returns 0 when done, 1 to fall back, -1 on error
+static int copyWithSendfile(int srcFD, int destFD, long long *copied)
+{
+    while (1)
+    {
+        ssize_t bytes = sendfile(destFD, srcFD, NULL, COPY_CHUNK);
+        if (bytes == 0)
+        {
+            return 0;
+        }
+        if (bytes < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return isUnsupported(errno) ? 1 : -1;
+        }
+        *copied += bytes;
+    }
+}
+
+//  Copy with splice through a pipe, returns 0 when done, 1 to fall back, -1 on error
+static int copyWithSplice(int srcFD, int destFD, long long *copied)
+{
+    int pipeFD[2];
+    if (pipe(pipeFD) < 0)
+    {
+        return 1;
+    }
+    fcntl(pipeFD[1], F_SETPIPE_SZ, COPY_BUFFER_SIZE); // a larger pipe means fewer splice calls
+
+    int result = 0;
+    while (1)
+    {
+        ssize_t bytes = splice(srcFD, NULL, pipeFD[1], NULL, COPY_BUFFER_SIZE, SPLICE_F_MOVE);
+        if (bytes < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (bytes <= 0)
+        {
+            result = bytes == 0 ? 0 : (isUnsupported(errno) ? 1 : -1);
+            break;
+        }
+
+        ssize_t pending = bytes; // everything in the pipe must reach the destination
+        while (pending > 0)
+        {
+            ssize_t written = splice(pipeFD[0], NULL, destFD, NULL, pending, SPLICE_F_MOVE);
+            if (written < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            if (written <= 0)
+            {
+                // Bytes already in the pipe are lost to a fallback, so this is an error
+                result = -1;
+                break;
+            }
+            pending -= written;
+            *copied += written;
+        }
+        if (result < 0)
+        {
+            break;
+        }
+    }
+
+    close(pipeFD[0]);
+    close(pipeFD[1]);
+    return result;
+}
+
+//  Copy with read and write through a large buffer, returns 0 when done, -1 on error
+static int copyWithReadWrite(int srcFD, int destFD, long long *copied)
+{
+    char *buffer = malloc(COPY_BUFFER_SIZE);
+    if (buffer == NULL)
+    {
+        return -1;
+    }
+
+    int result = 0;
+    ssize_t bytes;
+    while ((bytes = read(srcFD, buffer, COPY_BUFFER_SIZE)) != 0)
+    {
+        if (bytes < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            result = -1;
+            break;
+        }
+        for (ssize_t offset = 0; offset < bytes;)
+        {
+            ssize_t written = write(destFD, buffer + offset, bytes - offset);
+            if (written < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            if (written <= 0)
+            {
+                result = -1;
+                break;
+            }
+            offset += written;
+            *copied += written;
+        }
+        if (result < 0)
+        {
+            break;
+        }
+    }
+
+    free(buffer);
+    return result;
+}
+
+//  Copy a whole file, trying each path in turn; a path that gives up mid-file leaves
+//  both offsets where it stopped, so the next one continues from there
+long long copyFileData(int srcFD, int destFD, copyPath *pathTaken)
+{
+    long long copied = 0;
+    int result = copyWithCopyFileRange(srcFD, destFD, &copied);
+    *pathTaken = COPY_FILE_RANGE;
+    if (result == 1)
+    {
+        result = copyWithSendfile(srcFD, destFD, &copied);
+        *pathTaken = COPY_SENDFILE;
+    }
+    if (result == 1)
+    {
+        result = copyWithSplice(srcFD, destFD, &copied);
+        *pathTaken = COPY_SPLICE;
+    }
+    if (result == 1)
+    {
+        result = copyWithReadWrite(srcFD, destFD, &copied);
+        *pathTaken = COPY_READ_WRITE;
+    }
+    return result < 0 ? -1 : copied;
+}
+
+void copyStatsRecord(copyPath path, long long bytes, double seconds)
+{
+    pthread_mutex_lock(&statsMutex);
+    pathFiles[path]++;
+    pathBytes[path] += bytes;
+    pathSeconds[path] += seconds;
+    pthread_mutex_unlock(&statsMutex);
+}
+
+void copyStatsReport(char *out, size_t size)
+{
+    size_t used = 0;
+    pthread_mutex_lock(&statsMutex);
+    for (int path = 0; path < COPY_PATH_COUNT && used < size; path++)
+    {
+        // Per-file time summed over workers, so this is the rate of one worker on that path
+        double rate = pathSeconds[path] > 0 ? pathBytes[path] / pathSeconds[path] / (1024 * 1024) : 0;
+        used += snprintf(out + used, size - used, "%-16s files: %lld bytes: %lld throughput: %.1f MB/s\n",
+                         copyPathNames[path], pathFiles[path], pathBytes[path], rate);
+    }
+    pthread_mutex_unlock(&statsMutex);
+}
@@ -0,0 +1,24 @@
+#ifndef COPYENGINE_H
+#define COPYENGINE_H
+
+#include <stddef.h>
+
+typedef enum // Ways a file's data can be moved, tried in this order
+{
+    COPY_FILE_RANGE, // In-kernel copy, may share extents or offload to the device
+    COPY_SENDFILE,   // In-kernel copy through the page cache
+    COPY_SPLICE,     // In-kernel copy through a pipe
+    COPY_READ_WRITE, // User-space copy through a large buffer
+    COPY_PATH_COUNT
+} copyPath;
+
+#define COPY_BUFFER_SIZE (1 << 20) // Buffer size of the read/write fallback
+#define COPY_CHUNK (1L << 30)      // Largest request handed to one kernel copy call
+
+extern const char *copyPathNames[COPY_PATH_COUNT]; // Names used in reports
+
+long long copyFileData(int srcFD, int destFD, copyPath *pathTaken); // Copy srcFD to destFD from their current offsets, -1 on error
+void copyStatsRecord(copyPath path, long long bytes, double seconds); // Add one file to the per-path statistics
+void copyStatsReport(char *out, size_t size);                        // Format the per-path statistics
+
+#endif
@@ -1,3 +1,4 @@
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <pthread.h>
@@ -10,28 +11,132 @@
 #include <sys/types.h>
 #include <errno.h>
 #include <signal.h>
+#include <getopt.h>
+#include <limits.h>
+#include <sys/resource.h>
 
-#define MAX_BUFFER_SIZE 1024 // maximum buffer size
-#define PATH_MAX 4096        // maximum path length
+#include "copyengine.h"
+#include "walker.h"
+#include "uringengine.h"
+#include "manifest.h"
+#include "linkmap.h"
+#include "contenthash.h"
+#include "journal.h"
+#include "progress.h"
 
-typedef struct //  A struct that holds information about files to be copied
+
+#define DEFAULT_CHUNK_SIZE (64LL << 20) // files larger than this are split into ranges of this size
+#define ITEM_DONE 0                     // item copied, or nothing to copy
+#define ITEM_FAILED 1                   // file could not be opened
+#define ITEM_SKIPPED 2                  // file unchanged, skipped by sync mode
+#define ITEM_LINKED 3                   // another link to an inode already copied, linked after the copy
+#define DEDUP_NONE 0                    // every file is copied
+#define DEDUP_CLONE 1                   // duplicates are cloned from the first copy, or copied where cloning fails
+#define DEDUP_LINK 2                    // duplicates become hard links to the first copy
+#define DEDUP_SKIP 3                    // duplicates are left out of the destination
+#define LINK_HARD 0                     // pending hard link to another name of the same source inode
+#define LINK_DEDUP 1                    // pending hard link to an earlier file with the same content
+#define LINK_CLONE 2                    // pending clone of an earlier file with the same content
+#define LINK_SKIP 3                     // duplicate left out, only made if the earlier file failed
+
+typedef struct //  A large file whose ranges are copied by several workers at once
+{
+    int srcFD;        // source file descriptor, shared by every range
+    int destFD;       // destination file descriptor, shared by every range
+    int remaining;    // ranges not copied yet, the worker that copies the last one finishes the file
+    int failed;       // flag to indicate that a range could not be copied
+    long long bytes;  // bytes copied over all ranges
+    copyPath path;    // slowest path any range took
+} fileJob;
+
+typedef struct //  Small files of one directory queued as a single item
 {
-    int srcFD;               // source file descriptor
-    int destFD;              // destination file descriptor
-    char srcName[PATH_MAX];  // source file path
-    char destName[PATH_MAX]; // destination file path
-    int isFifo;              // flag to indicate if the file is a FIFO file
-    int isDir;               // flag to indicate if the file is a directory
+    int count;           // files in the batch
+    long long bytes;     // their total size when the walker saw them
+    const char *names[]; // entry names, stored in the directory's name arena
+} fileBatch;
+
+typedef struct //  A struct that holds information about files to be copied, a small fixed header
+{
+    dirHandle *dir;       // directory the entry is in, both files are opened relative to it
+    const char *name;     // entry name, stored in the directory's name arena
+    union
+    {
+        fileJob *job;     // file this range belongs to, NULL when the item is a whole file
+        fileBatch *batch; // small files copied together, only when isBatch is set
+    };
+    long long offset;     // start of the range
+    long long length;     // length of the range; for a whole file or batch, its size when queued, the largest-first key
+    unsigned char isFifo; // flag to indicate if the file is a FIFO file
+    unsigned char isDir;  // flag to indicate if the file is a directory
+    unsigned char delta;  // flag to indicate the destination already has data to compare against
+    unsigned char sparse; // flag to indicate the source has holes, only its data extents are copied
+    unsigned char isBatch; // flag to indicate the item is a batch of small files, taken apart before anything else
 } filePairStruct;
 
-filePairStruct buffer[MAX_BUFFER_SIZE]; //  An array of filePairStruct structs that holds information about files to be copied
+typedef struct pendingLink //  A hard link or clone to create once every file is copied
+{
+    const char *target;       // destination of the first copy, owned by the link map or by an earlier link
+    char *linkPath;           // destination path of this link
+    char *source;             // source path of this link, copied from when the first copy failed
+    long long size;           // bytes the link stands for
+    int kind;                 // LINK_HARD, LINK_DEDUP, LINK_CLONE or LINK_SKIP
+    struct pendingLink *next; // next link
+} pendingLink;
+
+typedef struct rangeNode //  A range split off by a worker, taken before any new file
+{
+    filePairStruct item;    // the range
+    struct rangeNode *next; // next range
+} rangeNode;
+
+filePairStruct *buffer;                 //  An array of filePairStruct structs that holds information about files to be copied
 int bufferSize;                         // size of the buffer
 int bufferCount = 0;                    // number of items in the buffer
 int done = 0;                           // flag to indicate all files are processed
-long totalBytes = 0;                    // total bytes transferred
-int numRegular = 0;                     // number of regular files transferred
-int numFifo = 0;                        // number of FIFO files transferred
-int numDir = 0;                         // number of directories transferred
+int interruptPipe[2];                   // the SIGINT handler writes a byte here, the interrupter thread stops the copy
+int scheduleLpt = 0;                    // flag to hand out the largest queued item first instead of the newest
+double runStart = 0;                    // monotonic time the copy started
+double *workerFinish = NULL;            // monotonic time each worker finished its last item
+int batchCount = 0;                     // small files packed into one item, 0 queues every file alone
+long long batchBytes = 1 << 20;         // bytes packed into one item at most, larger files are queued alone
+int numBatches = 0;                     // number of batches queued
+int numBatched = 0;                     // number of files queued in them
+__thread fileBatch *openBatch = NULL;   // batch the calling walker is filling from the directory it scans
+double progressInterval = 0;            // seconds between progress reports on stderr, 0 for none
+int progressJson = 0;                   // flag to print the progress reports as JSON lines
+int numChunked = 0;                     // number of files copied in ranges by several workers
+long long chunkSize = DEFAULT_CHUNK_SIZE; // range size for large files, 0 copies every file whole
+int numWalkers = 4;                     // number of threads scanning the source tree
+int numWorkers;                         // number of worker threads
+int useUring = 0;                       // flag to copy through a per-worker io_uring instead of one file at a time
+int queueDepth = URING_DEFAULT_DEPTH;   // read/write pairs in flight per worker with io_uring
+long long ioSize = URING_DEFAULT_IO_SIZE; // bytes per read/write pair with io_uring
+int syncMode = 0;                       // flag to skip unchanged files and rewrite only changed blocks
+int numSkipped = 0;                     // number of unchanged files skipped in sync mode
+int numManifestHits = 0;                // of those, files the directory manifest vouched for without a destination stat
+int numDelta = 0;                       // number of files updated in place in sync mode
+long long skippedBytes = 0;             // bytes not written in sync mode, unchanged files and blocks
+long long deltaRewritten = 0;           // bytes of blocks rewritten in sync mode
+int numHardLinks = 0;                   // number of files linked to an inode copied under another name
+long long linkedBytes = 0;              // bytes those files would have taken to copy
+int numSymlinks = 0;                    // number of symbolic links recreated
+pendingLink *pendingLinks = NULL;       // hard links waiting for the copy to finish
+int dedupMode = DEDUP_NONE;             // what to do with a file whose content was already copied in this run
+int numDuplicates = 0;                  // number of files found to duplicate another one
+long long dedupSaved = 0;               // bytes not written thanks to deduplication
+long long hashedBytes = 0;              // bytes read to hash file contents
+int numSparse = 0;                      // number of copied files with holes
+int resumeMode = 0;                     // flag to leave out the files and ranges the journal of an interrupted run recorded
+int numResumed = 0;                     // number of files the journal and the destination showed were already copied
+long long resumedBytes = 0;             // bytes of those files and of finished ranges, not copied again
+int numFailed = 0;                      // number of files not copied completely, the journal is kept for them
+char **failedPaths = NULL;              // destinations of those files, names deferred to them are copied instead
+int failedCount = 0;                    // number of failed destinations
+int failedCapacity = 0;                 // capacity of failedPaths
+size_t destRootLength = 0;              // length of the destination root, stripped from journal paths
+rangeNode *rangeList = NULL;            // ranges of split files waiting for a worker
+int activeWorkers = 0;                  // workers holding an item, any of them may still split a file
 
 pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;        // mutex for buffer
 pthread_cond_t bufferNotFull = PTHREAD_COND_INITIALIZER;  // condition variable for buffer not full
@@ -40,11 +145,30 @@ pthread_barrier_t barrier;                                // Global barrier vari
 
 void *manager(void *arg);                                       // manager thread
 void *worker(void *arg);                                        // worker thread
-void processDirectory(const char *srcDir, const char *destDir); // process directory
+int processEntry(dirHandle *dir, const char *name, unsigned char type); // process one entry found by the walkers
+void enqueueFilePair(const filePairStruct *item);               // add an item to the buffer
+void closeDirectory(dirHandle *dir);                            // save the manifest of a finished directory
+void flushBatch(dirHandle *dir);                                // queue the small files of a scanned directory still waiting
+void copyFileBatch(filePairStruct *batchItem);                  // copy the small files of a batch
+void createPendingLinks(void);                                  // create the hard links once every file is copied
+void noteFailed(filePairStruct *item);                          // count a file that was not copied completely
+int makeSymlink(int destFD, const char *name, const char *target); // recreate a symbolic link in the destination
+void journalPath(filePairStruct *item, char *path);              // destination path of an item relative to the root
+long long parseSize(const char *text);                          // parse a byte count with an optional K, M or G suffix
+double monotonicSeconds(void);                                  // current monotonic time in seconds
 void SIGINTHandler(int signo);                                  // signal handler
+void *interrupter(void *arg);                                   // stop the copy after a SIGINT, outside signal context
 
 int main(int argc, char *argv[])
 {
+    pthread_t interrupterThread;
+    if (pipe(interruptPipe) == -1 || pthread_create(&interrupterThread, NULL, interrupter, NULL) != 0)
+    {
+        perror("Failed to start the interrupter");
+        return 1;
+    }
+    pthread_detach(interrupterThread);
+
     struct sigaction act;
     act.sa_handler = SIGINTHandler;
     act.sa_flags = 0;
@@ -54,15 +178,91 @@ int main(int argc, char *argv[])
         return 1;
     }
 
-    if (argc != 5) // Check if the number of arguments is correct
+    static struct option longOptions[] = {
+        {"chunk-size", required_argument, NULL, 'c'}, // range size for large files, 0 disables splitting
+        {"walkers", required_argument, NULL, 'w'},    // threads scanning the source tree
+        {"engine", required_argument, NULL, 'e'},     // sync or uring
+        {"queue-depth", required_argument, NULL, 'q'}, // read/write pairs in flight per worker with io_uring
+        {"io-size", required_argument, NULL, 'b'},    // bytes per read/write pair with io_uring
+        {"sync", no_argument, NULL, 's'},             // skip unchanged files, rewrite only changed blocks
+        {"dedup", required_argument, NULL, 'd'},      // clone, link or skip files with the same content
+        {"resume", no_argument, NULL, 'r'},           // continue an interrupted copy from its journal
+        {"progress", required_argument, NULL, 'p'},   // report progress every so many seconds
+        {"json", no_argument, NULL, 'j'},             // progress reports as JSON lines
+        {"batch", required_argument, NULL, 'B'},      // pack up to this many small files into one queue item
+        {"batch-bytes", required_argument, NULL, 'L'}, // bytes per batch at most
+        {"schedule", required_argument, NULL, 'S'},   // lifo or lpt order of the buffer
+        {NULL, 0, NULL, 0}};
+    int opt, badOption = 0;
+    while ((opt = getopt_long(argc, argv, "c:w:e:q:b:sd:rp:jB:L:S:", longOptions, NULL)) != -1)
+    {
+        switch (opt)
+        {
+        case 'c':
+            chunkSize = parseSize(optarg);
+            badOption |= chunkSize < 0;
+            break;
+        case 'w':
+            numWalkers = atoi(optarg);
+            badOption |= numWalkers <= 0;
+            break;
+        case 'e':
+            useUring = strcmp(optarg, "uring") == 0;
+            badOption |= !useUring && strcmp(optarg, "sync") != 0;
+            break;
+        case 'q':
+            queueDepth = atoi(optarg);
+            badOption |= queueDepth <= 0 || queueDepth > 4096;
+            break;
+        case 'b':
+            ioSize = parseSize(optarg);
+            badOption |= ioSize <= 0 || ioSize > (1LL << 30);
+            break;
+        case 's':
+            syncMode = 1;
+            break;
+        case 'r':
+            resumeMode = 1;
+            break;
+        case 'p':
+            progressInterval = atof(optarg);
+            badOption |= progressInterval <= 0;
+            break;
+        case 'j':
+            progressJson = 1;
+            break;
+        case 'B':
+            batchCount = atoi(optarg);
+            badOption |= batchCount < 0;
+            break;
+        case 'L':
+            batchBytes = parseSize(optarg);
+            badOption |= batchBytes <= 0;
+            break;
+        case 'S':
+            scheduleLpt = strcmp(optarg, "lpt") == 0;
+            badOption |= !scheduleLpt && strcmp(optarg, "lifo") != 0;
+            break;
+        case 'd':
+            dedupMode = strcmp(optarg, "clone") == 0 ? DEDUP_CLONE : strcmp(optarg, "link") == 0 ? DEDUP_LINK : strcmp(optarg, "skip") == 0 ? DEDUP_SKIP : DEDUP_NONE;
+            badOption |= dedupMode == DEDUP_NONE;
+            break;
+        default:
+            badOption = 1;
+            break;
+        }
+    }
+
+    if (badOption || argc - optind != 4) // Check if the number of arguments is correct
     {
-        fprintf(stderr, "Usage: %s <buffer_size> <num_workers> <srcDir> <destDir>\n", argv[0]);
+        fprintf(stderr, "Usage: %s [--chunk-size <bytes>[K|M|G]] [--walkers <n>] [--engine sync|uring] [--queue-depth <n>] [--io-size <bytes>[K|M]] [--sync] [--dedup clone|link|skip] [--resume] [--progress <seconds>] [--json] [--batch <files>] [--batch-bytes <bytes>[K|M]] [--schedule lifo|lpt] <buffer_size> <num_workers> <srcDir> <destDir>\n", argv[0]);
         exit(EXIT_FAILURE);
     }
+    argv += optind - 1; // the positional arguments keep their argv[1..4] positions
 
     bufferSize = atoi(argv[1]);
-    int numberOfWorkers = atoi(argv[2]);
-    char *srcDir = argv[3];
+    numWorkers = atoi(argv[2]);
+    int numberOfWorkers = numWorkers;
     char *destDir = argv[4];
 
     if (bufferSize <= 0 || numberOfWorkers <= 0) // Check if the buffer size and number of workers are valid
@@ -71,6 +271,13 @@ int main(int argc, char *argv[])
         exit(EXIT_FAILURE);
     }
 
+    buffer = (filePairStruct *)malloc(sizeof(filePairStruct) * bufferSize); // items are a small header, so any buffer size fits
+    if (buffer == NULL)
+    {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+
     if (pthread_barrier_init(&barrier, NULL, numberOfWorkers + 1) != 0)
     {
         perror("pthread_barrier_init");
@@ -101,262 +308,1543 @@ int main(int argc, char *argv[])
         exit(EXIT_FAILURE);
     }
 
+    int rootFD = open(destDir, O_RDONLY | O_DIRECTORY);
+    if (rootFD < 0)
+    {
+        perror("open destDir");
+        exit(EXIT_FAILURE);
+    }
+    journalOpen(rootFD, resumeMode); // checkpoints of this run, after those of the interrupted one when resuming
+    close(rootFD);
+    destRootLength = strlen(destDir);
+
     pthread_t managerThread;                  // manager thread
     pthread_t workerThreads[numberOfWorkers]; // worker threads
 
     struct timeval start, end;                                   // start and end time
     gettimeofday(&start, NULL);                                  // get the start time
+    workerFinish = calloc(numberOfWorkers, sizeof(double));
+    if (workerFinish == NULL)
+    {
+        perror("calloc");
+        exit(EXIT_FAILURE);
+    }
+    runStart = monotonicSeconds();
+    for (int i = 0; i < numberOfWorkers; i++)
+    {
+        workerFinish[i] = runStart; // a worker that never gets an item finished at the start
+    }
+    progressInit(numberOfWorkers, numWalkers + 2);               // counter blocks for the workers, the walkers and this thread
+    if (progressInterval > 0)
+    {
+        progressStart(progressInterval, progressJson, argv[3]);
+    }
     pthread_create(&managerThread, NULL, manager, (void *)argv); // create the manager thread
 
     for (int i = 0; i < numberOfWorkers; i++) // create the worker threads
     {
-        pthread_create(&workerThreads[i], NULL, worker, NULL);
+        pthread_create(&workerThreads[i], NULL, worker, (void *)(long)i);
     }
 
     pthread_join(managerThread, NULL); // wait for the manager thread to finish
+    createPendingLinks();              // every first copy exists now
 
     for (int i = 0; i < numberOfWorkers; i++) // wait for the worker threads to finish
     {
         pthread_join(workerThreads[i], NULL);
     }
+    journalClose(numFailed == 0); // a finished copy leaves nothing to resume, failed files are retried by --resume
+    progressStop();
 
     gettimeofday(&end, NULL);                 // get the end time
-    long seconds = end.tv_sec - start.tv_sec; // calculate the total time
-    long miliseconds = (end.tv_usec - start.tv_usec) / 1000;
-    long minutes = seconds / 60;
-    seconds = seconds % 60;
+    long elapsed = (end.tv_sec - start.tv_sec) * 1000 + (end.tv_usec - start.tv_usec) / 1000; // calculate the total time in miliseconds
+    long miliseconds = elapsed % 1000;
+    long seconds = elapsed / 1000 % 60;
+    long minutes = elapsed / 60000;
 
     //  Print the statistics
+    walkStats walk = walkGetStats();
+    journalStats journal = journalGetStats();
+    progressCounters totals = progressTotals(); // counted per thread, summed once here
+    double firstFinish = workerFinish[0], lastFinish = workerFinish[0];
+    for (int i = 1; i < numberOfWorkers; i++)
+    {
+        firstFinish = workerFinish[i] < firstFinish ? workerFinish[i] : firstFinish;
+        lastFinish = workerFinish[i] > lastFinish ? workerFinish[i] : lastFinish;
+    }
     char *stdoutBuffer = (char *)malloc(4096);
-    sprintf(stdoutBuffer, "All files copied successfully.\n\n---------------STATISTICS--------------------\nConsumers: %d - Buffer Size: %d\nNumber of Regular File: %d\nNumber of FIFO File: %d\nNumber of Directory: %d\nTOTAL BYTES COPIED: %ld\nTOTAL TIME: %02ld:%02ld.%03ld (min:sec.mili)\n", numberOfWorkers, bufferSize, numRegular, numFifo, numDir, totalBytes, minutes, seconds, miliseconds);
+    char headline[64];
+    if (numFailed > 0)
+    {
+        snprintf(headline, sizeof(headline), "Copy finished, %d files failed.", numFailed);
+    }
+    else
+    {
+        snprintf(headline, sizeof(headline), "All files copied successfully.");
+    }
+    sprintf(stdoutBuffer, "%s\n\n---------------STATISTICS--------------------\nConsumers: %d - Buffer Size: %d\nWalkers: %d - Directories Scanned: %lld - Entries: %lld - Steals: %lld - stat Calls: %lld\nNumber of Regular File: %lld\nNumber of FIFO File: %lld\nNumber of Directory: %lld\nFiles Split Into Ranges: %d (%lld byte ranges)\nQueue Item: %zu bytes - Names: %lld in %lld arena bytes (%.1f bytes per file) - Batches: %d (%d small files)\nSync: Unchanged Files: %d (%d by manifest) - Updated In Place: %d (%lld bytes rewritten) - Bytes Skipped: %lld\nHard Links: %d (%lld bytes not copied) - Symbolic Links: %d\nDuplicates: %d (%lld bytes saved) - Hashed: %lld bytes (%s)\nSparse Files: %d - Holes Skipped: %lld bytes - Allocated: %lld bytes in source, %lld bytes in destination\nResume: Files Already Done: %d - Bytes Not Copied Again: %lld - Journal: %lld records in %lld flushes (%lld loaded) - Failed Files: %d\nSchedule: %s - Makespan: %.3f s - Workers Finished Within: %.3f s\nTOTAL BYTES COPIED: %lld\nTOTAL TIME: %02ld:%02ld.%03ld (min:sec.mili)\n", headline, numberOfWorkers, bufferSize, numWalkers, walk.directories, walk.entries, walk.steals, walk.statCalls, totals.regular, totals.fifo, totals.dirs, numChunked, chunkSize, sizeof(filePairStruct), walk.names, walk.arenaBytes, walk.names > 0 ? (double)walk.arenaBytes / walk.names : 0.0, numBatches, numBatched, numSkipped, numManifestHits, numDelta, deltaRewritten, skippedBytes, numHardLinks, linkedBytes, numSymlinks, numDuplicates, dedupSaved, hashedBytes, contentHashBackend(), numSparse, copyHoleBytes(), totals.srcAllocated, totals.destAllocated, numResumed, resumedBytes, journal.records, journal.flushes, journal.loaded, numFailed, scheduleLpt ? "lpt" : "lifo", lastFinish - runStart, lastFinish - firstFinish, totals.bytes, minutes, seconds, miliseconds);
+    write(STDOUT_FILENO, stdoutBuffer, strlen(stdoutBuffer));
+    copyStatsReport(stdoutBuffer, 4096); // bytes and throughput of each copy path
     write(STDOUT_FILENO, stdoutBuffer, strlen(stdoutBuffer));
     free(stdoutBuffer);
+    free(buffer);
+    free(workerFinish);
     pthread_barrier_destroy(&barrier);
     return 0;
 }
 
-//  Process the directory
-void processDirectory(const char *srcDir, const char *destDir)
+//  Queue the batch the calling walker has been filling
+void flushBatch(dirHandle *dir)
 {
-    DIR *src_dp = opendir(srcDir); // open the source directory
-    if (src_dp == NULL)            // check if the directory is opened successfully
+    fileBatch *batch = openBatch;
+    if (batch == NULL)
     {
-        perror("opendir");
         return;
     }
+    openBatch = NULL;
+
+    filePairStruct item = {.dir = dir, .batch = batch, .length = batch->bytes, .isBatch = 1}; // a walker scans one directory at a time, the batch is from it
+    pthread_mutex_lock(&mutex);
+    numBatches++;
+    numBatched += batch->count;
+    pthread_mutex_unlock(&mutex);
+    enqueueFilePair(&item);
+}
+
+//  Add a regular file to the walker's batch when it is small, returns 1 if it was added.
+//  The batch holds one reference to the directory for all of its files and is queued
+//  once it reaches the count or the byte threshold, or when the directory is scanned.
+int batchSmallFile(dirHandle *dir, const char *name, long long size)
+{
+    long long limit = chunkSize > 0 && chunkSize < batchBytes ? chunkSize : batchBytes; // a batched file is never split
+    if (size > limit)
+    {
+        return 0; // queued alone
+    }
 
-    struct dirent *entry;                     // directory entry
-    while ((entry = readdir(src_dp)) != NULL) // read the directory
+    if (openBatch != NULL && openBatch->bytes + size > batchBytes)
+    {
+        flushBatch(dir);
+    }
+    if (openBatch == NULL)
     {
-        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) // skip the current and parent directory
+        openBatch = malloc(sizeof(fileBatch) + sizeof(const char *) * batchCount);
+        if (openBatch == NULL)
         {
-            continue;
+            perror("malloc");
+            exit(EXIT_FAILURE);
         }
+        dirHandleRetain(dir); // one reference for every file of the batch
+        openBatch->count = 0;
+        openBatch->bytes = 0;
+    }
+    openBatch->names[openBatch->count++] = dirHandleIntern(dir, name);
+    openBatch->bytes += size;
+    if (openBatch->count == batchCount)
+    {
+        flushBatch(dir);
+    }
+    return 1;
+}
 
-        char src_path[PATH_MAX], dest_path[PATH_MAX];                   // source and destination path
-        snprintf(src_path, PATH_MAX, "%s/%s", srcDir, entry->d_name);   // create the source path
-        snprintf(dest_path, PATH_MAX, "%s/%s", destDir, entry->d_name); // create the destination path
+//  Process one entry found by the walkers, returns 1 for a directory to descend into.
+//  Files are only queued here; the worker that takes one opens it.
+int processEntry(dirHandle *dir, const char *name, unsigned char type)
+{
+    filePairStruct item;                           // several walkers enqueue at once, so each builds its own item
+    item.name = NULL;                              // set below, directories need no copy of their name
+    item.isFifo = 0;                               // set the flag to indicate that the file is not a FIFO file
+    item.isDir = 0;                                // set the flag to indicate that the file is not a directory
+    item.job = NULL;
+    item.offset = 0;
+    item.length = 0;
+    item.delta = 0;
+    item.sparse = 0;
+    item.isBatch = 0;
 
-        struct stat statbuf;              // file status
-        if (stat(src_path, &statbuf) < 0) // get the file status
+    if (strcmp(name, JOURNAL_NAME) == 0) // a copy of some other run's journal
+    {
+        return 0;
+    }
+    if (syncMode)
+    {
+        if (strcmp(name, MANIFEST_NAME) == 0) // a copy of some other run's manifest
         {
-            perror("stat"); // check if the file status is retrieved successfully
-            continue;       // continue to the next file
+            return 0;
         }
-
-        if (S_ISREG(statbuf.st_mode)) // check if the file is a regular file
+        if (dir->userData == NULL) // only this walker scans the directory, so no one else loads it
         {
-            int src_fd = open(src_path, O_RDONLY); // open the source file
-            if (src_fd < 0)                        // check if the file is opened successfully
-            {
-                perror("open src"); // print the error message
-                continue;           // continue to the next file
-            }
-
-            int dest_fd = open(dest_path, O_WRONLY | O_CREAT | O_TRUNC, 0644); // open the destination file to write the content of the source file to it
-            if (dest_fd < 0)                                                   // check if the file is opened successfully
-            {
-                close(src_fd);
-                perror("open dest");
-                continue;
-            }
+            dir->userData = manifestLoad(dir->destFD);
+        }
+    }
 
-            pthread_mutex_lock(&mutex);       // lock the mutex
-            while (bufferCount == bufferSize) // check if the buffer is full
+    if (type == DT_REG) // check if the file is a regular file
+    {
+        struct stat statbuf; // only batching and largest-first scheduling need the size this early
+        if ((batchCount > 1 || scheduleLpt) && fstatat(dir->srcFD, name, &statbuf, AT_SYMLINK_NOFOLLOW) == 0 && S_ISREG(statbuf.st_mode))
+        {
+            if (batchCount > 1 && batchSmallFile(dir, name, statbuf.st_size))
             {
-                pthread_cond_wait(&bufferNotFull, &mutex); // wait for the buffer to be not full
+                return 0;
             }
-
-            buffer[bufferCount].srcFD = src_fd;                         // set the source file descriptor
-            buffer[bufferCount].destFD = dest_fd;                       // set the destination file descriptor
-            strncpy(buffer[bufferCount].srcName, src_path, PATH_MAX);   // set the source path
-            strncpy(buffer[bufferCount].destName, dest_path, PATH_MAX); // set the destination path
-            buffer[bufferCount].isFifo = 0;                             // set the flag to indicate that the file is not a FIFO file
-            buffer[bufferCount].isDir = 0;                              // set the flag to indicate that the file is not a directory
-            bufferCount++;                                              // increment the number of items in the buffer
-
-            pthread_cond_signal(&bufferNotEmpty); // signal that the buffer is not empty
-            pthread_mutex_unlock(&mutex);         // unlock the mutex
+            item.length = statbuf.st_size;
         }
-        else if (S_ISFIFO(statbuf.st_mode)) // check if the file is a FIFO file
+        item.dir = dirHandleRetain(dir); // keeps the directory open until the file is copied
+        item.name = dirHandleIntern(dir, name);
+        enqueueFilePair(&item);
+    }
+    else if (type == DT_FIFO) // check if the file is a FIFO file
+    {
+        if (mkfifoat(dir->destFD, name, 0644) < 0)
         {
-            if (mkfifo(dest_path, 0644) < 0)
+            if (!((syncMode || resumeMode) && errno == EEXIST)) // an earlier run made it
             {
                 perror("mkfifo");
-                continue;
-            }
-
-            pthread_mutex_lock(&mutex);
-            while (bufferCount == bufferSize)
-            {
-                pthread_cond_wait(&bufferNotFull, &mutex);
             }
+            return 0;
+        }
 
-            strncpy(buffer[bufferCount].srcName, src_path, PATH_MAX);
-            strncpy(buffer[bufferCount].destName, dest_path, PATH_MAX);
-            buffer[bufferCount].isFifo = 1;
-            buffer[bufferCount].isDir = 0;
-            bufferCount++;
-
-            pthread_cond_signal(&bufferNotEmpty);
-            pthread_mutex_unlock(&mutex);
+        item.dir = dirHandleRetain(dir);
+        item.name = dirHandleIntern(dir, name);
+        item.isFifo = 1;
+        enqueueFilePair(&item);
+    }
+    else if (type == DT_LNK) // symbolic links are recreated, not followed
+    {
+        char target[PATH_MAX];
+        ssize_t length = readlinkat(dir->srcFD, name, target, sizeof(target) - 1);
+        if (length < 0)
+        {
+            perror("readlink");
+            return 0;
         }
-        else if (S_ISDIR(statbuf.st_mode)) // check if the file is a directory
+        target[length] = '\0';
+        if (makeSymlink(dir->destFD, name, target) < 0)
         {
-            if (mkdir(dest_path, 0755) < 0)
-            {
-                perror("mkdir");
-                continue;
-            }
+            perror("symlink");
+            return 0;
+        }
 
-            pthread_mutex_lock(&mutex);
-            numDir++;
-            pthread_mutex_unlock(&mutex);
+        pthread_mutex_lock(&mutex);
+        numSymlinks++;
+        pthread_mutex_unlock(&mutex);
 
-            processDirectory(src_path, dest_path); // process the directory recursively
-        }
+        char *stdoutBuffer = (char *)malloc(4096);
+        snprintf(stdoutBuffer, 4096, "Copied: %s/%s -> %s/%s (symlink)\n", dir->srcPath, name, dir->destPath, name);
+        write(STDOUT_FILENO, stdoutBuffer, strlen(stdoutBuffer));
+        free(stdoutBuffer);
     }
+    else if (type == DT_DIR) // check if the file is a directory
+    {
+        if (mkdirat(dir->destFD, name, 0755) < 0 && !((syncMode || resumeMode) && errno == EEXIST)) // sync and resumed runs descend into existing directories
+        {
+            perror("mkdir");
+            return 0;
+        }
 
-    closedir(src_dp); // close the source directory
+        progressAdd(&progressSelf()->dirs, 1);
+
+        return 1; // the walkers process the directory
+    }
+    return 0;
 }
 
-//  Purpose of the manager thread is to process the source directory
-void *manager(void *arg)
+//  Split an open file into ranges: the item becomes the first range and the rest are queued
+void splitFile(filePairStruct *item, int src_fd, int dest_fd, long long size)
 {
-    char **argv = (char **)arg;
-    char *srcDir = argv[3];
-    char *destDir = argv[4];
+    // Reserve the whole destination up front so ranges written out of order need no
+    // block allocation of their own; filesystems without fallocate just get the size.
+    // A sparse source only gets the size, reserving it would fill in every hole.
+    if ((item->sparse || fallocate(dest_fd, 0, 0, size) < 0) && ftruncate(dest_fd, size) < 0)
+    {
+        perror("fallocate");
+    }
 
-    processDirectory(srcDir, destDir);
+    fileJob *job = calloc(1, sizeof(fileJob));
+    if (job == NULL)
+    {
+        perror("calloc");
+        exit(EXIT_FAILURE);
+    }
+    job->srcFD = src_fd;
+    job->destFD = dest_fd;
+    item->job = job;
+    item->offset = 0;
+    item->length = 0; // stays empty when a resumed run finds every range done, the file is just finished
 
+    char path[PATH_MAX];
+    if (resumeMode)
+    {
+        journalPath(item, path);
+    }
     pthread_mutex_lock(&mutex);
-    done = 1;
-    pthread_cond_broadcast(&bufferNotEmpty);
+    for (long long offset = 0; offset < size; offset += chunkSize) // the item takes the first range left, the others get a node
+    {
+        long long length = size - offset < chunkSize ? size - offset : chunkSize;
+        if (resumeMode && journalRangeDone(path, offset, length)) // the interrupted run copied it
+        {
+            resumedBytes += length;
+            progressAdd(&progressSelf()->settled, length);
+            continue;
+        }
+        if (job->remaining++ == 0)
+        {
+            item->offset = offset;
+            item->length = length;
+            continue;
+        }
+        rangeNode *node = malloc(sizeof(rangeNode));
+        if (node == NULL)
+        {
+            perror("malloc");
+            exit(EXIT_FAILURE);
+        }
+        node->item = *item;
+        node->item.offset = offset;
+        node->item.length = length;
+        node->next = rangeList;
+        rangeList = node;
+    }
+    if (job->remaining == 0)
+    {
+        job->remaining = 1; // the empty item
+    }
+    pthread_cond_broadcast(&bufferNotEmpty); // idle workers can help with the ranges
     pthread_mutex_unlock(&mutex);
-
-    // Wait for all worker threads to reach this point
-    pthread_barrier_wait(&barrier);
-
-    return NULL;
 }
 
-//  Purpose of the worker thread is to copy the files from the buffer
-void *worker(void *arg)
+//  Create a symbolic link, replacing whatever an earlier run left under its name; -1 on error
+int makeSymlink(int destFD, const char *name, const char *target)
 {
-    (void)arg;
-    while (1)
+    if (symlinkat(target, destFD, name) == 0)
     {
-        pthread_mutex_lock(&mutex);       // lock the mutex
-        while (bufferCount == 0 && !done) // check if the buffer is empty
-        {
-            pthread_cond_wait(&bufferNotEmpty, &mutex); // wait for the buffer to be not empty
-        }
-
-        if (bufferCount == 0 && done) // check if the buffer is empty and all files are processed
+        return 0;
+    }
+    if (errno != EEXIST)
+    {
+        return -1;
+    }
+    char existing[PATH_MAX];
+    ssize_t length = readlinkat(destFD, name, existing, sizeof(existing) - 1);
+    if (length >= 0)
+    {
+        existing[length] = '\0';
+        if (strcmp(existing, target) == 0) // already right
         {
-            pthread_mutex_unlock(&mutex); // unlock the mutex
-            break;
+            return 0;
         }
+    }
+    if (unlinkat(destFD, name, 0) < 0)
+    {
+        return -1;
+    }
+    return symlinkat(target, destFD, name);
+}
 
-        filePairStruct filePair = buffer[--bufferCount]; // get the file pair from the buffer
-        pthread_cond_signal(&bufferNotFull);             // signal that the buffer is not full
-        pthread_mutex_unlock(&mutex);                    // unlock the mutex
-
-        if (!filePair.isFifo && !filePair.isDir) // check if the file is a regular file
-        {
-            char buffer[4096];
-            ssize_t bytes;
-            while ((bytes = read(filePair.srcFD, buffer, sizeof(buffer))) > 0) // read the content of the source file
-            {
-                if (write(filePair.destFD, buffer, bytes) != bytes) // write the content of the source file to the destination file
-                {
-                    perror("write");
-                    break;
-                }
-                pthread_mutex_lock(&mutex);
-                totalBytes += bytes;
-                pthread_mutex_unlock(&mutex);
-            }
+//  Full path of an entry in a directory
+char *joinPath(const char *dirPath, const char *name)
+{
+    char *path = malloc(strlen(dirPath) + strlen(name) + 2);
+    if (path == NULL)
+    {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+    sprintf(path, "%s/%s", dirPath, name);
+    return path;
+}
 
-            pthread_mutex_lock(&mutex); // lock the mutex
-            numRegular++;
-            pthread_mutex_unlock(&mutex); // unlock the mutex
+//  Full destination path of an item
+char *destPathOf(filePairStruct *item)
+{
+    return joinPath(item->dir->destPath, item->name);
+}
 
-            if (close(filePair.srcFD) < 0) // close the source file
-            {
-                perror("close src");
-            }
+//  Queue a hard link or clone for after the copy; the caller holds the mutex
+void queueLink(const char *target, char *linkPath, filePairStruct *item, long long size, int kind)
+{
+    pendingLink *link = malloc(sizeof(pendingLink));
+    if (link == NULL)
+    {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+    link->target = target;
+    link->linkPath = linkPath;
+    link->source = joinPath(item->dir->srcPath, item->name);
+    link->size = size;
+    link->kind = kind;
+    link->next = pendingLinks;
+    pendingLinks = link;
+}
 
-            if (close(filePair.destFD) < 0) // close the destination file
-            {
-                perror("close dest");
-            }
-        }
-        else if (filePair.isFifo) // check if the file is a FIFO file
+//  Count a file that was not copied completely and remember its destination, so the names
+//  queued to link to it are copied from their own source instead
+void noteFailed(filePairStruct *item)
+{
+    char *path = destPathOf(item);
+    pthread_mutex_lock(&mutex);
+    numFailed++;
+    if (failedCount == failedCapacity)
+    {
+        failedCapacity = failedCapacity ? failedCapacity * 2 : 64;
+        char **grown = realloc(failedPaths, failedCapacity * sizeof(char *));
+        if (grown == NULL)
         {
-            pthread_mutex_lock(&mutex);
-            numFifo++;
-            pthread_mutex_unlock(&mutex);
+            perror("realloc");
+            exit(EXIT_FAILURE);
         }
-
-        char *stdoutBuffer = (char *)malloc(4096);
-        sprintf(stdoutBuffer, "Copied: %s -> %s\n", filePair.srcName, filePair.destName);
-        write(STDOUT_FILENO, stdoutBuffer, strlen(stdoutBuffer));
-        free(stdoutBuffer);
+        failedPaths = grown;
     }
-    pthread_barrier_wait(&barrier); // Wait for all worker threads to reach this point
-    return NULL;
+    failedPaths[failedCount++] = path;
+    pthread_mutex_unlock(&mutex);
 }
 
-//  Signal handler for SIGINT
-void SIGINTHandler(int signo)
+//  Claim the inode of a file with several links. The first claim copies the data; later
+//  ones are queued as hard links to it, returns 1 for those.
+int deferHardLink(filePairStruct *item, const struct stat *srcStat)
 {
-    if (signo == SIGINT)
+    char *linkPath = destPathOf(item);
+    const char *target = linkMapClaim(srcStat->st_dev, srcStat->st_ino, linkPath);
+    if (target == NULL)
     {
+        free(linkPath); // the map keeps its own copy
+        return 0;
+    }
 
-        char *stdoutBuffer = (char *)malloc(4096);
-        sprintf(stdoutBuffer, "SIGINT received. Exiting...\n");
-        write(STDOUT_FILENO, stdoutBuffer, strlen(stdoutBuffer));
-        free(stdoutBuffer);
-
-        pthread_mutex_lock(&mutex);
-        done = 1;
-        pthread_cond_broadcast(&bufferNotEmpty);
-        pthread_mutex_unlock(&mutex);
+    pthread_mutex_lock(&mutex);
+    queueLink(target, linkPath, item, srcStat->st_size, LINK_HARD);
+    numHardLinks++;
+    linkedBytes += srcStat->st_size;
+    pthread_mutex_unlock(&mutex);
+    progressAdd(&progressSelf()->settled, srcStat->st_size);
+    return 1;
+}
 
-        pthread_mutex_lock(&mutex);
-        for (int i = 0; i < bufferCount; i++)
+//  Compare an open file with the file at path byte for byte, 1 when both hold the same size bytes
+int sameContent(int fd, const char *path, long long size)
+{
+    int otherFD = open(path, O_RDONLY);
+    if (otherFD < 0)
+    {
+        return 0;
+    }
+    char mine[65536], theirs[65536];
+    long long offset = 0;
+    while (offset < size)
+    {
+        size_t length = size - offset < (long long)sizeof(mine) ? (size_t)(size - offset) : sizeof(mine);
+        ssize_t got = pread(fd, mine, length, offset);
+        if (got <= 0 || pread(otherFD, theirs, got, offset) != got || memcmp(mine, theirs, got) != 0)
         {
-            if (!buffer[i].isFifo && !buffer[i].isDir)
-            {
-                close(buffer[i].srcFD);
-                close(buffer[i].destFD);
-            }
+            break;
         }
-        pthread_mutex_unlock(&mutex);
+        offset += got;
+    }
+    close(otherFD);
+    return offset == size;
+}
+
+//  Hash an open source file and claim its content. The first file with a content copies
+//  it; for later ones returns ITEM_LINKED when a link or clone is queued, or ITEM_SKIPPED
+//  when duplicates are left out, and ITEM_DONE when the file must be copied. A digest
+//  only finds candidates, a duplicate is compared with the first file's source first.
+int deduplicate(filePairStruct *item, int src_fd)
+{
+    contentDigest digest;
+    long long size;
+    if (contentHashFile(src_fd, &digest, &size) < 0)
+    {
+        perror("hash");
+        return ITEM_DONE;
+    }
+    pthread_mutex_lock(&mutex);
+    hashedBytes += size;
+    pthread_mutex_unlock(&mutex);
+    if (size == 0) // nothing to save
+    {
+        return ITEM_DONE;
+    }
 
-        pthread_barrier_destroy(&barrier);
+    char *linkPath = destPathOf(item);
+    char *source = joinPath(item->dir->srcPath, item->name);
+    const char *firstSource = NULL;
+    const char *target = contentMapClaim(&digest, size, linkPath, source, &firstSource);
+    int same = target != NULL && sameContent(src_fd, firstSource, size);
+    free(source);
+    if (!same) // the first of its content, or a different file with the same digest
+    {
+        free(linkPath);
+        return ITEM_DONE;
+    }
 
-        exit(EXIT_FAILURE);
+    pthread_mutex_lock(&mutex);
+    numDuplicates++;
+    if (dedupMode != DEDUP_CLONE) // a clone counts as saved only if the filesystem shares the extents
+    {
+        dedupSaved += size;
+    }
+    // A skipped duplicate is queued too, so it is copied after all if the first copy fails
+    queueLink(target, linkPath, item, size, dedupMode == DEDUP_CLONE ? LINK_CLONE : dedupMode == DEDUP_LINK ? LINK_DEDUP : LINK_SKIP);
+    pthread_mutex_unlock(&mutex);
+    progressAdd(&progressSelf()->settled, dedupMode != DEDUP_CLONE ? size : 0); // a clone is counted when it is made
+    return dedupMode == DEDUP_SKIP ? ITEM_SKIPPED : ITEM_LINKED;
+}
+
+//  Copy a file for a queued link, from its first copy or from its own source; returns the
+//  bytes of data copied, holes left out, or -1 on error
+long long copyPendingFile(const char *from, const char *to, copyPath *path)
+{
+    int src_fd = open(from, O_RDONLY | O_NOFOLLOW);
+    if (src_fd < 0)
+    {
+        return -1;
+    }
+    int dest_fd = open(to, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (dest_fd < 0)
+    {
+        close(src_fd);
+        return -1;
     }
+    struct timeval copyStart, copyEnd;
+    gettimeofday(&copyStart, NULL);
+    long long data;
+    long long bytes = copyFileData(src_fd, dest_fd, path, &data); // tries FICLONE first
+    gettimeofday(&copyEnd, NULL);
+    close(src_fd);
+    close(dest_fd);
+    if (bytes < 0)
+    {
+        return -1;
+    }
+    copyStatsRecord(*path, 1, data, (copyEnd.tv_sec - copyStart.tv_sec) + (copyEnd.tv_usec - copyStart.tv_usec) / 1e6);
+    progressAdd(&progressSelf()->regular, 1);
+    return data;
+}
+
+//  Clone a queued duplicate from its first copy, falling back to copying it; -1 on error
+int clonePendingLink(pendingLink *link, copyPath *path)
+{
+    long long bytes = copyPendingFile(link->target, link->linkPath, path);
+    if (bytes < 0)
+    {
+        return -1;
+    }
+    if (*path == COPY_CLONE)
+    {
+        pthread_mutex_lock(&mutex);
+        dedupSaved += bytes;
+        pthread_mutex_unlock(&mutex);
+        progressAdd(&progressSelf()->settled, bytes);
+    }
+    else
+    {
+        progressAdd(&progressSelf()->bytes, bytes);
+    }
+    return 0;
+}
+
+//  Hard link a queued name to its first copy, replacing a name an earlier run left behind
+//  unless it already is the same file; -1 on error
+int linkPendingLink(pendingLink *link)
+{
+    int result = linkat(AT_FDCWD, link->target, AT_FDCWD, link->linkPath, 0);
+    if (result < 0 && errno == EEXIST)
+    {
+        struct stat targetStat, linkStat;
+        if (stat(link->target, &targetStat) == 0 && lstat(link->linkPath, &linkStat) == 0 &&
+            targetStat.st_dev == linkStat.st_dev && targetStat.st_ino == linkStat.st_ino)
+        {
+            result = 0;
+        }
+        else if (unlink(link->linkPath) == 0)
+        {
+            result = linkat(AT_FDCWD, link->target, AT_FDCWD, link->linkPath, 0);
+        }
+    }
+    return result;
+}
+
+//  Take a queued name that did not become a link, clone or skipped duplicate out of the totals
+void dropLinkStats(pendingLink *link)
+{
+    pthread_mutex_lock(&mutex);
+    if (link->kind == LINK_HARD)
+    {
+        numHardLinks--;
+        linkedBytes -= link->size;
+    }
+    else
+    {
+        numDuplicates--;
+        dedupSaved -= link->kind == LINK_CLONE ? 0 : link->size; // a clone is only counted once made
+    }
+    pthread_mutex_unlock(&mutex);
+    progressAdd(&progressSelf()->settled, link->kind == LINK_CLONE ? 0 : -link->size);
+}
+
+//  Copy a queued name from its own source because its first copy failed. It is no longer
+//  a link, and becomes the target of the other names that were queued to the same copy.
+int copyPendingSource(pendingLink *link, pendingLink *rest)
+{
+    copyPath path;
+    long long bytes = copyPendingFile(link->source, link->linkPath, &path);
+    if (bytes < 0)
+    {
+        return -1;
+    }
+    progressAdd(&progressSelf()->bytes, bytes);
+
+    char *stdoutBuffer = (char *)malloc(4096);
+    snprintf(stdoutBuffer, 4096, "Copied: %s -> %s (%s, first copy failed)\n", link->source, link->linkPath, copyPathNames[path]);
+    write(STDOUT_FILENO, stdoutBuffer, strlen(stdoutBuffer));
+    free(stdoutBuffer);
+
+    for (pendingLink *other = rest; other != NULL; other = other->next)
+    {
+        if (other->target == link->target)
+        {
+            other->target = link->linkPath;
+        }
+    }
+    return 0;
+}
+
+//  Order failed destinations for bsearch
+int comparePaths(const void *a, const void *b)
+{
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+//  Check whether the first copy at a destination failed
+int copyFailed(const char *destPath)
+{
+    return failedCount > 0 && bsearch(&destPath, failedPaths, failedCount, sizeof(char *), comparePaths) != NULL;
+}
+
+//  Create the hard links and clones queued by the workers. This runs after the copy so the
+//  first copy of every inode or content is complete. A name whose first copy failed, a
+//  skipped duplicate included, is copied from its own source instead, and a name that
+//  links to another queued name is retried until that one exists. Every name that cannot
+//  be made counts as a failed file.
+void createPendingLinks(void)
+{
+    pendingLink *queued = NULL; // in the order the workers queued them
+    while (pendingLinks != NULL)
+    {
+        pendingLink *link = pendingLinks;
+        pendingLinks = link->next;
+        link->next = queued;
+        queued = link;
+    }
+    qsort(failedPaths, failedCount, sizeof(char *), comparePaths);
+
+    pendingLink *made = NULL; // kept until the end, later links may point at their paths
+    int progress = 1;
+    while (queued != NULL && progress)
+    {
+        pendingLink *retry = NULL, **retryTail = &retry;
+        progress = 0;
+        while (queued != NULL)
+        {
+            pendingLink *link = queued;
+            queued = link->next;
+            link->next = NULL;
+
+            int result;
+            copyPath path;
+            int recopy = copyFailed(link->target);
+            if (recopy)
+            {
+                result = copyPendingSource(link, queued);
+                for (pendingLink *other = retry; result == 0 && other != NULL; other = other->next)
+                {
+                    if (other->target == link->target)
+                    {
+                        other->target = link->linkPath;
+                    }
+                }
+            }
+            else if (link->kind == LINK_CLONE)
+            {
+                result = clonePendingLink(link, &path);
+            }
+            else if (link->kind == LINK_SKIP) // the first copy exists, nothing to make
+            {
+                result = 0;
+            }
+            else
+            {
+                result = linkPendingLink(link);
+            }
+
+            if (result < 0 && !recopy && errno == ENOENT) // the target may be a queued name made later in this pass
+            {
+                *retryTail = link;
+                retryTail = &link->next;
+                continue;
+            }
+            progress = 1;
+            if (result < 0 || recopy)
+            {
+                dropLinkStats(link);
+            }
+            if (result < 0)
+            {
+                perror(recopy ? "copy" : link->kind == LINK_CLONE ? "clone" : "link");
+                pthread_mutex_lock(&mutex);
+                numFailed++; // not journaled either, a resumed run makes the name again
+                pthread_mutex_unlock(&mutex);
+            }
+            else if (!recopy && link->kind != LINK_SKIP)
+            {
+                char *stdoutBuffer = (char *)malloc(4096);
+                if (link->kind == LINK_CLONE)
+                {
+                    snprintf(stdoutBuffer, 4096, "Copied: %s -> %s (%s)\n", link->target, link->linkPath, copyPathNames[path]);
+                }
+                else
+                {
+                    snprintf(stdoutBuffer, 4096, "Linked: %s -> %s\n", link->linkPath, link->target);
+                }
+                write(STDOUT_FILENO, stdoutBuffer, strlen(stdoutBuffer));
+                free(stdoutBuffer);
+            }
+            link->next = made;
+            made = link;
+        }
+        queued = retry;
+    }
+
+    while (queued != NULL) // no pass made any of these, their targets are missing
+    {
+        pendingLink *link = queued;
+        queued = link->next;
+        fprintf(stderr, "link: %s -> %s: No such file or directory\n", link->linkPath, link->target);
+        dropLinkStats(link);
+        pthread_mutex_lock(&mutex);
+        numFailed++;
+        pthread_mutex_unlock(&mutex);
+        link->next = made;
+        made = link;
+    }
+    while (made != NULL)
+    {
+        pendingLink *link = made;
+        made = link->next;
+        free(link->linkPath);
+        free(link->source);
+        free(link);
+    }
+    linkMapClear();
+}
+
+//  Path of an item's destination relative to the destination root, the key of its journal lines
+void journalPath(filePairStruct *item, char *path)
+{
+    snprintf(path, PATH_MAX, "%s/%s", item->dir->destPath + destRootLength, item->name);
+}
+
+//  Check whether a resumed run can leave a file out: the journal recorded it as finished
+//  at the source's size, and the destination still has that size. The source is assumed
+//  unchanged since the interrupted run, --sync is the mode that compares.
+int resumeDone(filePairStruct *item, const char *path, const struct stat *srcStat)
+{
+    struct stat destStat;
+    return journalFileDone(path, srcStat->st_size) && fstatat(item->dir->destFD, item->name, &destStat, AT_SYMLINK_NOFOLLOW) == 0 &&
+           S_ISREG(destStat.st_mode) && destStat.st_size == srcStat->st_size;
+}
+
+//  Check whether sync mode can skip a file: the destination is a regular file with the
+//  source's size and the modification time syncFinish gave it. A manifest hit only says the
+//  source is unchanged, the destination is still checked so a damaged copy is repaired.
+//  Sets *destHasData when a differing destination is worth comparing block by block.
+int syncUnchanged(filePairStruct *item, const struct stat *srcStat, int *destHasData)
+{
+    manifest *list = item->dir->userData;
+    *destHasData = 0;
+    struct stat destStat;
+    if (fstatat(item->dir->destFD, item->name, &destStat, AT_SYMLINK_NOFOLLOW) < 0 || !S_ISREG(destStat.st_mode))
+    {
+        return 0;
+    }
+    *destHasData = destStat.st_size > 0;
+    if (destStat.st_size != srcStat->st_size || destStat.st_mtim.tv_sec != srcStat->st_mtim.tv_sec ||
+        destStat.st_mtim.tv_nsec != srcStat->st_mtim.tv_nsec)
+    {
+        return 0;
+    }
+    if (list != NULL && manifestLookup(list, item->name, srcStat))
+    {
+        pthread_mutex_lock(&mutex);
+        numManifestHits++;
+        pthread_mutex_unlock(&mutex);
+    }
+    return 1;
+}
+
+//  In sync mode, give a finished destination the source's times and note it in the manifest,
+//  so the next run skips it
+void syncFinish(filePairStruct *item, int src_fd, int dest_fd)
+{
+    struct stat statbuf;
+    if (fstat(src_fd, &statbuf) < 0)
+    {
+        perror("fstat");
+        return;
+    }
+    struct timespec times[2] = {statbuf.st_atim, statbuf.st_mtim};
+    if (futimens(dest_fd, times) < 0)
+    {
+        perror("futimens");
+        return;
+    }
+    if (item->dir->userData != NULL)
+    {
+        manifestRecord(item->dir->userData, item->name, &statbuf);
+    }
+}
+
+//  Open a whole file and its destination, ITEM_DONE when both are open and the data should
+//  be copied. Otherwise the file failed to open, is unchanged in sync mode, or is another
+//  link to an inode copied elsewhere. A large file is split and comes back as its first
+//  range, with item->job set.
+int openWholeFile(filePairStruct *item, int *src_fd, int *dest_fd, long long *size)
+{
+    *src_fd = openat(item->dir->srcFD, item->name, O_RDONLY | O_NOFOLLOW); // open the source file
+    if (*src_fd < 0)                                                       // check if the file is opened successfully
+    {
+        perror("open src");
+        return ITEM_FAILED;
+    }
+
+    struct stat statbuf;              // file status, only needed for the size
+    if (fstat(*src_fd, &statbuf) < 0) // get the file status
+    {
+        perror("fstat");
+        close(*src_fd);
+        return ITEM_FAILED;
+    }
+
+    if (statbuf.st_nlink > 1 && deferHardLink(item, &statbuf)) // the data is copied once, under the first name claimed
+    {
+        close(*src_fd);
+        return ITEM_LINKED;
+    }
+
+    int flags = O_WRONLY | O_CREAT | O_TRUNC;
+    if (resumeMode)
+    {
+        char path[PATH_MAX];
+        journalPath(item, path);
+        if (resumeDone(item, path, &statbuf))
+        {
+            pthread_mutex_lock(&mutex);
+            numResumed++;
+            resumedBytes += statbuf.st_size;
+            pthread_mutex_unlock(&mutex);
+            progressAdd(&progressSelf()->settled, statbuf.st_size);
+            close(*src_fd);
+            return ITEM_SKIPPED;
+        }
+        if (chunkSize > 0 && statbuf.st_size > chunkSize && journalHasRanges(path)) // keep the ranges already copied
+        {
+            flags = O_WRONLY | O_CREAT;
+        }
+    }
+    if (syncMode)
+    {
+        int destHasData;
+        if (syncUnchanged(item, &statbuf, &destHasData))
+        {
+            if (item->dir->userData != NULL)
+            {
+                manifestRecord(item->dir->userData, item->name, &statbuf);
+            }
+            pthread_mutex_lock(&mutex);
+            numSkipped++;
+            skippedBytes += statbuf.st_size;
+            pthread_mutex_unlock(&mutex);
+            progressAdd(&progressSelf()->settled, statbuf.st_size);
+            close(*src_fd);
+            return ITEM_SKIPPED;
+        }
+        if (destHasData) // keep the old data, only differing blocks are rewritten
+        {
+            flags = O_RDWR;
+            item->delta = 1;
+        }
+    }
+
+    if (dedupMode != DEDUP_NONE)
+    {
+        int duplicate = deduplicate(item, *src_fd);
+        if (duplicate != ITEM_DONE)
+        {
+            close(*src_fd);
+            return duplicate;
+        }
+    }
+
+    *dest_fd = openat(item->dir->destFD, item->name, flags, 0644); // open the destination file to write the content of the source file to it
+    if (*dest_fd < 0)                                              // check if the file is opened successfully
+    {
+        perror("open dest");
+        close(*src_fd);
+        return ITEM_FAILED;
+    }
+    if (item->delta && ftruncate(*dest_fd, statbuf.st_size) < 0) // drop a longer old tail
+    {
+        perror("ftruncate");
+    }
+
+    item->sparse = statbuf.st_blocks * 512LL < statbuf.st_size; // fewer blocks than bytes, so there are holes
+    progressAdd(&progressSelf()->srcAllocated, statbuf.st_blocks * 512LL);
+    if (item->sparse)
+    {
+        pthread_mutex_lock(&mutex);
+        numSparse++;
+        pthread_mutex_unlock(&mutex);
+    }
+
+    *size = statbuf.st_size;
+    if (chunkSize > 0 && statbuf.st_size > chunkSize) // large files are copied in ranges by several workers
+    {
+        splitFile(item, *src_fd, *dest_fd, statbuf.st_size);
+    }
+    return ITEM_DONE;
+}
+
+//  Note a finished destination: the bytes it takes on disk, for comparing against the
+//  source, and a journal line once it is complete, so a resumed run leaves it out
+void recordFinished(filePairStruct *item, int dest_fd, int complete, long long bytes)
+{
+    struct stat statbuf;
+    int known = fstat(dest_fd, &statbuf) == 0;
+    complete &= known && (bytes < 0 || bytes == statbuf.st_size); // a whole file must hold every byte copied
+    if (complete)
+    {
+        char path[PATH_MAX];
+        journalPath(item, path);
+        journalRecordFile(path, statbuf.st_size);
+    }
+
+    progressAdd(&progressSelf()->destAllocated, known ? statbuf.st_blocks * 512LL : 0);
+    if (!complete)
+    {
+        noteFailed(item);
+    }
+}
+
+//  Count a copied whole file and close it. bytes is the size it reached, data the bytes
+//  actually moved, less than bytes when holes were skipped
+void finishWholeFile(filePairStruct *item, int src_fd, int dest_fd, long long bytes, long long data, int complete, copyPath path, double seconds)
+{
+    copyStatsRecord(path, 1, data, seconds);
+    if (syncMode)
+    {
+        syncFinish(item, src_fd, dest_fd);
+    }
+    recordFinished(item, dest_fd, complete, bytes);
+
+    progressCounters *counters = progressSelf(); // the worker's own cache line, no lock needed
+    progressAdd(&counters->bytes, data);
+    progressAdd(&counters->regular, 1);
+    if (item->delta)
+    {
+        pthread_mutex_lock(&mutex);
+        numDelta++;
+        pthread_mutex_unlock(&mutex);
+    }
+
+    if (close(src_fd) < 0) // close the source file
+    {
+        perror("close src");
+    }
+    if (close(dest_fd) < 0) // close the destination file
+    {
+        perror("close dest");
+    }
+}
+
+//  Count a copied range of a split file, returns 1 if it was the last one and the file is finished.
+//  bytes and data as for finishWholeFile
+int finishRange(filePairStruct *item, long long bytes, long long data, copyPath *path, double seconds)
+{
+    fileJob *job = item->job;
+    copyStatsRecord(*path, 0, data, seconds);
+
+    progressAdd(&progressSelf()->bytes, data);
+    pthread_mutex_lock(&mutex); // lock the mutex, the job is shared
+    job->bytes += bytes;
+    job->failed |= bytes != item->length;
+    job->path = *path > job->path ? *path : job->path;
+    int last = --job->remaining == 0; // only the worker that finishes the last range closes and counts the file
+    if (last)
+    {
+        progressAdd(&progressSelf()->regular, 1);
+        numChunked++;
+        numDelta += item->delta;
+    }
+    pthread_mutex_unlock(&mutex); // unlock the mutex
+
+    if (bytes == item->length && bytes > 0)
+    {
+        char journalKey[PATH_MAX];
+        journalPath(item, journalKey);
+        journalRecordRange(journalKey, item->offset, item->length);
+    }
+    if (!last)
+    {
+        return 0;
+    }
+
+    *path = job->path;
+    copyStatsRecord(*path, 1, 0, 0);
+    if (job->failed)
+    {
+        fprintf(stderr, "Incomplete copy of %s/%s: %lld bytes copied\n", item->dir->srcPath, item->name, job->bytes);
+    }
+    else if (syncMode)
+    {
+        syncFinish(item, job->srcFD, job->destFD);
+    }
+    recordFinished(item, job->destFD, !job->failed, -1); // the ranges were checked one by one
+    if (close(job->srcFD) < 0) // close the source file
+    {
+        perror("close src");
+    }
+    if (close(job->destFD) < 0) // close the destination file
+    {
+        perror("close dest");
+    }
+    free(job);
+    return 1;
+}
+
+//  Update part of an existing destination in sync mode, returns the bytes now in sync or -1
+long long copyDelta(int src_fd, int dest_fd, long long offset, long long length, copyPath *path)
+{
+    long long rewritten;
+    long long bytes = copyDeltaRange(src_fd, dest_fd, offset, length, &rewritten);
+    *path = COPY_DELTA;
+    if (bytes >= 0)
+    {
+        pthread_mutex_lock(&mutex);
+        deltaRewritten += rewritten;
+        skippedBytes += bytes - rewritten;
+        pthread_mutex_unlock(&mutex);
+    }
+    return bytes;
+}
+
+//  Copy a whole file opened by openWholeFile and finish it
+void copyOpenFile(filePairStruct *item, int src_fd, int dest_fd, long long size, copyPath *path)
+{
+    struct timeval copyStart, copyEnd; // start and end time of the copy
+    gettimeofday(&copyStart, NULL);    // get the start time
+    long long bytes, data;
+    if (item->delta)
+    {
+        bytes = data = copyDelta(src_fd, dest_fd, 0, size, path); // rewrite only the blocks that changed
+    }
+    else
+    {
+        bytes = copyFileData(src_fd, dest_fd, path, &data); // copy the content of the source file in the kernel when possible
+    }
+    gettimeofday(&copyEnd, NULL); // get the end time
+    int complete = bytes >= 0;
+    if (bytes < 0)
+    {
+        perror("copy");
+        bytes = data = 0;
+    }
+    finishWholeFile(item, src_fd, dest_fd, bytes, data, complete, *path, (copyEnd.tv_sec - copyStart.tv_sec) + (copyEnd.tv_usec - copyStart.tv_usec) / 1e6);
+}
+
+//  Open and copy a whole file, or split it if it is large; returns what openWholeFile did
+//  when there was nothing to copy
+int copyWholeFile(filePairStruct *item, copyPath *path)
+{
+    int src_fd, dest_fd;
+    long long size;
+    int opened = openWholeFile(item, &src_fd, &dest_fd, &size);
+    if (opened != ITEM_DONE)
+    {
+        return opened;
+    }
+    if (item->job != NULL) // split, the caller copies the first range
+    {
+        return ITEM_DONE;
+    }
+    copyOpenFile(item, src_fd, dest_fd, size, path);
+    return ITEM_DONE;
+}
+
+//  Copy one range of a split file, returns 1 if it was the last one and the file is finished
+int copyFileRange(filePairStruct *item, copyPath *path)
+{
+    fileJob *job = item->job;
+    struct timeval copyStart, copyEnd;
+    gettimeofday(&copyStart, NULL);
+    long long bytes, data;
+    if (item->delta)
+    {
+        bytes = data = copyDelta(job->srcFD, job->destFD, item->offset, item->length, path);
+    }
+    else
+    {
+        bytes = copyRangeData(job->srcFD, job->destFD, item->offset, item->length, path, &data); // copy the range at its offset
+    }
+    gettimeofday(&copyEnd, NULL);
+    if (bytes < 0)
+    {
+        perror("copy range");
+        bytes = data = 0;
+    }
+    return finishRange(item, bytes, data, path, (copyEnd.tv_sec - copyStart.tv_sec) + (copyEnd.tv_usec - copyStart.tv_usec) / 1e6);
+}
+
+//  Copy one item with the synchronous engine
+void copyItem(filePairStruct *item, copyPath *path, int *finished, int *status)
+{
+    *path = COPY_PATH_COUNT; // path that copied the file, none for FIFOs
+    *finished = 1;           // 0 while other ranges of the file are still being copied
+    *status = ITEM_DONE;
+    if (!item->isFifo && !item->isDir && item->job == NULL) // check if the file is a regular file
+    {
+        *status = copyWholeFile(item, path); // a large file comes back as its first range
+    }
+    if (item->job != NULL) // check if the item is a range of a large file
+    {
+        *finished = copyFileRange(item, path);
+    }
+    else if (item->isFifo) // check if the file is a FIFO file
+    {
+        progressAdd(&progressSelf()->fifo, 1);
+    }
+}
+
+//  Copy the small files of a batch one after another with nothing shared but the
+//  directory. Their "Copied:" lines are gathered and written together.
+void copyFileBatch(filePairStruct *batchItem)
+{
+    fileBatch *batch = batchItem->batch;
+    dirHandle *dir = batchItem->dir;
+    size_t logSize = 65536, logUsed = 0;
+    char *log = malloc(logSize);
+    if (log == NULL)
+    {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+
+    for (int i = 0; i < batch->count; i++)
+    {
+        filePairStruct item = {.dir = dir, .name = batch->names[i]};
+        copyPath path;
+        int finished, status;
+        copyItem(&item, &path, &finished, &status);
+        if (item.job != NULL && !finished) // grew past the chunk size since the walker saw it, its last range releases this reference
+        {
+            dirHandleRetain(dir);
+        }
+        if (status == ITEM_FAILED)
+        {
+            noteFailed(&item);
+        }
+        if (!finished || status != ITEM_DONE)
+        {
+            continue;
+        }
+
+        if (logSize - logUsed < 2 * PATH_MAX + 64) // room for one more line
+        {
+            write(STDOUT_FILENO, log, logUsed);
+            logUsed = 0;
+        }
+        logUsed += snprintf(log + logUsed, logSize - logUsed, "Copied: %s/%s -> %s/%s (%s)\n", dir->srcPath, item.name, dir->destPath, item.name, copyPathNames[path]);
+    }
+
+    write(STDOUT_FILENO, log, logUsed);
+    free(log);
+    free(batch);
+    dirHandleRelease(dir); // the one reference of the whole batch
+}
+
+//  Copy a batch of items through the worker's io_uring, with every file and range of the
+//  batch in flight at once; the results mean the same as for copyItem
+void copyBatchUring(uringEngine *ring, filePairStruct *items, int count, copyPath *paths, int *finished, int *status)
+{
+    uringTask tasks[count]; // files and ranges handed to the ring
+    int taskOf[count];      // task of each item, -1 for items with nothing to copy
+    int numTasks = 0;
+    for (int i = 0; i < count; i++)
+    {
+        filePairStruct *item = &items[i];
+        paths[i] = COPY_PATH_COUNT;
+        finished[i] = 1;
+        status[i] = ITEM_DONE;
+        taskOf[i] = -1;
+        if (item->isFifo) // check if the file is a FIFO file
+        {
+            progressAdd(&progressSelf()->fifo, 1);
+            continue;
+        }
+        if (!item->isDir && item->job == NULL) // check if the file is a regular file
+        {
+            int src_fd, dest_fd;
+            long long size;
+            int opened = openWholeFile(item, &src_fd, &dest_fd, &size);
+            if (opened != ITEM_DONE)
+            {
+                status[i] = opened;
+                continue;
+            }
+            if (item->job == NULL && item->sparse) // the ring would read the holes and write zeros
+            {
+                copyOpenFile(item, src_fd, dest_fd, size, &paths[i]);
+                continue;
+            }
+            if (item->job == NULL)
+            {
+                tasks[numTasks] = (uringTask){.srcFD = src_fd, .destFD = dest_fd, .offset = 0, .length = size};
+                taskOf[i] = numTasks++;
+                continue;
+            }
+        }
+        if (item->job != NULL && item->sparse)
+        {
+            finished[i] = copyFileRange(item, &paths[i]);
+        }
+        else if (item->job != NULL) // a range, possibly the first one of a file split just now
+        {
+            tasks[numTasks] = (uringTask){.srcFD = item->job->srcFD, .destFD = item->job->destFD, .offset = item->offset, .length = item->length};
+            taskOf[i] = numTasks++;
+        }
+    }
+
+    struct timeval copyStart, copyEnd;
+    gettimeofday(&copyStart, NULL);
+    uringCopy(ring, tasks, numTasks);
+    gettimeofday(&copyEnd, NULL);
+    // The items share the time, so the per-path rate stays the rate of one worker
+    double share = numTasks > 0 ? ((copyEnd.tv_sec - copyStart.tv_sec) + (copyEnd.tv_usec - copyStart.tv_usec) / 1e6) / numTasks : 0;
+
+    for (int i = 0; i < count; i++)
+    {
+        if (taskOf[i] < 0)
+        {
+            continue;
+        }
+        uringTask *task = &tasks[taskOf[i]];
+        paths[i] = COPY_IO_URING;
+        if (items[i].job == NULL)
+        {
+            finishWholeFile(&items[i], task->srcFD, task->destFD, task->copied, task->copied, task->copied == task->length, COPY_IO_URING, share);
+        }
+        else
+        {
+            finished[i] = finishRange(&items[i], task->copied, task->copied, &paths[i], share);
+        }
+    }
+}
+
+//  Put an item in the buffer, which has room; the caller holds the mutex. Largest-first
+//  scheduling keeps the buffer as a max-heap on the item size, otherwise it is a stack.
+void bufferPush(const filePairStruct *item)
+{
+    int slot = bufferCount++;
+    while (scheduleLpt && slot > 0 && buffer[(slot - 1) / 2].length < item->length) // sift up
+    {
+        buffer[slot] = buffer[(slot - 1) / 2];
+        slot = (slot - 1) / 2;
+    }
+    buffer[slot] = *item;
+}
+
+//  Take the next item from the buffer, which is not empty; the caller holds the mutex
+filePairStruct bufferPop(void)
+{
+    if (!scheduleLpt)
+    {
+        return buffer[--bufferCount]; // newest first
+    }
+    filePairStruct top = buffer[0], last = buffer[--bufferCount];
+    int slot = 0;
+    while (2 * slot + 1 < bufferCount) // sift the last item down from the root
+    {
+        int child = 2 * slot + 1;
+        if (child + 1 < bufferCount && buffer[child + 1].length > buffer[child].length)
+        {
+            child++;
+        }
+        if (buffer[child].length <= last.length)
+        {
+            break;
+        }
+        buffer[slot] = buffer[child];
+        slot = child;
+    }
+    buffer[slot] = last;
+    return top;
+}
+
+//  Add an item to the buffer, waiting while it is full
+void enqueueFilePair(const filePairStruct *item)
+{
+    pthread_mutex_lock(&mutex);       // lock the mutex
+    while (bufferCount == bufferSize) // check if the buffer is full
+    {
+        pthread_cond_wait(&bufferNotFull, &mutex); // wait for the buffer to be not full
+    }
+
+    bufferPush(item); // add the item and increment the number of items in the buffer
+
+    pthread_cond_signal(&bufferNotEmpty); // signal that the buffer is not empty
+    pthread_mutex_unlock(&mutex);         // unlock the mutex
+}
+
+//  Save the manifest of a directory once every file queued from it is done
+void closeDirectory(dirHandle *dir)
+{
+    if (dir->userData != NULL)
+    {
+        manifestSave(dir->userData, dir->destFD);
+        dir->userData = NULL;
+    }
+}
+
+//  Parse a byte count such as 4096, 64K, 64M or 1G, -1 if it is not one
+long long parseSize(const char *text)
+{
+    char *end;
+    long long value = strtoll(text, &end, 10);
+    switch (*end)
+    {
+    case 'G':
+    case 'g':
+        value <<= 10; // fall through
+    case 'M':
+    case 'm':
+        value <<= 10; // fall through
+    case 'K':
+    case 'k':
+        value <<= 10;
+        end++;
+        break;
+    }
+    return *end != '\0' || end == text || value < 0 ? -1 : value;
+}
+
+//  Purpose of the manager thread is to process the source directory
+void *manager(void *arg)
+{
+    char **argv = (char **)arg;
+    char *srcDir = argv[3];
+    char *destDir = argv[4];
+
+    // Each open directory holds two descriptors; leave room for stdio and every worker's
+    // source, destination and splice pipe, or its ring and a batch of open files
+    struct rlimit limit;
+    int maxOpenDirs = 512;
+    long perWorker = useUring ? 2L * queueDepth + 1 : 4;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur != RLIM_INFINITY)
+    {
+        maxOpenDirs = ((long)limit.rlim_cur - 16 - perWorker * numWorkers) / 2;
+    }
+
+    walkTree(srcDir, destDir, numWalkers, maxOpenDirs, processEntry, flushBatch, closeDirectory); // returns once every directory is scanned
+
+    pthread_mutex_lock(&mutex);
+    done = 1;
+    pthread_cond_broadcast(&bufferNotEmpty);
+    pthread_mutex_unlock(&mutex);
+
+    // Wait for all worker threads to reach this point
+    pthread_barrier_wait(&barrier);
+
+    return NULL;
+}
+
+//  Purpose of the worker thread is to copy the files from the buffer
+void *worker(void *arg)
+{
+    progressBindWorker((int)(long)arg); // counters on this worker's own cache line
+    uringEngine *ring = NULL; // this worker's ring with the io_uring engine
+    int batchSize = 1;        // items taken from the buffer at once
+    if (useUring && !syncMode) // sync mode mostly compares, it stays on the synchronous engine
+    {
+        ring = uringCreate(queueDepth, ioSize);
+        if (ring == NULL)
+        {
+            perror("io_uring_setup, using the synchronous engine");
+        }
+        else
+        {
+            batchSize = uringMaxTasks(ring); // one file or range per read->write pair in flight
+        }
+    }
+    filePairStruct *items = malloc(sizeof(filePairStruct) * batchSize);
+    copyPath *paths = malloc(sizeof(copyPath) * batchSize);
+    int *finished = malloc(sizeof(int) * batchSize * 2);
+    if (items == NULL || paths == NULL || finished == NULL)
+    {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+    int *status = finished + batchSize;
+
+    while (1)
+    {
+        pthread_mutex_lock(&mutex); // lock the mutex
+        // Once the walk is done, only a worker still holding an item can add ranges
+        while (bufferCount == 0 && rangeList == NULL && !(done && activeWorkers == 0))
+        {
+            pthread_cond_wait(&bufferNotEmpty, &mutex); // wait for the buffer to be not empty
+        }
+
+        if (bufferCount == 0 && rangeList == NULL) // check if everything is copied and nobody can add more
+        {
+            pthread_mutex_unlock(&mutex); // unlock the mutex
+            break;
+        }
+
+        int count = 0;
+        while (count < batchSize && (rangeList != NULL || bufferCount > 0))
+        {
+            if (rangeList != NULL) // finish files that are already open before starting new ones
+            {
+                rangeNode *node = rangeList;
+                rangeList = node->next;
+                items[count++] = node->item;
+                free(node);
+            }
+            else
+            {
+                items[count++] = bufferPop();           // get the file pair from the buffer
+                pthread_cond_signal(&bufferNotFull);    // signal that the buffer is not full
+            }
+        }
+        activeWorkers++;
+        pthread_mutex_unlock(&mutex); // unlock the mutex
+        struct timespec busyStart, busyEnd; // time holding items, for the progress reports
+        clock_gettime(CLOCK_MONOTONIC, &busyStart);
+
+        int kept = 0;
+        for (int i = 0; i < count; i++) // batches of small files are copied here, one file at a time
+        {
+            if (items[i].isBatch)
+            {
+                copyFileBatch(&items[i]);
+            }
+            else
+            {
+                items[kept++] = items[i];
+            }
+        }
+        count = kept;
+
+        if (ring != NULL && count > 0)
+        {
+            copyBatchUring(ring, items, count, paths, finished, status);
+        }
+        else if (count > 0)
+        {
+            copyItem(&items[0], &paths[0], &finished[0], &status[0]);
+        }
+
+        for (int i = 0; i < count; i++)
+        {
+            filePairStruct *filePair = &items[i];
+            if (status[i] == ITEM_FAILED) // not journaled, a resumed run tries it again
+            {
+                noteFailed(filePair);
+            }
+            if (finished[i] && status[i] == ITEM_DONE) // unchanged files are not listed, links are listed when made
+            {
+                char *stdoutBuffer = (char *)malloc(4096);
+                const char *srcDir = filePair->dir->srcPath, *destDir = filePair->dir->destPath;
+                if (paths[i] < COPY_PATH_COUNT)
+                {
+                    snprintf(stdoutBuffer, 4096, "Copied: %s/%s -> %s/%s (%s)\n", srcDir, filePair->name, destDir, filePair->name, copyPathNames[paths[i]]);
+                }
+                else
+                {
+                    snprintf(stdoutBuffer, 4096, "Copied: %s/%s -> %s/%s\n", srcDir, filePair->name, destDir, filePair->name);
+                }
+                write(STDOUT_FILENO, stdoutBuffer, strlen(stdoutBuffer));
+                free(stdoutBuffer);
+            }
+            if (finished[i])
+            {
+                dirHandleRelease(filePair->dir); // the directory closes once its last file is done
+            }
+        }
+
+        clock_gettime(CLOCK_MONOTONIC, &busyEnd);
+        workerFinish[(long)arg] = busyEnd.tv_sec + busyEnd.tv_nsec / 1e9; // end of this worker's last item, the makespan ends with the latest
+        progressAdd(&progressSelf()->busyMicros, (busyEnd.tv_sec - busyStart.tv_sec) * 1000000LL + (busyEnd.tv_nsec - busyStart.tv_nsec) / 1000);
+
+        pthread_mutex_lock(&mutex);
+        activeWorkers--;
+        if (done && activeWorkers == 0)
+        {
+            pthread_cond_broadcast(&bufferNotEmpty); // no more ranges can appear, let idle workers exit
+        }
+        pthread_mutex_unlock(&mutex);
+    }
+    free(items);
+    free(paths);
+    free(finished);
+    uringDestroy(ring);
+    pthread_barrier_wait(&barrier); // Wait for all worker threads to reach this point
+    return NULL;
+}
+
+double monotonicSeconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+//  Signal handler for SIGINT
+void SIGINTHandler(int signo)
+{
+    if (signo == SIGINT)
+    {
+        char byte = 0;
+        write(interruptPipe[1], &byte, 1); // only async-signal-safe calls here, the journal lock may be held by this thread
+    }
+}
+
+//  Wait for the SIGINT handler, then stop the workers and save the checkpoints
+void *interrupter(void *arg)
+{
+    (void)arg;
+    char byte;
+    ssize_t got;
+    while ((got = read(interruptPipe[0], &byte, 1)) != 1)
+    {
+        if (got == 0 || (got < 0 && errno != EINTR))
+        {
+            perror("interrupt pipe");
+            return NULL;
+        }
+    }
+
+    char *stdoutBuffer = (char *)malloc(4096);
+    sprintf(stdoutBuffer, "SIGINT received. Exiting...\n");
+    write(STDOUT_FILENO, stdoutBuffer, strlen(stdoutBuffer));
+    free(stdoutBuffer);
+
+    pthread_mutex_lock(&mutex);
+    done = 1;
+    pthread_cond_broadcast(&bufferNotEmpty);
+    pthread_mutex_unlock(&mutex);
+
+    journalFlush(); // checkpoints still in the buffer, a --resume run starts from them
+
+    exit(EXIT_FAILURE);
 }
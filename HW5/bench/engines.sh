@@ -0,0 +1,59 @@
+#!/bin/sh
+# Copies one synthetic tree with the synchronous engine (one file per worker at a
+# time) and with the io_uring engine at several queue depths, to show what keeping
+# many reads and writes in flight buys on the device holding TREE and DEST.
+#
+# Usage: bench/engines.sh   (from the HW5 directory, after make build)
+# Tunables: FILES (default 2000) SIZE (KB per file, default 256) WORKERS BUFFER
+# DEPTH_LIST IO_SIZE TREE (where the source tree is kept) DEST (where copies go)
+# Add DROP=1 when running as root to drop the page cache before every run.
+
+FILES=${FILES:-2000}
+SIZE=${SIZE:-256}
+WORKERS=${WORKERS:-4}
+BUFFER=${BUFFER:-1024}
+DEPTH_LIST=${DEPTH_LIST:-"1 8 32 128"}
+IO_SIZE=${IO_SIZE:-128K}
+TREE=${TREE:-/tmp/mwcp-files-$FILES-$SIZE}
+DEST=${DEST:-$(mktemp -d)}
+
+BIN=$(cd "$(dirname "$0")/.." && pwd)/MWCp
+
+if [ ! -f "$TREE/.complete" ]
+then
+    echo "Creating $FILES files of $SIZE KB under $TREE" >&2
+    rm -rf "$TREE"
+    mkdir -p "$TREE"
+    i=0
+    while [ $i -lt "$FILES" ]
+    do
+        mkdir -p "$TREE/d$((i / 100))"
+        head -c $((SIZE * 1024)) /dev/urandom > "$TREE/d$((i / 100))/f$i"
+        i=$((i + 1))
+    done
+    touch "$TREE/.complete"
+fi
+
+run()
+{
+    rm -rf "$DEST/copy"
+    sync
+    if [ "${DROP:-0}" = 1 ]
+    then
+        echo 3 > /proc/sys/vm/drop_caches
+    fi
+    "$BIN" "$@" "$BUFFER" "$WORKERS" "$TREE" "$DEST/copy" | sed -n '/STATISTICS/,$p' | awk '
+        /^TOTAL BYTES COPIED:/ { bytes = $4 }
+        /^TOTAL TIME:/ { time = $3; split($3, t, "[:.]"); seconds = t[1] * 60 + t[2] + t[3] / 1000 }
+        END { printf "%12s %10.1f\n", time, (seconds > 0 ? bytes / seconds / 1048576 : 0) }' | sed "s/^/$label /"
+}
+
+printf "%-16s %12s %10s\n" engine time MB/s
+label=$(printf "%-16s" sync)
+run --engine sync
+for depth in $DEPTH_LIST
+do
+    label=$(printf "%-16s" "uring qd=$depth")
+    run --engine uring --queue-depth "$depth" --io-size "$IO_SIZE"
+done
+rm -rf "$DEST/copy"
@@ -0,0 +1,68 @@
+#!/bin/sh
+# Copies a skewed tree, many small files and a few large ones, with the buffer handed
+# out newest first (lifo) and largest first (lpt), with and without splitting large
+# files into ranges, and reports the makespan and how far apart the workers finished.
+#
+# Usage: bench/schedule.sh   (from the HW5 directory, after make build)
+# Tunables: SMALL (number of small files, default 2000) SMALL_KB (default 64)
+# LARGE (number of large files, default 4) LARGE_MB (default 256) WORKERS BUFFER
+# CHUNK (range size of the split runs, default 64M) TREE (where the source tree is
+# kept) DEST (where copies go). Add DROP=1 when running as root to drop the page cache
+# before every run.
+
+SMALL=${SMALL:-2000}
+SMALL_KB=${SMALL_KB:-64}
+LARGE=${LARGE:-4}
+LARGE_MB=${LARGE_MB:-256}
+WORKERS=${WORKERS:-4}
+BUFFER=${BUFFER:-256}
+CHUNK=${CHUNK:-64M}
+TREE=${TREE:-/tmp/mwcp-skew-$SMALL-$SMALL_KB-$LARGE-$LARGE_MB}
+DEST=${DEST:-$(mktemp -d)}
+
+BIN=$(cd "$(dirname "$0")/.." && pwd)/MWCp
+
+if [ ! -f "$TREE/.complete" ]
+then
+    echo "Creating $SMALL files of $SMALL_KB KB and $LARGE of $LARGE_MB MB under $TREE" >&2
+    rm -rf "$TREE"
+    mkdir -p "$TREE"
+    i=0
+    while [ $i -lt "$SMALL" ]
+    do
+        mkdir -p "$TREE/d$((i / 200))"
+        head -c $((SMALL_KB * 1024)) /dev/urandom > "$TREE/d$((i / 200))/f$i"
+        i=$((i + 1))
+    done
+    i=0
+    while [ $i -lt "$LARGE" ] # spread over the tree, so the stack meets them at random times
+    do
+        head -c $((LARGE_MB * 1048576)) /dev/urandom > "$TREE/d$((i * SMALL / 200 / LARGE))/large$i"
+        i=$((i + 1))
+    done
+    touch "$TREE/.complete"
+fi
+
+run()
+{
+    rm -rf "$DEST/copy"
+    sync
+    if [ "${DROP:-0}" = 1 ]
+    then
+        echo 3 > /proc/sys/vm/drop_caches
+    fi
+    "$BIN" "$@" "$BUFFER" "$WORKERS" "$TREE" "$DEST/copy" | sed -n '/STATISTICS/,$p' | awk '
+        /^Schedule:/ { makespan = $5; spread = $11 }
+        END { printf "%12.3f %12.3f\n", makespan, spread }' | sed "s/^/$label /"
+}
+
+printf "%-20s %12s %12s\n" schedule makespan/s finish-gap/s
+for chunk in 0 "$CHUNK"
+do
+    for schedule in lifo lpt
+    do
+        label=$(printf "%-20s" "$schedule chunk=$chunk")
+        run --schedule "$schedule" --chunk-size "$chunk"
+    done
+done
+rm -rf "$DEST/copy"
@@ -0,0 +1,59 @@
+#!/bin/sh
+# Copies a tree of tiny files one queue item per file and then packed into batches,
+# to show how much of a small-file copy is queue and logging overhead.
+#
+# Usage: bench/smallfiles.sh   (from the HW5 directory, after make build)
+# Tunables: FILES (default 1000000) SIZE (bytes per file, default 1024) WORKERS BUFFER
+# BATCH_LIST (files per batch, 0 is unbatched) TREE (where the source tree is kept)
+# DEST (where copies go). Add DROP=1 when running as root to drop the page cache
+# before every run.
+
+FILES=${FILES:-1000000}
+SIZE=${SIZE:-1024}
+WORKERS=${WORKERS:-4}
+BUFFER=${BUFFER:-1024}
+BATCH_LIST=${BATCH_LIST:-"0 16 64 256"}
+TREE=${TREE:-/tmp/mwcp-small-$FILES-$SIZE}
+DEST=${DEST:-$(mktemp -d)}
+
+BIN=$(cd "$(dirname "$0")/.." && pwd)/MWCp
+
+if [ ! -f "$TREE/.complete" ]
+then
+    echo "Creating $FILES files of $SIZE bytes under $TREE" >&2
+    rm -rf "$TREE"
+    mkdir -p "$TREE"
+    left=$FILES
+    dir=0
+    while [ "$left" -gt 0 ]
+    do
+        count=$((left < 1000 ? left : 1000)) # 1000 files per directory, made by split in one go
+        mkdir "$TREE/d$dir"
+        head -c $((count * SIZE)) /dev/urandom | (cd "$TREE/d$dir" && split -b "$SIZE" -a 3 -d - f)
+        left=$((left - count))
+        dir=$((dir + 1))
+    done
+    touch "$TREE/.complete"
+fi
+
+run()
+{
+    rm -rf "$DEST/copy"
+    sync
+    if [ "${DROP:-0}" = 1 ]
+    then
+        echo 3 > /proc/sys/vm/drop_caches
+    fi
+    "$BIN" "$@" "$BUFFER" "$WORKERS" "$TREE" "$DEST/copy" | sed -n '/STATISTICS/,$p' | awk '
+        /^Number of Regular File:/ { files = $5 }
+        /^TOTAL TIME:/ { time = $3; split($3, t, "[:.]"); seconds = t[1] * 60 + t[2] + t[3] / 1000 }
+        END { printf "%12s %12.0f\n", time, (seconds > 0 ? files / seconds : 0) }' | sed "s/^/$label /"
+}
+
+printf "%-12s %12s %12s\n" batch time files/s
+for batch in $BATCH_LIST
+do
+    label=$(printf "%-12s" "$batch")
+    run --batch "$batch"
+done
+rm -rf "$DEST/copy"
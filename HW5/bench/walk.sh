@@ -0,0 +1,53 @@
+#!/bin/sh
+# Builds a synthetic tree of small files and times MWCp on it with different
+# walker counts, to show how directory scanning scales.
+#
+# Usage: bench/walk.sh   (from the HW5 directory, after make build)
+# Tunables: FILES (default 1000000) DIRS (directories, nested two levels deep)
+# WORKERS BUFFER WALKERS_LIST TREE (where the source tree is kept between runs)
+
+FILES=${FILES:-1000000}
+DIRS=${DIRS:-1000}
+WORKERS=${WORKERS:-8}
+BUFFER=${BUFFER:-1024}
+WALKERS_LIST=${WALKERS_LIST:-"1 2 4 8"}
+TREE=${TREE:-/tmp/mwcp-tree-$FILES}
+
+BIN=$(cd "$(dirname "$0")/.." && pwd)/MWCp
+
+if [ ! -f "$TREE/.complete" ]
+then
+    echo "Creating $FILES files in $DIRS directories under $TREE" >&2
+    rm -rf "$TREE"
+    mkdir -p "$TREE"
+    # Directories are spread over 32 top-level parents so the tree has some depth
+    awk -v files="$FILES" -v dirs="$DIRS" -v root="$TREE" 'BEGIN {
+        for (d = 0; d < dirs; d++)
+        {
+            dir = sprintf("%s/p%02d/d%04d", root, d % 32, d)
+            system("mkdir -p " dir)
+            for (f = d; f < files; f += dirs)
+            {
+                name = sprintf("%s/f%07d", dir, f)
+                printf "file %d\n", f > name
+                close(name)
+            }
+        }
+    }'
+    touch "$TREE/.complete"
+fi
+
+DEST=$(mktemp -d)
+printf "%-8s %12s %12s %10s\n" walkers time files steals
+for walkers in $WALKERS_LIST
+do
+    rm -rf "$DEST/copy"
+    sync
+    output=$("$BIN" --walkers "$walkers" "$BUFFER" "$WORKERS" "$TREE" "$DEST/copy" | sed -n '/STATISTICS/,$p')
+    echo "$output" | awk -v walkers="$walkers" '
+        /^Walkers:/ { steals = $12 }
+        /^Number of Regular File:/ { files = $5 }
+        /^TOTAL TIME:/ { time = $3 }
+        END { printf "%-8s %12s %12s %10s\n", walkers, time, files, steals }'
+done
+rm -rf "$DEST"
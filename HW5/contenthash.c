@@ -0,0 +1,305 @@
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+
+#include "contenthash.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define CONTENT_HASH_X86 1
+#endif
+
+#define HASH_LANES 8                                     // 64-bit lanes per stripe
+#define HASH_STRIPE 64                                   // bytes per stripe
+#define HASH_STRIPES (CONTENT_HASH_BLOCK / HASH_STRIPE)  // stripes per block
+#define HASH_READ_SIZE (1 << 20)                         // bytes read per pread, a whole number of blocks
+
+#define PRIME32_1 0x9E3779B1ULL
+#define PRIME64_1 0x9E3779B185EBCA87ULL
+#define PRIME64_2 0xC2B2AE3D27D4EB4FULL
+
+// Stripe s of a block mixes lane i with stripeKeys[s + i], so keys slide along the stripes
+static const unsigned long long stripeKeys[HASH_STRIPES + HASH_LANES] = {
+    0xbe4ba423396cfeb8ULL, 0x1cad21f72c81017cULL, 0xdb979083e96dd4deULL, 0x1f67b3b7a4a44072ULL,
+    0x78e5c0cc4ee679cbULL, 0x2172ffcc7dd05a82ULL, 0x8e2443f7744608b8ULL, 0x4c263a81e69035e0ULL,
+    0xcb00c391bb52283cULL, 0xa32e531b8b65d088ULL, 0x4ef90da297486471ULL, 0xd8acdea946ef1938ULL,
+    0x3f349ce33f76faa8ULL, 0x1d4f0bc7c7bbdcf9ULL, 0x3159b4cd4be0518aULL, 0x647378d9c97e9fc8ULL,
+    0xc3ebd33483acc5eaULL, 0xeb6313faffa081c5ULL, 0x49daf0b751dd0d17ULL, 0x9e68d429265516d3ULL,
+    0xfca1477d58be162bULL, 0xce31d07ad1b8f88fULL, 0x280416958f3acb45ULL, 0x7e404bbbcafbd7afULL};
+
+// Scramble keys, one per lane
+static const unsigned long long scrambleKeys[HASH_LANES] = {
+    0xb8fe6c3923a44bbeULL, 0x7c01812cf721ad1cULL, 0xded46de9839097dbULL, 0x7240a4a4b7b3671fULL,
+    0xcb79e64eccc0e578ULL, 0x825ad07dccff7221ULL, 0xb8084674f743248eULL, 0xe03590e6813a264cULL};
+
+typedef void (*hashKernel)(unsigned long long acc[HASH_LANES], const unsigned char *data, size_t blocks);
+
+//  Mix one stripe into the lanes
+static void accumulateStripe(unsigned long long acc[HASH_LANES], const unsigned char *stripe, const unsigned long long *keys)
+{
+    for (int lane = 0; lane < HASH_LANES; lane++)
+    {
+        unsigned long long data;
+        memcpy(&data, stripe + 8 * lane, 8);
+        unsigned long long mixed = data ^ keys[lane];
+        acc[lane ^ 1] += data; // into the neighbouring lane, so the product of a lane never cancels out its own data
+        acc[lane] += (mixed & 0xffffffffULL) * (mixed >> 32);
+    }
+}
+
+//  Accumulate whole blocks one lane at a time
+static void accumulateScalar(unsigned long long acc[HASH_LANES], const unsigned char *data, size_t blocks)
+{
+    for (size_t block = 0; block < blocks; block++, data += CONTENT_HASH_BLOCK)
+    {
+        for (int stripe = 0; stripe < HASH_STRIPES; stripe++)
+        {
+            accumulateStripe(acc, data + stripe * HASH_STRIPE, stripeKeys + stripe);
+        }
+        for (int lane = 0; lane < HASH_LANES; lane++)
+        {
+            acc[lane] ^= acc[lane] >> 47;
+            acc[lane] ^= scrambleKeys[lane];
+            acc[lane] *= PRIME32_1;
+        }
+    }
+}
+
+#ifdef CONTENT_HASH_X86
+//  Accumulate whole blocks two lanes per register, four registers per stripe
+static void accumulateSse2(unsigned long long acc[HASH_LANES], const unsigned char *data, size_t blocks)
+{
+    __m128i lanes[4], prime = _mm_set1_epi32((int)PRIME32_1);
+    for (int i = 0; i < 4; i++)
+    {
+        lanes[i] = _mm_loadu_si128((const __m128i *)(acc + 2 * i));
+    }
+    for (size_t block = 0; block < blocks; block++, data += CONTENT_HASH_BLOCK)
+    {
+        for (int stripe = 0; stripe < HASH_STRIPES; stripe++)
+        {
+            const __m128i *input = (const __m128i *)(data + stripe * HASH_STRIPE);
+            const __m128i *keys = (const __m128i *)(stripeKeys + stripe);
+            for (int i = 0; i < 4; i++)
+            {
+                __m128i value = _mm_loadu_si128(input + i);
+                __m128i mixed = _mm_xor_si128(value, _mm_loadu_si128(keys + i));
+                __m128i product = _mm_mul_epu32(mixed, _mm_srli_epi64(mixed, 32));
+                __m128i swapped = _mm_shuffle_epi32(value, _MM_SHUFFLE(1, 0, 3, 2)); // data of lane ^ 1
+                lanes[i] = _mm_add_epi64(lanes[i], _mm_add_epi64(swapped, product));
+            }
+        }
+        for (int i = 0; i < 4; i++)
+        {
+            __m128i value = _mm_xor_si128(lanes[i], _mm_srli_epi64(lanes[i], 47));
+            value = _mm_xor_si128(value, _mm_loadu_si128((const __m128i *)(scrambleKeys + 2 * i)));
+            __m128i low = _mm_mul_epu32(value, prime); // 64 x 32 bit multiply from two 32 x 32 ones
+            __m128i high = _mm_mul_epu32(_mm_srli_epi64(value, 32), prime);
+            lanes[i] = _mm_add_epi64(low, _mm_slli_epi64(high, 32));
+        }
+    }
+    for (int i = 0; i < 4; i++)
+    {
+        _mm_storeu_si128((__m128i *)(acc + 2 * i), lanes[i]);
+    }
+}
+
+//  Accumulate whole blocks four lanes per register, two registers per stripe
+__attribute__((target("avx2"))) static void accumulateAvx2(unsigned long long acc[HASH_LANES], const unsigned char *data, size_t blocks)
+{
+    __m256i lanes[2], prime = _mm256_set1_epi32((int)PRIME32_1);
+    for (int i = 0; i < 2; i++)
+    {
+        lanes[i] = _mm256_loadu_si256((const __m256i *)(acc + 4 * i));
+    }
+    for (size_t block = 0; block < blocks; block++, data += CONTENT_HASH_BLOCK)
+    {
+        for (int stripe = 0; stripe < HASH_STRIPES; stripe++)
+        {
+            const __m256i *input = (const __m256i *)(data + stripe * HASH_STRIPE);
+            const __m256i *keys = (const __m256i *)(stripeKeys + stripe);
+            for (int i = 0; i < 2; i++)
+            {
+                __m256i value = _mm256_loadu_si256(input + i);
+                __m256i mixed = _mm256_xor_si256(value, _mm256_loadu_si256(keys + i));
+                __m256i product = _mm256_mul_epu32(mixed, _mm256_srli_epi64(mixed, 32));
+                __m256i swapped = _mm256_shuffle_epi32(value, _MM_SHUFFLE(1, 0, 3, 2));
+                lanes[i] = _mm256_add_epi64(lanes[i], _mm256_add_epi64(swapped, product));
+            }
+        }
+        for (int i = 0; i < 2; i++)
+        {
+            __m256i value = _mm256_xor_si256(lanes[i], _mm256_srli_epi64(lanes[i], 47));
+            value = _mm256_xor_si256(value, _mm256_loadu_si256((const __m256i *)(scrambleKeys + 4 * i)));
+            __m256i low = _mm256_mul_epu32(value, prime);
+            __m256i high = _mm256_mul_epu32(_mm256_srli_epi64(value, 32), prime);
+            lanes[i] = _mm256_add_epi64(low, _mm256_slli_epi64(high, 32));
+        }
+    }
+    for (int i = 0; i < 2; i++)
+    {
+        _mm256_storeu_si256((__m256i *)(acc + 4 * i), lanes[i]);
+    }
+}
+#endif
+
+static hashKernel kernel = NULL; // Selected backend, chosen on first use
+static const char *kernelName = "scalar";
+
+static void selectBackend(void)
+{
+    if (kernel != NULL)
+    {
+        return;
+    }
+    kernel = accumulateScalar;
+    kernelName = "scalar";
+#ifdef CONTENT_HASH_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+    {
+        kernel = accumulateAvx2;
+        kernelName = "avx2";
+    }
+    else if (__builtin_cpu_supports("sse2"))
+    {
+        kernel = accumulateSse2;
+        kernelName = "sse2";
+    }
+#endif
+}
+
+const char *contentHashBackend(void)
+{
+    selectBackend();
+    return kernelName;
+}
+
+int contentHashSetBackend(const char *name)
+{
+    if (strcmp(name, "scalar") == 0)
+    {
+        kernel = accumulateScalar;
+        kernelName = "scalar";
+        return 0;
+    }
+#ifdef CONTENT_HASH_X86
+    __builtin_cpu_init();
+    if (strcmp(name, "sse2") == 0 && __builtin_cpu_supports("sse2"))
+    {
+        kernel = accumulateSse2;
+        kernelName = "sse2";
+        return 0;
+    }
+    if (strcmp(name, "avx2") == 0 && __builtin_cpu_supports("avx2"))
+    {
+        kernel = accumulateAvx2;
+        kernelName = "avx2";
+        return 0;
+    }
+#endif
+    return -1;
+}
+
+//  Starting lanes
+static void hashInit(unsigned long long acc[HASH_LANES])
+{
+    static const unsigned long long seeds[HASH_LANES] = {
+        0xC2B2AE3DULL, PRIME64_1, PRIME64_2, 0x165667B19E3779F9ULL,
+        0x85EBCA77C2B2AE63ULL, 0x27D4EB2F165667C5ULL, PRIME32_1, 0xFF51AFD7ED558CCDULL};
+    memcpy(acc, seeds, sizeof(seeds));
+}
+
+//  Final avalanche of one 64-bit word
+static unsigned long long mix64(unsigned long long value)
+{
+    value ^= value >> 33;
+    value *= 0xFF51AFD7ED558CCDULL;
+    value ^= value >> 33;
+    value *= 0xC4CEB9FE1A85EC53ULL;
+    value ^= value >> 33;
+    return value;
+}
+
+//  Mix the bytes after the last whole block and fold the lanes into the digest
+static void hashFinish(unsigned long long acc[HASH_LANES], const unsigned char *tail, size_t tailLength, unsigned long long length, contentDigest *digest)
+{
+    int stripe = 0;
+    for (; (stripe + 1) * HASH_STRIPE <= (int)tailLength; stripe++)
+    {
+        accumulateStripe(acc, tail + stripe * HASH_STRIPE, stripeKeys + stripe);
+    }
+    if (tailLength % HASH_STRIPE != 0) // the last stripe is padded with zeros
+    {
+        unsigned char last[HASH_STRIPE] = {0};
+        memcpy(last, tail + stripe * HASH_STRIPE, tailLength % HASH_STRIPE);
+        accumulateStripe(acc, last, stripeKeys + stripe);
+    }
+
+    unsigned long long low = length * PRIME64_1, high = ~length * PRIME64_2;
+    for (int lane = 0; lane < HASH_LANES; lane++)
+    {
+        low = mix64(low ^ acc[lane]) + lane;
+        high = mix64(high + (acc[lane] ^ scrambleKeys[lane]));
+    }
+    digest->low = low;
+    digest->high = mix64(high ^ low);
+}
+
+void contentHashBuffer(const void *data, size_t length, contentDigest *digest)
+{
+    selectBackend();
+    unsigned long long acc[HASH_LANES];
+    hashInit(acc);
+    size_t blocks = length / CONTENT_HASH_BLOCK;
+    kernel(acc, data, blocks);
+    hashFinish(acc, (const unsigned char *)data + blocks * CONTENT_HASH_BLOCK, length % CONTENT_HASH_BLOCK, length, digest);
+}
+
+int contentHashFile(int fd, contentDigest *digest, long long *length)
+{
+    selectBackend();
+    unsigned char *buffer = malloc(HASH_READ_SIZE);
+    if (buffer == NULL)
+    {
+        return -1;
+    }
+
+    unsigned long long acc[HASH_LANES];
+    hashInit(acc);
+    long long total = 0;
+    size_t filled = 0; // bytes in the buffer, processed once it holds whole blocks or the file ends
+    while (1)
+    {
+        ssize_t bytes = pread(fd, buffer + filled, HASH_READ_SIZE - filled, total + filled);
+        if (bytes < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            free(buffer);
+            return -1;
+        }
+        filled += bytes;
+        if (bytes == 0 || filled == HASH_READ_SIZE)
+        {
+            size_t blocks = filled / CONTENT_HASH_BLOCK;
+            kernel(acc, buffer, blocks);
+            if (bytes == 0)
+            {
+                total += filled;
+                hashFinish(acc, buffer + blocks * CONTENT_HASH_BLOCK, filled % CONTENT_HASH_BLOCK, total, digest);
+                break;
+            }
+            total += filled;
+            filled = 0;
+        }
+    }
+
+    free(buffer);
+    *length = total;
+    return 0;
+}
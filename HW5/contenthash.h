@@ -0,0 +1,26 @@
+#ifndef CONTENTHASH_H
+#define CONTENTHASH_H
+
+#include <stddef.h>
+
+// 128-bit content hash for finding duplicate files. Data is consumed in 1 KB blocks
+// of sixteen 64-byte stripes, eight 64-bit lanes per stripe, with a multiply of the
+// two 32-bit halves of every lane (the XXH3 accumulate step) and a scramble after
+// each block. The AVX2 and SSE2 kernels compute exactly what the scalar one does, so
+// a digest never depends on the CPU. Not a cryptographic hash.
+
+#define CONTENT_HASH_BLOCK 1024 // bytes per accumulate block
+
+typedef struct // Digest of a file's content
+{
+    unsigned long long low;
+    unsigned long long high;
+} contentDigest;
+
+const char *contentHashBackend(void);        // Name of the backend in use: avx2, sse2 or scalar
+int contentHashSetBackend(const char *name); // Force a backend, -1 if this CPU lacks it
+
+void contentHashBuffer(const void *data, size_t length, contentDigest *digest); // Hash a buffer
+int contentHashFile(int fd, contentDigest *digest, long long *length);          // Hash a whole file with pread, -1 on a read error
+
+#endif
@@ -0,0 +1,606 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <pthread.h>
+#include <string.h>
+#include <sys/sendfile.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <linux/fs.h>
+
+#include "copyengine.h"
+
+const char *copyPathNames[COPY_PATH_COUNT] = {"clone", "copy_file_range", "sendfile", "splice", "read/write", "io_uring", "delta"};
+
+long long pathFiles[COPY_PATH_COUNT];                       // files completed by each path
+long long pathBytes[COPY_PATH_COUNT];                       // bytes copied by each path
+double pathSeconds[COPY_PATH_COUNT];                        // time spent copying by each path
+long long holeBytes;                                        // source bytes in holes, never read or written
+pthread_mutex_t statsMutex = PTHREAD_MUTEX_INITIALIZER;     // mutex for the statistics
+
+static long long copyExtents(int srcFD, int destFD, long long offset, long long length, copyPath *pathTaken, long long *rewritten, long long *holesSkipped);
+
+//  A kernel copy call failed in a way that means the next path may still work
+static int isUnsupported(int err)
+{
+    return err == EXDEV || err == EINVAL || err == ENOSYS || err == EOPNOTSUPP || err == EBADF || err == ESPIPE;
+}
+
+//  Clone the whole file with FICLONE, returns 0 when done, 1 to fall back. Nothing is
+//  written when it fails, so any error just moves on to the next path.
+static int copyWithClone(int srcFD, int destFD, long long *copied)
+{
+    struct stat statbuf;
+    if (fstat(srcFD, &statbuf) < 0 || ioctl(destFD, FICLONE, srcFD) < 0)
+    {
+        return 1;
+    }
+    *copied = statbuf.st_size;
+    return 0;
+}
+
+//  Copy with copy_file_range, returns 0 when done, 1 to fall back, -1 on error
+static int copyWithCopyFileRange(int srcFD, int destFD, long long *copied)
+{
+    while (1)
+    {
+        ssize_t bytes = copy_file_range(srcFD, NULL, destFD, NULL, COPY_CHUNK, 0); // offsets of both files advance
+        if (bytes == 0)
+        {
+            return 0;
+        }
+        if (bytes < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return isUnsupported(errno) ? 1 : -1;
+        }
+        *copied += bytes;
+    }
+}
+
+//  Copy with sendfile, returns 0 when done, 1 to fall back, -1 on error
+static int copyWithSendfile(int srcFD, int destFD, long long *copied)
+{
+    while (1)
+    {
+        ssize_t bytes = sendfile(destFD, srcFD, NULL, COPY_CHUNK);
+        if (bytes == 0)
+        {
+            return 0;
+        }
+        if (bytes < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return isUnsupported(errno) ? 1 : -1;
+        }
+        *copied += bytes;
+    }
+}
+
+//  Copy with splice through a pipe, returns 0 when done, 1 to fall back, -1 on error
+static int copyWithSplice(int srcFD, int destFD, long long *copied)
+{
+    int pipeFD[2];
+    if (pipe(pipeFD) < 0)
+    {
+        return 1;
+    }
+    fcntl(pipeFD[1], F_SETPIPE_SZ, COPY_BUFFER_SIZE); // a larger pipe means fewer splice calls
+
+    int result = 0;
+    while (1)
+    {
+        ssize_t bytes = splice(srcFD, NULL, pipeFD[1], NULL, COPY_BUFFER_SIZE, SPLICE_F_MOVE);
+        if (bytes < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (bytes <= 0)
+        {
+            result = bytes == 0 ? 0 : (isUnsupported(errno) ? 1 : -1);
+            break;
+        }
+
+        ssize_t pending = bytes; // everything in the pipe must reach the destination
+        while (pending > 0)
+        {
+            ssize_t written = splice(pipeFD[0], NULL, destFD, NULL, pending, SPLICE_F_MOVE);
+            if (written < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            if (written <= 0)
+            {
+                // Bytes already in the pipe are lost to a fallback, so this is an error
+                result = -1;
+                break;
+            }
+            pending -= written;
+            *copied += written;
+        }
+        if (result < 0)
+        {
+            break;
+        }
+    }
+
+    close(pipeFD[0]);
+    close(pipeFD[1]);
+    return result;
+}
+
+//  Copy with read and write through a large buffer, returns 0 when done, -1 on error
+static int copyWithReadWrite(int srcFD, int destFD, long long *copied)
+{
+    char *buffer = malloc(COPY_BUFFER_SIZE);
+    if (buffer == NULL)
+    {
+        return -1;
+    }
+
+    int result = 0;
+    ssize_t bytes;
+    while ((bytes = read(srcFD, buffer, COPY_BUFFER_SIZE)) != 0)
+    {
+        if (bytes < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            result = -1;
+            break;
+        }
+        for (ssize_t offset = 0; offset < bytes;)
+        {
+            ssize_t written = write(destFD, buffer + offset, bytes - offset);
+            if (written < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            if (written <= 0)
+            {
+                result = -1;
+                break;
+            }
+            offset += written;
+            *copied += written;
+        }
+        if (result < 0)
+        {
+            break;
+        }
+    }
+
+    free(buffer);
+    return result;
+}
+
+//  Copy a whole file from the start, trying each path in turn; a path that gives up
+//  mid-file leaves both offsets where it stopped, so the next one continues from there
+long long copyFileData(int srcFD, int destFD, copyPath *pathTaken, long long *dataBytes)
+{
+    long long copied = 0, holes = 0;
+    int result = copyWithClone(srcFD, destFD, &copied);
+    *pathTaken = COPY_CLONE;
+    struct stat statbuf;
+    if (result == 1 && fstat(srcFD, &statbuf) == 0 && statbuf.st_blocks * 512LL < statbuf.st_size)
+    {
+        // Fewer blocks than bytes, so the source has holes. Only its data extents are
+        // copied into the new, empty destination and the final size leaves the rest as
+        // holes, where the chain below would read them as zeros and write them out.
+        copied = copyExtents(srcFD, destFD, 0, statbuf.st_size, pathTaken, NULL, &holes);
+        if (copied < 0 || ftruncate(destFD, copied) < 0)
+        {
+            return -1;
+        }
+        *dataBytes = copied - holes;
+        return copied;
+    }
+    if (result == 1)
+    {
+        result = copyWithCopyFileRange(srcFD, destFD, &copied);
+        *pathTaken = COPY_FILE_RANGE;
+    }
+    if (result == 1)
+    {
+        result = copyWithSendfile(srcFD, destFD, &copied);
+        *pathTaken = COPY_SENDFILE;
+    }
+    if (result == 1)
+    {
+        result = copyWithSplice(srcFD, destFD, &copied);
+        *pathTaken = COPY_SPLICE;
+    }
+    if (result == 1)
+    {
+        result = copyWithReadWrite(srcFD, destFD, &copied);
+        *pathTaken = COPY_READ_WRITE;
+    }
+    *dataBytes = copied;
+    return result < 0 ? -1 : copied;
+}
+
+//  Copy a range with copy_file_range at explicit offsets, returns 0 when done, 1 to fall back, -1 on error
+static int copyRangeWithCopyFileRange(int srcFD, int destFD, loff_t *offset, long long *remaining)
+{
+    while (*remaining > 0)
+    {
+        loff_t destOffset = *offset;
+        ssize_t bytes = copy_file_range(srcFD, offset, destFD, &destOffset, *remaining < COPY_CHUNK ? *remaining : COPY_CHUNK, 0);
+        if (bytes == 0)
+        {
+            return 0; // the source is shorter than it was when the range was planned
+        }
+        if (bytes < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return isUnsupported(errno) ? 1 : -1;
+        }
+        *remaining -= bytes;
+    }
+    return 0;
+}
+
+//  Copy a range with splice at explicit offsets, returns 0 when done, 1 to fall back, -1 on error
+static int copyRangeWithSplice(int srcFD, int destFD, loff_t *offset, long long *remaining)
+{
+    int pipeFD[2];
+    if (pipe(pipeFD) < 0)
+    {
+        return 1;
+    }
+    fcntl(pipeFD[1], F_SETPIPE_SZ, COPY_BUFFER_SIZE);
+
+    int result = 0;
+    while (*remaining > 0)
+    {
+        loff_t readOffset = *offset;
+        ssize_t bytes = splice(srcFD, &readOffset, pipeFD[1], NULL, *remaining < COPY_BUFFER_SIZE ? *remaining : COPY_BUFFER_SIZE, SPLICE_F_MOVE);
+        if (bytes < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (bytes <= 0)
+        {
+            result = bytes == 0 ? 0 : (isUnsupported(errno) ? 1 : -1);
+            break;
+        }
+
+        while (bytes > 0)
+        {
+            ssize_t written = splice(pipeFD[0], NULL, destFD, offset, bytes, SPLICE_F_MOVE); // advances offset
+            if (written < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            if (written <= 0)
+            {
+                result = -1;
+                break;
+            }
+            bytes -= written;
+            *remaining -= written;
+        }
+        if (result < 0)
+        {
+            break;
+        }
+    }
+
+    close(pipeFD[0]);
+    close(pipeFD[1]);
+    return result;
+}
+
+//  Copy a range with pread and pwrite through a large buffer, returns 0 when done, -1 on error
+static int copyRangeWithPreadPwrite(int srcFD, int destFD, loff_t *offset, long long *remaining)
+{
+    char *buffer = malloc(COPY_BUFFER_SIZE);
+    if (buffer == NULL)
+    {
+        return -1;
+    }
+
+    int result = 0;
+    while (*remaining > 0)
+    {
+        ssize_t bytes = pread(srcFD, buffer, *remaining < COPY_BUFFER_SIZE ? *remaining : COPY_BUFFER_SIZE, *offset);
+        if (bytes < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (bytes <= 0)
+        {
+            result = bytes == 0 ? 0 : -1;
+            break;
+        }
+        for (ssize_t done = 0; done < bytes;)
+        {
+            ssize_t written = pwrite(destFD, buffer + done, bytes - done, *offset);
+            if (written < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            if (written <= 0)
+            {
+                result = -1;
+                break;
+            }
+            done += written;
+            *offset += written;
+            *remaining -= written;
+        }
+        if (result < 0)
+        {
+            break;
+        }
+    }
+
+    free(buffer);
+    return result;
+}
+
+//  Copy one range of a file without touching either file offset, so several workers can
+//  copy ranges of the same pair of descriptors at once. sendfile is skipped because it
+//  always writes at the destination's file offset.
+static long long copyDenseRange(int srcFD, int destFD, long long offset, long long length, copyPath *pathTaken)
+{
+    loff_t position = offset;
+    long long remaining = length;
+    struct file_clone_range range = {.src_fd = srcFD, .src_offset = offset, .src_length = length, .dest_offset = offset};
+    if (ioctl(destFD, FICLONERANGE, &range) == 0) // needs block-aligned ranges, the last one may end at EOF
+    {
+        *pathTaken = COPY_CLONE;
+        return length;
+    }
+    int result = copyRangeWithCopyFileRange(srcFD, destFD, &position, &remaining);
+    *pathTaken = COPY_FILE_RANGE;
+    if (result == 1)
+    {
+        result = copyRangeWithSplice(srcFD, destFD, &position, &remaining);
+        *pathTaken = COPY_SPLICE;
+    }
+    if (result == 1)
+    {
+        result = copyRangeWithPreadPwrite(srcFD, destFD, &position, &remaining);
+        *pathTaken = COPY_READ_WRITE;
+    }
+    return result < 0 ? -1 : length - remaining;
+}
+
+//  Read until length bytes or the end of the file, returns the bytes read or -1 on error
+static ssize_t preadFull(int fd, char *data, size_t length, long long offset)
+{
+    size_t done = 0;
+    while (done < length)
+    {
+        ssize_t bytes = pread(fd, data + done, length - done, offset + done);
+        if (bytes < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (bytes < 0)
+        {
+            return -1;
+        }
+        if (bytes == 0)
+        {
+            break;
+        }
+        done += bytes;
+    }
+    return done;
+}
+
+//  Bring one range of an existing destination in line with the source. Both files are
+//  local, so each block is compared directly instead of through checksums, and only the
+//  blocks that differ are written; the caller sets the destination's final size.
+static long long deltaDenseRange(int srcFD, int destFD, long long offset, long long length, long long *rewritten)
+{
+    *rewritten = 0;
+    char *srcBuffer = malloc(COPY_BUFFER_SIZE);
+    char *destBuffer = malloc(COPY_BUFFER_SIZE);
+    if (srcBuffer == NULL || destBuffer == NULL)
+    {
+        free(srcBuffer);
+        free(destBuffer);
+        return -1;
+    }
+
+    long long done = 0;
+    int result = 0;
+    while (done < length && result == 0)
+    {
+        size_t want = length - done < COPY_BUFFER_SIZE ? length - done : COPY_BUFFER_SIZE;
+        ssize_t got = preadFull(srcFD, srcBuffer, want, offset + done);
+        if (got <= 0)
+        {
+            result = got < 0 ? -1 : 0;
+            break; // 0 means the source shrank
+        }
+        ssize_t have = preadFull(destFD, destBuffer, got, offset + done); // short where the destination was shorter
+        if (have < 0)
+        {
+            have = 0; // unreadable, rewrite everything
+        }
+
+        for (ssize_t block = 0; block < got; block += COPY_DELTA_BLOCK)
+        {
+            ssize_t size = got - block < COPY_DELTA_BLOCK ? got - block : COPY_DELTA_BLOCK;
+            if (block + size <= have && memcmp(srcBuffer + block, destBuffer + block, size) == 0)
+            {
+                continue; // block unchanged
+            }
+            for (ssize_t written = 0; written < size;)
+            {
+                ssize_t bytes = pwrite(destFD, srcBuffer + block + written, size - written, offset + done + block + written);
+                if (bytes < 0 && errno == EINTR)
+                {
+                    continue;
+                }
+                if (bytes <= 0)
+                {
+                    result = -1;
+                    break;
+                }
+                written += bytes;
+            }
+            if (result < 0)
+            {
+                break;
+            }
+            *rewritten += size;
+        }
+        done += got;
+    }
+
+    free(srcBuffer);
+    free(destBuffer);
+    return result < 0 ? -1 : done;
+}
+
+//  Walk the data extents of one source range with SEEK_DATA and SEEK_HOLE and copy only
+//  those, or compare them when rewritten is given. Holes are skipped, and an existing
+//  destination gets them punched so it stays as sparse as the source. Both lseek calls
+//  return a position without the caller depending on the file offset they move, so
+//  workers sharing the descriptor are not disturbed. Returns the bytes of the range
+//  covered, short if the source shrank, or -1 on error.
+static long long copyExtents(int srcFD, int destFD, long long offset, long long length, copyPath *pathTaken, long long *rewritten, long long *holesSkipped)
+{
+    long long position = offset, end = offset + length, holes = 0;
+    struct stat statbuf;
+    if (fstat(srcFD, &statbuf) == 0 && statbuf.st_size < end)
+    {
+        end = statbuf.st_size > offset ? statbuf.st_size : offset; // the source shrank, ENXIO below must not pass for a hole
+    }
+    *pathTaken = rewritten != NULL ? COPY_DELTA : COPY_FILE_RANGE;
+    if (rewritten != NULL)
+    {
+        *rewritten = 0;
+    }
+    while (position < end)
+    {
+        off_t data = lseek(srcFD, position, SEEK_DATA);
+        if (data < 0 && errno == ENXIO)
+        {
+            data = end; // nothing but a hole up to the end of the file
+        }
+        else if (data < 0)
+        {
+            data = position; // no hole support, the rest is one extent
+        }
+        if (data > end)
+        {
+            data = end;
+        }
+        if (data > position)
+        {
+            if (rewritten != NULL)
+            {
+                fallocate(destFD, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, position, data - position); // best effort, zeros read the same
+            }
+            holes += data - position;
+            position = data;
+            if (position == end)
+            {
+                break;
+            }
+        }
+
+        off_t hole = lseek(srcFD, position, SEEK_HOLE);
+        if (hole < 0 || hole > end)
+        {
+            hole = end;
+        }
+        long long extent = hole - position, done;
+        if (rewritten != NULL)
+        {
+            long long changed = 0;
+            done = deltaDenseRange(srcFD, destFD, position, extent, &changed);
+            if (done >= 0)
+            {
+                *rewritten += changed;
+            }
+        }
+        else
+        {
+            done = copyDenseRange(srcFD, destFD, position, extent, pathTaken);
+        }
+        if (done < 0)
+        {
+            return -1;
+        }
+        position += done;
+        if (done < extent)
+        {
+            break; // the source shrank
+        }
+    }
+
+    pthread_mutex_lock(&statsMutex);
+    holeBytes += holes;
+    pthread_mutex_unlock(&statsMutex);
+    if (holesSkipped != NULL)
+    {
+        *holesSkipped = holes;
+    }
+    return position - offset;
+}
+
+long long copyRangeData(int srcFD, int destFD, long long offset, long long length, copyPath *pathTaken, long long *dataBytes)
+{
+    long long holes = 0;
+    long long copied = copyExtents(srcFD, destFD, offset, length, pathTaken, NULL, &holes);
+    *dataBytes = copied < 0 ? 0 : copied - holes;
+    return copied;
+}
+
+long long copyDeltaRange(int srcFD, int destFD, long long offset, long long length, long long *rewritten)
+{
+    copyPath path;
+    return copyExtents(srcFD, destFD, offset, length, &path, rewritten, NULL);
+}
+
+void copyStatsRecord(copyPath path, int files, long long bytes, double seconds)
+{
+    pthread_mutex_lock(&statsMutex);
+    pathFiles[path] += files;
+    pathBytes[path] += bytes;
+    pathSeconds[path] += seconds;
+    pthread_mutex_unlock(&statsMutex);
+}
+
+long long copyHoleBytes(void)
+{
+    pthread_mutex_lock(&statsMutex);
+    long long bytes = holeBytes;
+    pthread_mutex_unlock(&statsMutex);
+    return bytes;
+}
+
+void copyStatsReport(char *out, size_t size)
+{
+    size_t used = 0;
+    pthread_mutex_lock(&statsMutex);
+    for (int path = 0; path < COPY_PATH_COUNT && used < size; path++)
+    {
+        // Per-file time summed over workers, so this is the rate of one worker on that path
+        double rate = pathSeconds[path] > 0 ? pathBytes[path] / pathSeconds[path] / (1024 * 1024) : 0;
+        used += snprintf(out + used, size - used, "%-16s files: %lld bytes: %lld throughput: %.1f MB/s\n",
+                         copyPathNames[path], pathFiles[path], pathBytes[path], rate);
+    }
+    pthread_mutex_unlock(&statsMutex);
+}
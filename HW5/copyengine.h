@@ -0,0 +1,33 @@
+#ifndef COPYENGINE_H
+#define COPYENGINE_H
+
+#include <stddef.h>
+
+typedef enum // Ways a file's data can be moved, tried in this order
+{
+    COPY_CLONE,      // Share the source's extents (reflink), copy-on-write filesystems only
+    COPY_FILE_RANGE, // In-kernel copy, may share extents or offload to the device
+    COPY_SENDFILE,   // In-kernel copy through the page cache
+    COPY_SPLICE,     // In-kernel copy through a pipe
+    COPY_READ_WRITE, // User-space copy through a large buffer
+    COPY_IO_URING,   // Linked reads and writes through an io_uring, only with --engine uring
+    COPY_DELTA,      // Compare with the existing destination and rewrite the blocks that differ, only with --sync
+    COPY_PATH_COUNT
+} copyPath;
+
+#define COPY_BUFFER_SIZE (1 << 20) // Buffer size of the read/write fallback
+#define COPY_CHUNK (1L << 30)      // Largest request handed to one kernel copy call
+#define COPY_DELTA_BLOCK 65536     // Unit the delta copy compares and rewrites
+
+extern const char *copyPathNames[COPY_PATH_COUNT]; // Names used in reports
+
+// A source with holes is copied extent by extent (SEEK_DATA/SEEK_HOLE): holes are never
+// read or written, so they stay holes in the destination and cost no I/O.
+long long copyFileData(int srcFD, int destFD, copyPath *pathTaken, long long *dataBytes);             // Copy srcFD to a new destFD from the start, -1 on error; returns the size, dataBytes the bytes moved without holes
+long long copyRangeData(int srcFD, int destFD, long long offset, long long length, copyPath *pathTaken, long long *dataBytes); // Copy one range at the same offset in both files, -1 on error; the same two counts
+long long copyDeltaRange(int srcFD, int destFD, long long offset, long long length, long long *rewritten); // Rewrite the differing blocks of one range and punch its holes, -1 on error
+long long copyHoleBytes(void);                                                                       // Source bytes skipped as holes so far
+void copyStatsRecord(copyPath path, int files, long long bytes, double seconds);                       // Add files, bytes and copy time to the per-path statistics
+void copyStatsReport(char *out, size_t size);                        // Format the per-path statistics
+
+#endif
@@ -0,0 +1,90 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "contenthash.h"
+
+//  Purpose of this program is to check that every content hash backend gives the same
+//  digests and to measure how fast each one hashes a buffer that stays in cache and one
+//  that does not.
+
+#define BENCH_SMALL (256 * 1024)  // fits in the caches
+#define BENCH_LARGE (256 << 20)   // does not
+#define BENCH_BYTES (4LL << 30)   // bytes hashed per measurement
+
+//  Returns the current time in seconds
+static double nowSeconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(void)
+{
+    unsigned char *data = malloc(BENCH_LARGE);
+    if (data == NULL)
+    {
+        perror("malloc");
+        return 1;
+    }
+    srand(45);
+    for (size_t i = 0; i < BENCH_LARGE; i++)
+    {
+        data[i] = rand();
+    }
+
+    const char *backends[] = {"scalar", "sse2", "avx2"};
+    contentDigest reference[64];
+    for (int b = 0; b < 3; b++) // every length up to a few blocks, unaligned starts included
+    {
+        if (contentHashSetBackend(backends[b]) < 0)
+        {
+            continue;
+        }
+        for (int i = 0; i < 64; i++)
+        {
+            size_t length = i * 97 + i % 3;
+            contentDigest digest;
+            contentHashBuffer(data + i, length, &digest);
+            if (b == 0)
+            {
+                reference[i] = digest;
+            }
+            else if (memcmp(&digest, &reference[i], sizeof(digest)) != 0)
+            {
+                printf("%s differs from scalar at length %zu\n", backends[b], length);
+                return 1;
+            }
+        }
+    }
+
+    printf("%-8s %16s %16s\n", "backend", "GB/s in cache", "GB/s memory");
+    for (int b = 0; b < 3; b++)
+    {
+        if (contentHashSetBackend(backends[b]) < 0)
+        {
+            printf("%-8s %16s %16s\n", backends[b], "n/a", "n/a");
+            continue;
+        }
+        double rate[2];
+        size_t sizes[2] = {BENCH_SMALL, BENCH_LARGE};
+        unsigned long long sink = 0;
+        for (int s = 0; s < 2; s++)
+        {
+            long long rounds = BENCH_BYTES / sizes[s];
+            double start = nowSeconds();
+            for (long long r = 0; r < rounds; r++)
+            {
+                contentDigest digest;
+                contentHashBuffer(data, sizes[s], &digest);
+                sink += digest.low;
+            }
+            rate[s] = rounds * sizes[s] / (nowSeconds() - start) / 1e9;
+        }
+        printf("%-8s %16.2f %16.2f%s\n", backends[b], rate[0], rate[1], sink == 42 ? " " : "");
+    }
+    free(data);
+    return 0;
+}
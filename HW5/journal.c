@@ -0,0 +1,289 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <limits.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#include "journal.h"
+
+typedef struct //  A line of the previous run's journal
+{
+    const char *path; // destination path relative to the root, points into the loaded text
+    char kind;        // 'F' for a file, 'R' for a range
+    long long first;  // size of a file, offset of a range
+    long long second; // length of a range
+} journalEntry;
+
+static journalEntry *loaded = NULL;   // lines of the previous run, sorted by path, kind and offset
+static int loadedCount = 0;           // number of loaded lines
+static char *loadedText = NULL;       // contents of the previous journal, the paths point into it
+static int journalFD = -1;            // journal being appended to
+static int journalRootFD = -1;        // destination root the journal lives in
+static char pending[JOURNAL_FLUSH];   // lines not written yet
+static size_t pendingLength = 0;      // bytes in pending
+static time_t lastFlush = 0;          // time of the last write
+static journalStats stats;            // totals
+static pthread_mutex_t journalLock = PTHREAD_MUTEX_INITIALIZER; // mutex for the buffer and the totals
+
+//  Order lines by path, then kind, then offset
+static int compareEntries(const void *a, const void *b)
+{
+    const journalEntry *x = a, *y = b;
+    int order = strcmp(x->path, y->path);
+    if (order != 0)
+    {
+        return order;
+    }
+    if (x->kind != y->kind)
+    {
+        return x->kind - y->kind;
+    }
+    return (x->first > y->first) - (x->first < y->first);
+}
+
+//  Index of the first loaded line not ordered before key
+static int lowerBound(const journalEntry *key)
+{
+    int low = 0, high = loadedCount;
+    while (low < high)
+    {
+        int middle = (low + high) / 2;
+        if (compareEntries(&loaded[middle], key) < 0)
+        {
+            low = middle + 1;
+        }
+        else
+        {
+            high = middle;
+        }
+    }
+    return low;
+}
+
+//  Parse the lines in place, a torn last line from an interrupted write is ignored
+static void parseJournal(char *text, size_t length)
+{
+    int capacity = 0;
+    char *line = text, *end = text + length;
+    while (line < end)
+    {
+        char *newline = memchr(line, '\n', end - line);
+        if (newline == NULL)
+        {
+            break;
+        }
+        *newline = '\0';
+
+        journalEntry entry = {.kind = line[0], .second = 0};
+        int pathStart = 0;
+        int parsed = entry.kind == 'F' ? sscanf(line + 1, " %lld %n", &entry.first, &pathStart) == 1
+                   : entry.kind == 'R' ? sscanf(line + 1, " %lld %lld %n", &entry.first, &entry.second, &pathStart) == 2
+                                       : 0;
+        if (parsed && pathStart > 0 && line[1 + pathStart] != '\0')
+        {
+            if (loadedCount == capacity)
+            {
+                capacity = capacity ? capacity * 2 : 256;
+                journalEntry *grown = realloc(loaded, capacity * sizeof(journalEntry));
+                if (grown == NULL)
+                {
+                    perror("realloc");
+                    exit(EXIT_FAILURE);
+                }
+                loaded = grown;
+            }
+            entry.path = line + 1 + pathStart;
+            loaded[loadedCount++] = entry;
+        }
+        line = newline + 1;
+    }
+    qsort(loaded, loadedCount, sizeof(journalEntry), compareEntries);
+}
+
+//  Read the previous journal of the destination root, if there is one
+static void loadJournal(int rootFD)
+{
+    int fd = openat(rootFD, JOURNAL_NAME, O_RDONLY);
+    if (fd < 0)
+    {
+        return; // nothing was recorded, the resumed run copies everything
+    }
+    struct stat st;
+    if (fstat(fd, &st) == 0 && st.st_size > 0 && (loadedText = malloc(st.st_size)) != NULL)
+    {
+        size_t length = 0;
+        ssize_t bytes;
+        while (length < (size_t)st.st_size && (bytes = read(fd, loadedText + length, st.st_size - length)) != 0)
+        {
+            if (bytes < 0)
+            {
+                if (errno == EINTR)
+                {
+                    continue;
+                }
+                break;
+            }
+            length += bytes;
+        }
+        parseJournal(loadedText, length);
+    }
+    close(fd);
+    stats.loaded = loadedCount;
+}
+
+void journalOpen(int rootFD, int resume)
+{
+    if (resume)
+    {
+        loadJournal(rootFD);
+    }
+    journalRootFD = dup(rootFD);
+    journalFD = openat(rootFD, JOURNAL_NAME, O_WRONLY | O_CREAT | O_APPEND | (resume ? 0 : O_TRUNC), 0644);
+    if (journalFD < 0)
+    {
+        perror("journal"); // the copy still runs, it just cannot be resumed
+    }
+    lastFlush = time(NULL);
+}
+
+int journalFileDone(const char *path, long long size)
+{
+    journalEntry key = {.path = path, .kind = 'F', .first = size};
+    int index = lowerBound(&key);
+    return index < loadedCount && compareEntries(&loaded[index], &key) == 0;
+}
+
+int journalRangeDone(const char *path, long long offset, long long length)
+{
+    journalEntry key = {.path = path, .kind = 'R', .first = offset};
+    int index = lowerBound(&key);
+    return index < loadedCount && compareEntries(&loaded[index], &key) == 0 && loaded[index].second == length;
+}
+
+int journalHasRanges(const char *path)
+{
+    journalEntry key = {.path = path, .kind = 'R', .first = -1};
+    int index = lowerBound(&key);
+    return index < loadedCount && loaded[index].kind == 'R' && strcmp(loaded[index].path, path) == 0;
+}
+
+//  Write the buffered lines and sync them, the lock is held
+static void flushLocked(void)
+{
+    // The data of the files and ranges in the batch goes to disk before the lines that
+    // vouch for it; one syncfs covers the whole batch, the journal shares their filesystem
+    if (journalFD >= 0 && pendingLength > 0 && syncfs(journalFD) < 0)
+    {
+        perror("syncfs");
+    }
+    size_t written = 0;
+    while (journalFD >= 0 && written < pendingLength)
+    {
+        ssize_t bytes = write(journalFD, pending + written, pendingLength - written);
+        if (bytes < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (bytes <= 0)
+        {
+            perror("journal");
+            break;
+        }
+        written += bytes;
+    }
+    if (journalFD >= 0 && pendingLength > 0)
+    {
+        fdatasync(journalFD);
+        stats.flushes++;
+    }
+    pendingLength = 0;
+    lastFlush = time(NULL);
+}
+
+//  Buffer one line, writing the batch out when it is full or has waited long enough
+static void recordLine(const char *line, int length)
+{
+    if (journalFD < 0 || length <= 0)
+    {
+        return;
+    }
+    pthread_mutex_lock(&journalLock);
+    if (pendingLength + length > sizeof(pending))
+    {
+        flushLocked();
+    }
+    memcpy(pending + pendingLength, line, length);
+    pendingLength += length;
+    stats.records++;
+    if (time(NULL) - lastFlush >= JOURNAL_INTERVAL)
+    {
+        flushLocked();
+    }
+    pthread_mutex_unlock(&journalLock);
+}
+
+void journalRecordFile(const char *path, long long size)
+{
+    if (strchr(path, '\n') != NULL) // cannot be stored in a line, such files are always copied
+    {
+        return;
+    }
+    char line[PATH_MAX + 64];
+    int length = snprintf(line, sizeof(line), "F %lld %s\n", size, path);
+    if (length < (int)sizeof(line)) // a longer path is not recorded, that file is copied again
+    {
+        recordLine(line, length);
+    }
+}
+
+void journalRecordRange(const char *path, long long offset, long long length)
+{
+    if (strchr(path, '\n') != NULL)
+    {
+        return;
+    }
+    char line[PATH_MAX + 64];
+    int lineLength = snprintf(line, sizeof(line), "R %lld %lld %s\n", offset, length, path);
+    if (lineLength < (int)sizeof(line))
+    {
+        recordLine(line, lineLength);
+    }
+}
+
+void journalFlush(void)
+{
+    pthread_mutex_lock(&journalLock);
+    flushLocked();
+    pthread_mutex_unlock(&journalLock);
+}
+
+void journalClose(int complete)
+{
+    journalFlush();
+    if (journalFD >= 0 && close(journalFD) < 0)
+    {
+        perror("journal");
+    }
+    journalFD = -1;
+    if (complete && unlinkat(journalRootFD, JOURNAL_NAME, 0) < 0 && errno != ENOENT) // nothing left to resume
+    {
+        perror("journal");
+    }
+    close(journalRootFD);
+    free(loaded);
+    free(loadedText);
+}
+
+journalStats journalGetStats(void)
+{
+    pthread_mutex_lock(&journalLock);
+    journalStats totals = stats;
+    pthread_mutex_unlock(&journalLock);
+    return totals;
+}
@@ -0,0 +1,33 @@
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#define JOURNAL_NAME ".mwcp-journal" // kept in the destination root until a copy completes
+#define JOURNAL_FLUSH 65536           // bytes of records buffered before they are written
+#define JOURNAL_INTERVAL 1            // seconds a record may wait in the buffer at most
+
+// Checkpoint journal of one copy. Every finished file and every finished range of a
+// split file is appended as a line, "F size path" or "R offset length path", with the
+// path relative to the destination root. Lines are buffered and written in batches, so
+// an interruption loses at most the last batch, which the next run just copies again.
+// The destination filesystem is synced before every batch, so a line never reaches the
+// disk ahead of the data it records.
+// A resumed run loads the lines of the previous one and keeps appending to them.
+
+typedef struct // Totals of the journal
+{
+    long long records; // lines recorded in this run
+    long long flushes; // batched writes of those lines
+    long long loaded;  // lines loaded from the previous run
+} journalStats;
+
+void journalOpen(int rootFD, int resume);                                  // Start the journal, loading the previous one first when resuming
+int journalFileDone(const char *path, long long size);                     // 1 if the previous run finished the file at this size
+int journalRangeDone(const char *path, long long offset, long long length); // 1 if the previous run finished this range of the file
+int journalHasRanges(const char *path);                                    // 1 if the previous run finished any range of the file
+void journalRecordFile(const char *path, long long size);                  // Note a finished file
+void journalRecordRange(const char *path, long long offset, long long length); // Note a finished range of a split file
+void journalFlush(void);                                                   // Write the buffered lines out now
+void journalClose(int complete);                                           // Flush and close, removing the journal once the copy completed
+journalStats journalGetStats(void);                                        // Totals so far
+
+#endif
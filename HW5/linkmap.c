@@ -0,0 +1,162 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "linkmap.h"
+
+typedef struct linkEntry //  An inode or content seen in the source and where its data went
+{
+    unsigned long long key[3]; // device and inode, or digest and size
+    char *destPath;            // destination of the first file copied
+    char *srcPath;             // source of the first file, kept for contents only so a duplicate can be compared with it
+    struct linkEntry *next;    // next entry in the bucket
+} linkEntry;
+
+typedef struct //  One part of the map, a chained hash table with its own lock
+{
+    pthread_mutex_t lock; // mutex for this shard
+    linkEntry **buckets;  // bucket heads
+    size_t bucketCount;   // number of buckets, a power of two
+    size_t count;         // number of entries
+} linkShard;
+
+typedef struct //  A map of keys to the destination that claimed them first
+{
+    linkShard shards[LINK_MAP_SHARDS];
+} claimMap;
+
+static claimMap inodeMap;   // (st_dev, st_ino) of files with several links
+static claimMap contentMap; // (digest, size) of files hashed for deduplication
+static pthread_once_t shardsOnce = PTHREAD_ONCE_INIT;
+
+static void initShards(void)
+{
+    for (int i = 0; i < LINK_MAP_SHARDS; i++)
+    {
+        pthread_mutex_init(&inodeMap.shards[i].lock, NULL);
+        pthread_mutex_init(&contentMap.shards[i].lock, NULL);
+    }
+}
+
+//  Mix the key words, the low bits pick the shard and the rest the bucket
+static size_t hashKey(const unsigned long long key[3])
+{
+    unsigned long long hash = key[0] * 0x9E3779B97F4A7C15ULL ^ key[1] * 0xC2B2AE3D27D4EB4FULL ^ key[2] * 0x165667B19E3779F9ULL;
+    return hash ^ (hash >> 29);
+}
+
+//  Double the buckets of a shard once it holds two entries per bucket
+static void growShard(linkShard *shard)
+{
+    size_t bucketCount = shard->bucketCount ? shard->bucketCount * 2 : 256;
+    linkEntry **buckets = calloc(bucketCount, sizeof(linkEntry *));
+    if (buckets == NULL)
+    {
+        perror("calloc");
+        exit(EXIT_FAILURE);
+    }
+    for (size_t i = 0; i < shard->bucketCount; i++)
+    {
+        while (shard->buckets[i] != NULL)
+        {
+            linkEntry *entry = shard->buckets[i];
+            shard->buckets[i] = entry->next;
+            size_t bucket = (hashKey(entry->key) / LINK_MAP_SHARDS) & (bucketCount - 1);
+            entry->next = buckets[bucket];
+            buckets[bucket] = entry;
+        }
+    }
+    free(shard->buckets);
+    shard->buckets = buckets;
+    shard->bucketCount = bucketCount;
+}
+
+//  Claim a key, NULL for the first claim and otherwise the first claimer's destination and source
+static const char *claim(claimMap *map, const unsigned long long key[3], const char *destPath, const char *srcPath, const char **firstSource)
+{
+    pthread_once(&shardsOnce, initShards);
+    size_t hash = hashKey(key);
+    linkShard *shard = &map->shards[hash % LINK_MAP_SHARDS];
+
+    pthread_mutex_lock(&shard->lock);
+    if (shard->count >= 2 * shard->bucketCount)
+    {
+        growShard(shard);
+    }
+    size_t bucket = (hash / LINK_MAP_SHARDS) & (shard->bucketCount - 1);
+    for (linkEntry *entry = shard->buckets[bucket]; entry != NULL; entry = entry->next)
+    {
+        if (memcmp(entry->key, key, sizeof(entry->key)) == 0)
+        {
+            pthread_mutex_unlock(&shard->lock);
+            if (firstSource != NULL)
+            {
+                *firstSource = entry->srcPath;
+            }
+            return entry->destPath; // never changes or moves once stored
+        }
+    }
+
+    linkEntry *entry = malloc(sizeof(linkEntry));
+    if (entry == NULL || (entry->destPath = strdup(destPath)) == NULL || (srcPath != NULL && (entry->srcPath = strdup(srcPath)) == NULL))
+    {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+    if (srcPath == NULL)
+    {
+        entry->srcPath = NULL;
+    }
+    memcpy(entry->key, key, sizeof(entry->key));
+    entry->next = shard->buckets[bucket];
+    shard->buckets[bucket] = entry;
+    shard->count++;
+    pthread_mutex_unlock(&shard->lock);
+    return NULL;
+}
+
+const char *linkMapClaim(dev_t dev, ino_t ino, const char *destPath)
+{
+    unsigned long long key[3] = {dev, ino, 0};
+    return claim(&inodeMap, key, destPath, NULL, NULL);
+}
+
+const char *contentMapClaim(const contentDigest *digest, long long size, const char *destPath, const char *srcPath, const char **firstSource)
+{
+    unsigned long long key[3] = {digest->low, digest->high, size};
+    return claim(&contentMap, key, destPath, srcPath, firstSource);
+}
+
+//  Free every entry of a map
+static void clearMap(claimMap *map)
+{
+    for (int i = 0; i < LINK_MAP_SHARDS; i++)
+    {
+        linkShard *shard = &map->shards[i];
+        pthread_mutex_lock(&shard->lock);
+        for (size_t b = 0; b < shard->bucketCount; b++)
+        {
+            while (shard->buckets[b] != NULL)
+            {
+                linkEntry *entry = shard->buckets[b];
+                shard->buckets[b] = entry->next;
+                free(entry->destPath);
+                free(entry->srcPath);
+                free(entry);
+            }
+        }
+        free(shard->buckets);
+        shard->buckets = NULL;
+        shard->bucketCount = 0;
+        shard->count = 0;
+        pthread_mutex_unlock(&shard->lock);
+    }
+}
+
+void linkMapClear(void)
+{
+    pthread_once(&shardsOnce, initShards);
+    clearMap(&inodeMap);
+    clearMap(&contentMap);
+}
@@ -0,0 +1,14 @@
+#ifndef LINKMAP_H
+#define LINKMAP_H
+
+#include <sys/types.h>
+
+#include "contenthash.h"
+
+#define LINK_MAP_SHARDS 64 // independently locked parts of the map
+
+const char *linkMapClaim(dev_t dev, ino_t ino, const char *destPath);                            // NULL for the first claim of an inode, which copies it; later claims get the first one's destination
+const char *contentMapClaim(const contentDigest *digest, long long size, const char *destPath, const char *srcPath, const char **firstSource); // The same for a file content, keyed by digest and size; firstSource gets the first file's source to compare with
+void linkMapClear(void);                                                                        // Forget every inode and content
+
+#endif
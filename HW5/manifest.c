@@ -0,0 +1,157 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+
+#include "manifest.h"
+
+//  Order entries by name for bsearch
+static int compareEntries(const void *a, const void *b)
+{
+    return strcmp(((const manifestEntry *)a)->name, ((const manifestEntry *)b)->name);
+}
+
+//  Parse "size seconds nanoseconds name" lines in place, the names stay in the text
+static void parseManifest(manifest *list, char *text, size_t length)
+{
+    int capacity = 0;
+    char *line = text, *end = text + length;
+    while (line < end)
+    {
+        char *newline = memchr(line, '\n', end - line);
+        if (newline == NULL)
+        {
+            break; // a torn last line is ignored
+        }
+        *newline = '\0';
+
+        manifestEntry entry;
+        int nameStart = 0;
+        if (sscanf(line, "%lld %lld %ld %n", &entry.size, &entry.seconds, &entry.nanoseconds, &nameStart) == 3 && nameStart > 0 && line[nameStart] != '\0')
+        {
+            if (list->loadedCount == capacity)
+            {
+                capacity = capacity ? capacity * 2 : 64;
+                manifestEntry *grown = realloc(list->loaded, capacity * sizeof(manifestEntry));
+                if (grown == NULL)
+                {
+                    perror("realloc");
+                    exit(EXIT_FAILURE);
+                }
+                list->loaded = grown;
+            }
+            entry.name = line + nameStart;
+            list->loaded[list->loadedCount++] = entry;
+        }
+        line = newline + 1;
+    }
+    qsort(list->loaded, list->loadedCount, sizeof(manifestEntry), compareEntries);
+}
+
+manifest *manifestLoad(int dirFD)
+{
+    manifest *list = calloc(1, sizeof(manifest));
+    if (list == NULL)
+    {
+        perror("calloc");
+        exit(EXIT_FAILURE);
+    }
+    pthread_mutex_init(&list->lock, NULL);
+
+    int fd = openat(dirFD, MANIFEST_NAME, O_RDONLY);
+    if (fd < 0)
+    {
+        return list; // first sync of this directory
+    }
+    struct stat st;
+    if (fstat(fd, &st) == 0 && st.st_size > 0 && (list->text = malloc(st.st_size)) != NULL)
+    {
+        size_t length = 0;
+        ssize_t bytes;
+        while (length < (size_t)st.st_size && (bytes = read(fd, list->text + length, st.st_size - length)) != 0)
+        {
+            if (bytes < 0)
+            {
+                if (errno == EINTR)
+                {
+                    continue;
+                }
+                break;
+            }
+            length += bytes;
+        }
+        parseManifest(list, list->text, length);
+    }
+    close(fd);
+    return list;
+}
+
+int manifestLookup(const manifest *list, const char *name, const struct stat *st)
+{
+    manifestEntry key = {.name = name};
+    const manifestEntry *entry = bsearch(&key, list->loaded, list->loadedCount, sizeof(manifestEntry), compareEntries);
+    return entry != NULL && entry->size == st->st_size && entry->seconds == st->st_mtim.tv_sec && entry->nanoseconds == st->st_mtim.tv_nsec;
+}
+
+void manifestRecord(manifest *list, const char *name, const struct stat *st)
+{
+    if (strchr(name, '\n') != NULL) // cannot be stored in a line, such files are always checked
+    {
+        return;
+    }
+    pthread_mutex_lock(&list->lock);
+    if (list->freshCount == list->freshCapacity)
+    {
+        list->freshCapacity = list->freshCapacity ? list->freshCapacity * 2 : 64;
+        manifestEntry *grown = realloc(list->fresh, list->freshCapacity * sizeof(manifestEntry));
+        if (grown == NULL)
+        {
+            perror("realloc");
+            exit(EXIT_FAILURE);
+        }
+        list->fresh = grown;
+    }
+    list->fresh[list->freshCount++] = (manifestEntry){name, st->st_size, st->st_mtim.tv_sec, st->st_mtim.tv_nsec};
+    pthread_mutex_unlock(&list->lock);
+}
+
+void manifestSave(manifest *list, int dirFD)
+{
+    // Files that were not recorded (removed, failed, changed during the copy) drop out,
+    // so the next run checks them again. A new file is renamed over the old one so a
+    // crash never leaves a half-written manifest.
+    if (list->freshCount > 0 || list->loadedCount > 0)
+    {
+        int fd = openat(dirFD, MANIFEST_NAME ".tmp", O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        FILE *out = fd < 0 ? NULL : fdopen(fd, "w");
+        if (out == NULL)
+        {
+            perror("manifest");
+            if (fd >= 0)
+            {
+                close(fd);
+            }
+        }
+        else
+        {
+            for (int i = 0; i < list->freshCount; i++)
+            {
+                manifestEntry *entry = &list->fresh[i];
+                fprintf(out, "%lld %lld %ld %s\n", entry->size, entry->seconds, entry->nanoseconds, entry->name);
+            }
+            if (fclose(out) != 0 || renameat(dirFD, MANIFEST_NAME ".tmp", dirFD, MANIFEST_NAME) != 0)
+            {
+                perror("manifest");
+            }
+        }
+    }
+
+    pthread_mutex_destroy(&list->lock);
+    free(list->loaded);
+    free(list->text);
+    free(list->fresh);
+    free(list);
+}
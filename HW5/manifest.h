@@ -0,0 +1,33 @@
+#ifndef MANIFEST_H
+#define MANIFEST_H
+
+#include <pthread.h>
+#include <sys/stat.h>
+
+#define MANIFEST_NAME ".mwcp-manifest" // kept in every destination directory by sync mode
+
+typedef struct //  Source size and modification time of a file when it was last brought in sync
+{
+    const char *name;  // entry name
+    long long size;    // source size
+    long long seconds; // source modification time
+    long nanoseconds;  // sub-second part of it
+} manifestEntry;
+
+typedef struct //  The manifest of one destination directory
+{
+    manifestEntry *loaded;  // entries of the previous run, sorted by name, read only
+    int loadedCount;        // number of loaded entries
+    char *text;             // contents of the file, the loaded names point into it
+    manifestEntry *fresh;   // entries recorded in this run
+    int freshCount;         // number of fresh entries
+    int freshCapacity;      // size of the fresh array
+    pthread_mutex_t lock;   // mutex for the fresh entries, workers record concurrently
+} manifest;
+
+manifest *manifestLoad(int dirFD);                                           // Read the manifest of a directory, empty if it has none
+int manifestLookup(const manifest *list, const char *name, const struct stat *st); // 1 if the last run saw the file with this size and time
+void manifestRecord(manifest *list, const char *name, const struct stat *st);      // Note a file in sync, name must outlive the manifest
+void manifestSave(manifest *list, int dirFD);                                // Replace the directory's manifest with the fresh entries and free it
+
+#endif
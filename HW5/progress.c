@@ -0,0 +1,253 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <ftw.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#include "progress.h"
+
+static progressCounters *blocks = NULL;     // workers first, then the other threads in order of first use
+static int workerCount = 0;                 // blocks reserved for workers
+static int blockCount = 0;                  // blocks in total
+static int nextBlock = 0;                   // next block for a thread that is not a worker
+static __thread progressCounters *self = NULL; // block of the calling thread
+
+static double interval = 1;                 // seconds between reports
+static int jsonOutput = 0;                  // flag to print JSON lines instead of text
+static int stopping = 0;                    // flag to make the reporter print its last report
+static pthread_t reporterThread;            // the reporter
+static int reporterRunning = 0;             // flag to indicate the reporter was started
+static pthread_mutex_t reportLock = PTHREAD_MUTEX_INITIALIZER; // mutex for stopping
+static pthread_cond_t reportWake = PTHREAD_COND_INITIALIZER;   // wakes the reporter early to stop
+
+static const char *sizeRoot = NULL;         // source root the sizer walks
+static long long sizeTotal = 0;             // bytes of regular files under it, summed by the sizer
+static int sizeKnown = 0;                   // flag set once the sizer is done, the ETA needs the total
+
+void progressInit(int workers, int others)
+{
+    workerCount = workers;
+    blockCount = workers + others + 1; // the last block is shared by any thread beyond others
+    blocks = aligned_alloc(PROGRESS_LINE, sizeof(progressCounters) * blockCount);
+    if (blocks == NULL)
+    {
+        perror("aligned_alloc");
+        exit(EXIT_FAILURE);
+    }
+    memset(blocks, 0, sizeof(progressCounters) * blockCount);
+    nextBlock = workers;
+}
+
+void progressBindWorker(int index)
+{
+    self = &blocks[index];
+}
+
+progressCounters *progressSelf(void)
+{
+    if (self == NULL)
+    {
+        int index = __atomic_fetch_add(&nextBlock, 1, __ATOMIC_RELAXED);
+        self = &blocks[index < blockCount ? index : blockCount - 1];
+    }
+    return self;
+}
+
+progressCounters progressTotals(void)
+{
+    progressCounters sum = {0};
+    for (int i = 0; i < blockCount; i++)
+    {
+        sum.bytes += __atomic_load_n(&blocks[i].bytes, __ATOMIC_RELAXED);
+        sum.regular += __atomic_load_n(&blocks[i].regular, __ATOMIC_RELAXED);
+        sum.fifo += __atomic_load_n(&blocks[i].fifo, __ATOMIC_RELAXED);
+        sum.dirs += __atomic_load_n(&blocks[i].dirs, __ATOMIC_RELAXED);
+        sum.settled += __atomic_load_n(&blocks[i].settled, __ATOMIC_RELAXED);
+        sum.busyMicros += __atomic_load_n(&blocks[i].busyMicros, __ATOMIC_RELAXED);
+        sum.srcAllocated += __atomic_load_n(&blocks[i].srcAllocated, __ATOMIC_RELAXED);
+        sum.destAllocated += __atomic_load_n(&blocks[i].destAllocated, __ATOMIC_RELAXED);
+    }
+    return sum;
+}
+
+//  Returns the current time in seconds
+static double nowSeconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+//  Add up one entry for the sizer
+static int sizeEntry(const char *path, const struct stat *st, int type, struct FTW *ftw)
+{
+    (void)path;
+    (void)ftw;
+    if (type == FTW_F && S_ISREG(st->st_mode))
+    {
+        sizeTotal += st->st_size;
+    }
+    return 0;
+}
+
+//  Sum the size of the source tree alongside the copy, so the reports can give an ETA.
+//  The walkers never stat regular files, so this is the only place the total comes from.
+static void *sizer(void *arg)
+{
+    (void)arg;
+    if (nftw(sizeRoot, sizeEntry, 64, FTW_PHYS) == 0)
+    {
+        __atomic_store_n(&sizeKnown, 1, __ATOMIC_RELEASE);
+    }
+    return NULL;
+}
+
+//  Print one report: rates over the last interval, the share of the total done once it is
+//  known, and how much of the interval each worker spent on items
+static void report(double elapsed, double seconds, const progressCounters *now, const progressCounters *last, long long *lastBusy, int final)
+{
+    long long files = now->regular + now->fifo;
+    double filesRate = seconds > 0 ? (files - last->regular - last->fifo) / seconds : 0;
+    double bytesRate = seconds > 0 ? (now->bytes - last->bytes) / seconds : 0;
+    int known = __atomic_load_n(&sizeKnown, __ATOMIC_ACQUIRE);
+    long long total = known ? sizeTotal : -1;
+    long long handled = now->bytes + now->settled;
+    double percent = total > 0 ? 100.0 * (handled < total ? handled : total) / total : (known ? 100 : -1);
+    double average = elapsed > 0 ? now->bytes / elapsed : 0;
+    double eta = !known ? -1 : final ? 0 : average > 0 ? (total > handled ? total - handled : 0) / average : -1;
+
+    char line[4096];
+    size_t used = 0;
+    if (jsonOutput)
+    {
+        used += snprintf(line + used, sizeof(line) - used, "{\"elapsed\":%.3f,\"files\":%lld,\"directories\":%lld,\"bytes\":%lld,\"filesPerSecond\":%.1f,\"bytesPerSecond\":%.0f,",
+                         elapsed, files, now->dirs, now->bytes, filesRate, bytesRate);
+        if (known)
+        {
+            used += snprintf(line + used, sizeof(line) - used, "\"totalBytes\":%lld,\"percent\":%.1f,", total, percent);
+            used += snprintf(line + used, sizeof(line) - used, eta >= 0 ? "\"eta\":%.1f," : "\"eta\":null,", eta);
+        }
+        else
+        {
+            used += snprintf(line + used, sizeof(line) - used, "\"totalBytes\":null,\"percent\":null,\"eta\":null,");
+        }
+        used += snprintf(line + used, sizeof(line) - used, "\"workers\":[");
+    }
+    else
+    {
+        used += snprintf(line + used, sizeof(line) - used, "Progress: %02ld:%02ld - %lld files (%.1f/s) - %.1f MB (%.1f MB/s)",
+                         (long)elapsed / 60, (long)elapsed % 60, files, filesRate, now->bytes / 1048576.0, bytesRate / 1048576.0);
+        if (eta >= 0)
+        {
+            used += snprintf(line + used, sizeof(line) - used, " - %.0f%% - ETA %02ld:%02ld", percent, (long)eta / 60, (long)eta % 60);
+        }
+        else
+        {
+            used += snprintf(line + used, sizeof(line) - used, known ? " - ETA: unknown" : " - ETA: sizing source");
+        }
+        used += snprintf(line + used, sizeof(line) - used, " - Workers:");
+    }
+
+    for (int i = 0; i < workerCount && used < sizeof(line); i++)
+    {
+        long long busy = __atomic_load_n(&blocks[i].busyMicros, __ATOMIC_RELAXED);
+        double utilisation = seconds > 0 ? (busy - lastBusy[i]) / 1e6 / seconds : 0;
+        utilisation = utilisation > 1 ? 1 : utilisation; // an item's time is added when it ends
+        lastBusy[i] = busy;
+        used += snprintf(line + used, sizeof(line) - used, jsonOutput ? "%s%.2f" : "%s %.0f%%", jsonOutput && i > 0 ? "," : "", jsonOutput ? utilisation : 100 * utilisation);
+    }
+    if (used < sizeof(line) && jsonOutput)
+    {
+        snprintf(line + used, sizeof(line) - used, "],\"done\":%s}\n", final ? "true" : "false");
+    }
+    else if (used < sizeof(line))
+    {
+        snprintf(line + used, sizeof(line) - used, "\n");
+    }
+    fputs(line, stderr);
+}
+
+//  Wake up every interval and report, until progressStop
+static void *reporter(void *arg)
+{
+    (void)arg;
+    pthread_t sizerThread;
+    if (pthread_create(&sizerThread, NULL, sizer, NULL) == 0)
+    {
+        pthread_detach(sizerThread); // a copy that ends first does not wait for it
+    }
+
+    long long *lastBusy = calloc(workerCount, sizeof(long long));
+    if (lastBusy == NULL)
+    {
+        perror("calloc");
+        return NULL;
+    }
+    double start = nowSeconds(), lastTime = start;
+    progressCounters last = {0};
+    struct timespec wake;
+    clock_gettime(CLOCK_REALTIME, &wake);
+
+    pthread_mutex_lock(&reportLock);
+    while (1)
+    {
+        wake.tv_sec += (time_t)interval;
+        wake.tv_nsec += (long)((interval - (time_t)interval) * 1e9);
+        if (wake.tv_nsec >= 1000000000L)
+        {
+            wake.tv_sec++;
+            wake.tv_nsec -= 1000000000L;
+        }
+        while (!stopping && pthread_cond_timedwait(&reportWake, &reportLock, &wake) != ETIMEDOUT)
+        {
+        }
+        int final = stopping;
+        pthread_mutex_unlock(&reportLock);
+
+        double now = nowSeconds();
+        progressCounters totals = progressTotals();
+        report(now - start, now - lastTime, &totals, &last, lastBusy, final);
+        last = totals;
+        lastTime = now;
+
+        pthread_mutex_lock(&reportLock);
+        if (final)
+        {
+            break;
+        }
+    }
+    pthread_mutex_unlock(&reportLock);
+    free(lastBusy);
+    return NULL;
+}
+
+void progressStart(double seconds, int json, const char *srcRoot)
+{
+    interval = seconds;
+    jsonOutput = json;
+    sizeRoot = srcRoot;
+    if (pthread_create(&reporterThread, NULL, reporter, NULL) != 0)
+    {
+        perror("pthread_create progress");
+        return;
+    }
+    reporterRunning = 1;
+}
+
+void progressStop(void)
+{
+    if (!reporterRunning)
+    {
+        return;
+    }
+    pthread_mutex_lock(&reportLock);
+    stopping = 1;
+    pthread_cond_signal(&reportWake);
+    pthread_mutex_unlock(&reportLock);
+    pthread_join(reporterThread, NULL);
+    reporterRunning = 0;
+}
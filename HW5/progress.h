@@ -0,0 +1,32 @@
+#ifndef PROGRESS_H
+#define PROGRESS_H
+
+#define PROGRESS_LINE 64 // bytes per counter block, a cache line, so no two threads write to one line
+
+typedef struct // Counters of one thread; only that thread adds to them, anyone may read them
+{
+    long long bytes;         // bytes copied
+    long long regular;       // regular files finished
+    long long fifo;          // FIFO files made
+    long long dirs;          // directories made
+    long long settled;       // bytes of files handled without a copy: unchanged, resumed, linked, deduplicated
+    long long busyMicros;    // time spent on items, workers only
+    long long srcAllocated;  // bytes allocated on disk by the copied source files
+    long long destAllocated; // bytes allocated on disk by their copies
+} __attribute__((aligned(PROGRESS_LINE))) progressCounters;
+
+void progressInit(int workers, int others);  // Counter blocks for every worker and for up to others threads more
+void progressBindWorker(int index);          // The calling worker uses its own block, so the report can show it
+progressCounters *progressSelf(void);        // Block of the calling thread, assigned on first use
+progressCounters progressTotals(void);       // Sum over every block
+void progressStart(double interval, int json, const char *srcRoot); // Report every interval seconds on stderr, as text or JSON lines
+void progressStop(void);                     // Print the last report and stop the reporter
+
+// Add to a counter of the calling thread's block. Relaxed, the reporter only needs a
+// recent value, and a block shared by overflow threads still adds up.
+static inline void progressAdd(long long *counter, long long value)
+{
+    __atomic_fetch_add(counter, value, __ATOMIC_RELAXED);
+}
+
+#endif
@@ -0,0 +1,141 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <time.h>
+
+#include "walker.h"
+
+//  Purpose of this program is to compare the cost of the work queue items.
+//  The old item carried both full paths (two PATH_MAX arrays, about 8 KB) and was filled
+//  with snprintf; the new one is a small header whose name lives in the directory's arena.
+//  Both are pushed through a ring buffer of the same size as in MWCp, for FILES names
+//  spread over DIRS directories.
+
+#define FILES 1000000
+#define DIRS 1000
+#define RING_SIZE 1024
+
+typedef struct //  The item before arenas
+{
+    int srcFD;
+    int destFD;
+    char srcName[PATH_MAX];
+    char destName[PATH_MAX];
+    int isFifo;
+    int isDir;
+} oldItem;
+
+typedef struct //  The item with arenas, same layout as filePairStruct
+{
+    dirHandle *dir;
+    const char *name;
+    void *job;
+    long long offset;
+    long long length;
+    unsigned char isFifo;
+    unsigned char isDir;
+} newItem;
+
+//  Returns the current time in nanoseconds
+static double nowNs(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+int main(void)
+{
+    static char names[DIRS][32];
+    dirHandle *dirs[DIRS];
+    for (int d = 0; d < DIRS; d++)
+    {
+        dirs[d] = calloc(1, sizeof(dirHandle));
+        dirs[d]->srcFD = dirs[d]->destFD = -1;
+        dirs[d]->refs = 1;
+        dirs[d]->srcPath = malloc(64);
+        dirs[d]->destPath = malloc(64);
+        snprintf(dirs[d]->srcPath, 64, "/tmp/mwcp-tree/d%04d", d);
+        snprintf(dirs[d]->destPath, 64, "/tmp/mwcp-copy/d%04d", d);
+        snprintf(names[d], sizeof(names[d]), "file%04d", d);
+    }
+
+    oldItem *oldRing = malloc(sizeof(oldItem) * RING_SIZE);
+    newItem *newRing = malloc(sizeof(newItem) * RING_SIZE);
+    char name[NAME_MAX + 1];
+    long long checksum = 0;
+    double oldPush = 0, oldPop = 0, newPush = 0, newPop = 0;
+
+    //  Old layout: build both paths into the slot, copy the whole item out
+    for (int base = 0; base < FILES; base += RING_SIZE)
+    {
+        int count = FILES - base < RING_SIZE ? FILES - base : RING_SIZE;
+        double start = nowNs();
+        for (int i = 0; i < count; i++)
+        {
+            int file = base + i, d = file % DIRS;
+            snprintf(name, sizeof(name), "%s-%d", names[d], file);
+            oldItem *slot = &oldRing[i];
+            slot->srcFD = slot->destFD = -1;
+            snprintf(slot->srcName, PATH_MAX, "%s/%s", dirs[d]->srcPath, name);
+            snprintf(slot->destName, PATH_MAX, "%s/%s", dirs[d]->destPath, name);
+            slot->isFifo = slot->isDir = 0;
+        }
+        double middle = nowNs();
+        for (int i = 0; i < count; i++)
+        {
+            oldItem item = oldRing[i];
+            checksum += item.srcName[strlen(item.srcName) - 1];
+        }
+        double end = nowNs();
+        oldPush += middle - start;
+        oldPop += end - middle;
+    }
+
+    //  New layout: intern the name, fill the header, copy the header out
+    for (int base = 0; base < FILES; base += RING_SIZE)
+    {
+        int count = FILES - base < RING_SIZE ? FILES - base : RING_SIZE;
+        double start = nowNs();
+        for (int i = 0; i < count; i++)
+        {
+            int file = base + i, d = file % DIRS;
+            snprintf(name, sizeof(name), "%s-%d", names[d], file);
+            newItem *slot = &newRing[i];
+            slot->dir = dirs[d];
+            slot->name = dirHandleIntern(dirs[d], name);
+            slot->job = NULL;
+            slot->offset = slot->length = 0;
+            slot->isFifo = slot->isDir = 0;
+        }
+        double middle = nowNs();
+        for (int i = 0; i < count; i++)
+        {
+            newItem item = newRing[i];
+            checksum += item.name[strlen(item.name) - 1];
+        }
+        double end = nowNs();
+        newPush += middle - start;
+        newPop += end - middle;
+    }
+
+    long long arenaBytes = 0;
+    for (int d = 0; d < DIRS; d++)
+    {
+        for (nameChunk *chunk = dirs[d]->names; chunk != NULL; chunk = chunk->next)
+        {
+            arenaBytes += sizeof(nameChunk) + chunk->size;
+        }
+        dirHandleRelease(dirs[d]);
+    }
+
+    printf("%d files in %d directories, ring of %d items (checksum %lld)\n", FILES, DIRS, RING_SIZE, checksum);
+    printf("%-8s %14s %14s %18s %14s\n", "layout", "enqueue ns", "dequeue ns", "bytes per file", "ring bytes");
+    printf("%-8s %14.1f %14.1f %18zu %14zu\n", "paths", oldPush / FILES, oldPop / FILES, sizeof(oldItem), sizeof(oldItem) * RING_SIZE);
+    printf("%-8s %14.1f %14.1f %18.1f %14zu\n", "arena", newPush / FILES, newPop / FILES, sizeof(newItem) + (double)arenaBytes / FILES, sizeof(newItem) * RING_SIZE);
+
+    free(oldRing);
+    free(newRing);
+    return 0;
+}
@@ -0,0 +1,385 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <linux/io_uring.h>
+
+#include "uringengine.h"
+
+typedef struct //  One buffer and the read->write pair using it
+{
+    int task;         // task the pair belongs to
+    long long offset; // offset of the pair in both files
+    unsigned length;  // bytes asked of the read
+    int readRes;      // result of the read
+    int writeRes;     // result of the write
+    int pending;      // completions not reaped yet
+} uringSlot;
+
+struct uringEngine
+{
+    int ringFD;                 // io_uring file descriptor
+    unsigned depth;             // number of slots
+    size_t ioSize;              // bytes per slot buffer
+    unsigned *sqTail;           // submission ring tail, written by us
+    unsigned sqMask;            // submission ring index mask
+    unsigned localTail;         // tail including entries not published yet
+    unsigned toSubmit;          // entries published but not handed to the kernel
+    struct io_uring_sqe *sqes;  // submission entries
+    unsigned *cqHead;           // completion ring head, written by us
+    unsigned *cqTail;           // completion ring tail, written by the kernel
+    unsigned cqMask;            // completion ring index mask
+    struct io_uring_cqe *cqes;  // completion entries
+    void *sqRing;               // mapping of the submission ring
+    size_t sqRingSize;          // size of that mapping
+    void *cqRing;               // mapping of the completion ring
+    size_t cqRingSize;          // size of that mapping
+    size_t sqesSize;            // size of the submission entry mapping
+    char *buffers;              // depth buffers of ioSize bytes, registered when possible
+    int fixedBuffers;           // flag to indicate the buffers are registered
+    int fixedFiles;             // flag to indicate the file table is registered
+    uringSlot *slots;           // one per buffer
+    int *freeSlots;             // stack of idle slots
+    long long *cursor;          // next offset to read of each task
+    int *fileTable;             // descriptors for IORING_REGISTER_FILES_UPDATE, two per task
+};
+
+//  Thin wrappers, glibc has no io_uring functions
+static int uringSetup(unsigned entries, struct io_uring_params *params)
+{
+    return syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int uringEnter(int ringFD, unsigned toSubmit, unsigned minComplete, unsigned flags)
+{
+    return syscall(__NR_io_uring_enter, ringFD, toSubmit, minComplete, flags, NULL, 0);
+}
+
+static int uringRegister(int ringFD, unsigned opcode, void *arg, unsigned count)
+{
+    return syscall(__NR_io_uring_register, ringFD, opcode, arg, count);
+}
+
+uringEngine *uringCreate(unsigned depth, size_t ioSize)
+{
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    int ringFD = uringSetup(2 * depth, &params); // a read and a write per slot
+    if (ringFD < 0)
+    {
+        return NULL;
+    }
+
+    uringEngine *ring = calloc(1, sizeof(uringEngine));
+    if (ring == NULL)
+    {
+        close(ringFD);
+        return NULL;
+    }
+    ring->ringFD = ringFD;
+    ring->depth = depth;
+    ring->ioSize = ioSize;
+
+    ring->sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring->cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    ring->sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqRing = mmap(NULL, ring->sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFD, IORING_OFF_SQ_RING);
+    ring->cqRing = mmap(NULL, ring->cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFD, IORING_OFF_CQ_RING);
+    ring->sqes = mmap(NULL, ring->sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFD, IORING_OFF_SQES);
+    ring->slots = calloc(depth, sizeof(uringSlot));
+    ring->freeSlots = calloc(depth, sizeof(int));
+    ring->cursor = calloc(depth, sizeof(long long));
+    ring->fileTable = calloc(2 * depth, sizeof(int));
+    if (ring->sqRing == MAP_FAILED || ring->cqRing == MAP_FAILED || ring->sqes == MAP_FAILED || ring->slots == NULL ||
+        ring->freeSlots == NULL || ring->cursor == NULL || ring->fileTable == NULL ||
+        posix_memalign((void **)&ring->buffers, 4096, depth * ioSize) != 0)
+    {
+        uringDestroy(ring);
+        return NULL;
+    }
+
+    char *sq = ring->sqRing, *cq = ring->cqRing;
+    ring->sqTail = (unsigned *)(sq + params.sq_off.tail);
+    ring->sqMask = *(unsigned *)(sq + params.sq_off.ring_mask);
+    ring->localTail = *ring->sqTail;
+    unsigned *sqArray = (unsigned *)(sq + params.sq_off.array);
+    for (unsigned i = 0; i < params.sq_entries; i++) // entry i always sits in array slot i
+    {
+        sqArray[i] = i;
+    }
+    ring->cqHead = (unsigned *)(cq + params.cq_off.head);
+    ring->cqTail = (unsigned *)(cq + params.cq_off.tail);
+    ring->cqMask = *(unsigned *)(cq + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *)(cq + params.cq_off.cqes);
+
+    // Registered buffers are pinned once instead of on every I/O, and registered files skip
+    // the descriptor lookup; either can fail (memlock limit, old kernel) and is then skipped
+    struct iovec *iovecs = malloc(depth * sizeof(struct iovec));
+    if (iovecs != NULL)
+    {
+        for (unsigned i = 0; i < depth; i++)
+        {
+            iovecs[i].iov_base = ring->buffers + i * ioSize;
+            iovecs[i].iov_len = ioSize;
+        }
+        ring->fixedBuffers = uringRegister(ringFD, IORING_REGISTER_BUFFERS, iovecs, depth) == 0;
+        free(iovecs);
+    }
+    for (unsigned i = 0; i < 2 * depth; i++)
+    {
+        ring->fileTable[i] = -1; // empty entries, filled per batch
+    }
+    ring->fixedFiles = uringRegister(ringFD, IORING_REGISTER_FILES, ring->fileTable, 2 * depth) == 0;
+    return ring;
+}
+
+int uringMaxTasks(const uringEngine *ring)
+{
+    return ring->depth;
+}
+
+void uringDestroy(uringEngine *ring)
+{
+    if (ring == NULL)
+    {
+        return;
+    }
+    if (ring->sqRing != NULL && ring->sqRing != MAP_FAILED)
+    {
+        munmap(ring->sqRing, ring->sqRingSize);
+    }
+    if (ring->cqRing != NULL && ring->cqRing != MAP_FAILED)
+    {
+        munmap(ring->cqRing, ring->cqRingSize);
+    }
+    if (ring->sqes != NULL && ring->sqes != MAP_FAILED)
+    {
+        munmap(ring->sqes, ring->sqesSize);
+    }
+    close(ring->ringFD); // also drops the registered buffers and files
+    free(ring->buffers);
+    free(ring->slots);
+    free(ring->freeSlots);
+    free(ring->cursor);
+    free(ring->fileTable);
+    free(ring);
+}
+
+//  Fill the next submission entry with a read or write of a slot's buffer
+static void prepareIo(uringEngine *ring, int slot, int isWrite, int fd, int fileIndex, unsigned char flags)
+{
+    uringSlot *s = &ring->slots[slot];
+    struct io_uring_sqe *sqe = &ring->sqes[ring->localTail & ring->sqMask];
+    memset(sqe, 0, sizeof(*sqe));
+    if (ring->fixedBuffers)
+    {
+        sqe->opcode = isWrite ? IORING_OP_WRITE_FIXED : IORING_OP_READ_FIXED;
+        sqe->buf_index = slot;
+    }
+    else
+    {
+        sqe->opcode = isWrite ? IORING_OP_WRITE : IORING_OP_READ;
+    }
+    if (ring->fixedFiles)
+    {
+        sqe->fd = fileIndex;
+        flags |= IOSQE_FIXED_FILE;
+    }
+    else
+    {
+        sqe->fd = fd;
+    }
+    sqe->flags = flags;
+    sqe->off = s->offset;
+    sqe->addr = (unsigned long)(ring->buffers + slot * ring->ioSize);
+    sqe->len = s->length;
+    sqe->user_data = (unsigned long long)slot << 1 | isWrite;
+    ring->localTail++;
+    ring->toSubmit++;
+}
+
+//  Hand the prepared entries to the kernel and wait for at least one completion
+static void submitAndWait(uringEngine *ring)
+{
+    __atomic_store_n(ring->sqTail, ring->localTail, __ATOMIC_RELEASE);
+    while (1)
+    {
+        int submitted = uringEnter(ring->ringFD, ring->toSubmit, 1, IORING_ENTER_GETEVENTS);
+        if (submitted < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            perror("io_uring_enter");
+            exit(EXIT_FAILURE);
+        }
+        ring->toSubmit -= submitted;
+        if (ring->toSubmit == 0)
+        {
+            return;
+        }
+    }
+}
+
+//  Account for a slot whose read and write both completed. A short or failed write, or a
+//  short read (which cancels the linked write), is finished here with pwrite and pread;
+//  that only happens when a file shrinks or the device runs out of space.
+static void resolveSlot(uringEngine *ring, uringTask *tasks, int slot)
+{
+    uringSlot *s = &ring->slots[slot];
+    uringTask *task = &tasks[s->task];
+    if (s->readRes == (int)s->length && s->writeRes == (int)s->length) // the usual case
+    {
+        task->copied += s->length;
+        return;
+    }
+    if (s->readRes < 0 || (s->writeRes < 0 && s->writeRes != -ECANCELED))
+    {
+        errno = s->readRes < 0 ? -s->readRes : -s->writeRes;
+        perror("io_uring copy");
+        task->failed = 1;
+        return;
+    }
+
+    char *data = ring->buffers + slot * ring->ioSize;
+    long long have = s->readRes;                         // bytes in the buffer
+    long long done = s->writeRes > 0 ? s->writeRes : 0; // bytes of them already written
+    while (done < s->length)
+    {
+        if (done == have) // the read came up short, read the rest of the slot
+        {
+            ssize_t bytes = pread(task->srcFD, data + done, s->length - done, s->offset + done);
+            if (bytes < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            if (bytes <= 0)
+            {
+                task->failed |= bytes < 0;
+                break; // 0 means the file shrank, nothing more to copy
+            }
+            have += bytes;
+        }
+        ssize_t written = pwrite(task->destFD, data + done, have - done, s->offset + done);
+        if (written < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (written <= 0)
+        {
+            perror("pwrite");
+            task->failed = 1;
+            break;
+        }
+        done += written;
+    }
+    task->copied += done;
+}
+
+void uringCopy(uringEngine *ring, uringTask *tasks, int count)
+{
+    if (count > (int)ring->depth)
+    {
+        count = ring->depth; // the file table holds depth pairs
+    }
+    for (int i = 0; i < count; i++)
+    {
+        tasks[i].copied = 0;
+        tasks[i].failed = 0;
+        ring->cursor[i] = tasks[i].offset;
+        ring->fileTable[2 * i] = tasks[i].srcFD;
+        ring->fileTable[2 * i + 1] = tasks[i].destFD;
+    }
+    struct io_uring_files_update update = {.offset = 0, .fds = (unsigned long)ring->fileTable};
+    if (ring->fixedFiles && uringRegister(ring->ringFD, IORING_REGISTER_FILES_UPDATE, &update, 2 * count) < 0)
+    {
+        ring->fixedFiles = 0; // plain descriptors from here on
+    }
+
+    int freeCount = 0;
+    for (unsigned i = 0; i < ring->depth; i++)
+    {
+        ring->freeSlots[freeCount++] = i;
+    }
+    int inFlight = 0, nextTask = 0;
+    while (1)
+    {
+        // Give every idle slot the next piece of some task, going round the tasks so
+        // several files are read and written at once
+        while (freeCount > 0)
+        {
+            int task = -1;
+            for (int i = 0; i < count; i++)
+            {
+                int candidate = (nextTask + i) % count;
+                if (!tasks[candidate].failed && ring->cursor[candidate] < tasks[candidate].offset + tasks[candidate].length)
+                {
+                    task = candidate;
+                    break;
+                }
+            }
+            if (task < 0)
+            {
+                break;
+            }
+            nextTask = (task + 1) % count;
+
+            int slot = ring->freeSlots[--freeCount];
+            uringSlot *s = &ring->slots[slot];
+            long long left = tasks[task].offset + tasks[task].length - ring->cursor[task];
+            s->task = task;
+            s->offset = ring->cursor[task];
+            s->length = left < (long long)ring->ioSize ? left : (long long)ring->ioSize;
+            s->pending = 2;
+            ring->cursor[task] += s->length;
+            // The write is linked to the read, so it starts only after the data is in the buffer
+            prepareIo(ring, slot, 0, tasks[task].srcFD, 2 * task, IOSQE_IO_LINK);
+            prepareIo(ring, slot, 1, tasks[task].destFD, 2 * task + 1, 0);
+            inFlight++;
+        }
+        if (inFlight == 0)
+        {
+            break;
+        }
+
+        submitAndWait(ring);
+        unsigned head = *ring->cqHead;
+        unsigned tail = __atomic_load_n(ring->cqTail, __ATOMIC_ACQUIRE);
+        for (; head != tail; head++)
+        {
+            struct io_uring_cqe *cqe = &ring->cqes[head & ring->cqMask];
+            int slot = cqe->user_data >> 1;
+            uringSlot *s = &ring->slots[slot];
+            if (cqe->user_data & 1)
+            {
+                s->writeRes = cqe->res;
+            }
+            else
+            {
+                s->readRes = cqe->res;
+            }
+            if (--s->pending == 0)
+            {
+                resolveSlot(ring, tasks, slot);
+                ring->freeSlots[freeCount++] = slot;
+                inFlight--;
+            }
+        }
+        __atomic_store_n(ring->cqHead, head, __ATOMIC_RELEASE);
+    }
+
+    for (int i = 0; i < 2 * count; i++) // drop the ring's references so closing the files closes them
+    {
+        ring->fileTable[i] = -1;
+    }
+    if (ring->fixedFiles)
+    {
+        uringRegister(ring->ringFD, IORING_REGISTER_FILES_UPDATE, &update, 2 * count);
+    }
+}
@@ -0,0 +1,26 @@
+#ifndef URINGENGINE_H
+#define URINGENGINE_H
+
+#include <stddef.h>
+
+#define URING_DEFAULT_DEPTH 32          // read/write pairs kept in flight by one ring
+#define URING_DEFAULT_IO_SIZE (1 << 17) // bytes moved by one read/write pair
+
+typedef struct uringEngine uringEngine; //  An io_uring with its registered buffers and file table, used by one thread
+
+typedef struct //  A file or range copied at the same offsets in both files
+{
+    int srcFD;        // source file descriptor
+    int destFD;       // destination file descriptor
+    long long offset; // first byte to copy
+    long long length; // bytes to copy
+    long long copied; // bytes copied, set by uringCopy
+    int failed;       // set by uringCopy if a read or write failed
+} uringTask;
+
+uringEngine *uringCreate(unsigned depth, size_t ioSize);      // Set up a ring for depth pairs of ioSize bytes, NULL if the kernel has no io_uring
+int uringMaxTasks(const uringEngine *ring);                   // Most tasks one uringCopy call takes
+void uringCopy(uringEngine *ring, uringTask *tasks, int count); // Copy every task, keeping up to depth linked read->write pairs in flight across them
+void uringDestroy(uringEngine *ring);                         // Unmap and close the ring
+
+#endif
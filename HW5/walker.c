@@ -0,0 +1,400 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+#include "walker.h"
+
+#define WALK_DENTS_BUFFER 65536   // bytes of directory entries read per getdents64 call
+
+typedef struct //  A directory waiting to be scanned, opened only when a walker takes it
+{
+    char *srcPath;  // source directory path
+    char *destPath; // destination directory path
+} dirTask;
+
+typedef struct //  Deque of directories, the owner works at the tail and thieves take from the head
+{
+    pthread_mutex_t lock; // mutex for the deque
+    dirTask *tasks;       // ring of tasks
+    int capacity;         // size of the ring
+    int head;             // index of the oldest task
+    int count;            // number of tasks in the ring
+} dirDeque;
+
+typedef struct linuxDirent64 //  Record layout returned by getdents64
+{
+    unsigned long long d_ino;
+    long long d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+} linuxDirent64;
+
+dirDeque *deques;                                         // one deque per walker
+int walkerCount;                                          // number of walker threads
+int pendingDirs = 0;                                      // directories queued or being scanned, the walk ends at 0
+int queuedDirs = 0;                                       // directories sitting in a deque
+walkEntryCallback entryCallback;                          // what to do with each entry
+walkScanCallback scanCallback = NULL;                     // what to do when a directory is scanned
+walkCloseCallback closeCallback = NULL;                   // what to do when a directory is done
+walkStats stats;                                          // totals over every walker
+static __thread long long internedNames = 0;              // names the calling walker stored in arenas
+static __thread long long internedBytes = 0;              // bytes of those names
+static __thread long long arenaBytes = 0;                 // bytes of arena chunks the calling walker allocated
+int openDirs = 0;                                         // directory handles currently open
+int maxOpenDirs;                                          // walkers wait before opening more than this
+pthread_mutex_t openMutex = PTHREAD_MUTEX_INITIALIZER;    // mutex for openDirs
+pthread_cond_t dirClosed = PTHREAD_COND_INITIALIZER;      // signaled when a directory handle is closed
+pthread_mutex_t idleMutex = PTHREAD_MUTEX_INITIALIZER;    // mutex for idle walkers
+pthread_cond_t workAvailable = PTHREAD_COND_INITIALIZER;  // signaled when a directory is queued or the walk ends
+
+//  Add a directory to the tail of a walker's deque
+static void pushTask(int walker, char *srcPath, char *destPath)
+{
+    dirDeque *deque = &deques[walker];
+    pthread_mutex_lock(&deque->lock);
+    if (deque->count == deque->capacity) // grow the ring, unrolling it from the head
+    {
+        int capacity = deque->capacity ? deque->capacity * 2 : 64;
+        dirTask *tasks = malloc(capacity * sizeof(dirTask));
+        if (tasks == NULL)
+        {
+            perror("malloc");
+            exit(EXIT_FAILURE);
+        }
+        for (int i = 0; i < deque->count; i++)
+        {
+            tasks[i] = deque->tasks[(deque->head + i) % deque->capacity];
+        }
+        free(deque->tasks);
+        deque->tasks = tasks;
+        deque->capacity = capacity;
+        deque->head = 0;
+    }
+    deque->tasks[(deque->head + deque->count) % deque->capacity] = (dirTask){srcPath, destPath};
+    deque->count++;
+    pthread_mutex_unlock(&deque->lock);
+
+    __atomic_add_fetch(&pendingDirs, 1, __ATOMIC_SEQ_CST);
+    pthread_mutex_lock(&idleMutex);
+    queuedDirs++;
+    pthread_cond_signal(&workAvailable);
+    pthread_mutex_unlock(&idleMutex);
+}
+
+//  Take a task from the tail (own deque, depth first) or the head (stealing, biggest subtrees first)
+static int takeTask(int walker, int fromTail, dirTask *task)
+{
+    dirDeque *deque = &deques[walker];
+    pthread_mutex_lock(&deque->lock);
+    if (deque->count == 0)
+    {
+        pthread_mutex_unlock(&deque->lock);
+        return 0;
+    }
+    if (fromTail)
+    {
+        *task = deque->tasks[(deque->head + deque->count - 1) % deque->capacity];
+    }
+    else
+    {
+        *task = deque->tasks[deque->head];
+        deque->head = (deque->head + 1) % deque->capacity;
+    }
+    deque->count--;
+    pthread_mutex_unlock(&deque->lock);
+
+    pthread_mutex_lock(&idleMutex);
+    queuedDirs--;
+    pthread_mutex_unlock(&idleMutex);
+    return 1;
+}
+
+const char *dirHandleIntern(dirHandle *dir, const char *name)
+{
+    size_t length = strlen(name) + 1;
+    nameChunk *chunk = dir->names;
+    if (chunk == NULL || chunk->used + length > chunk->size) // small directories stay in one small chunk, big ones grow to NAME_ARENA_CHUNK
+    {
+        size_t size = chunk == NULL ? NAME_ARENA_FIRST : chunk->size * 2;
+        if (size > NAME_ARENA_CHUNK)
+        {
+            size = NAME_ARENA_CHUNK;
+        }
+        if (size < length) // names are at most NAME_MAX + 1 bytes
+        {
+            size = length;
+        }
+        chunk = malloc(sizeof(nameChunk) + size);
+        if (chunk == NULL)
+        {
+            perror("malloc");
+            exit(EXIT_FAILURE);
+        }
+        chunk->next = dir->names;
+        chunk->used = 0;
+        chunk->size = size;
+        dir->names = chunk;
+        arenaBytes += sizeof(nameChunk) + size;
+    }
+    char *copy = memcpy(chunk->data + chunk->used, name, length);
+    chunk->used += length;
+    internedNames++;
+    internedBytes += length;
+    return copy;
+}
+
+dirHandle *dirHandleRetain(dirHandle *dir)
+{
+    __atomic_add_fetch(&dir->refs, 1, __ATOMIC_RELAXED);
+    return dir;
+}
+
+void dirHandleRelease(dirHandle *dir)
+{
+    if (__atomic_sub_fetch(&dir->refs, 1, __ATOMIC_ACQ_REL) != 0)
+    {
+        return;
+    }
+    if (closeCallback != NULL)
+    {
+        closeCallback(dir);
+    }
+    if (dir->srcFD >= 0)
+    {
+        close(dir->srcFD);
+    }
+    if (dir->destFD >= 0)
+    {
+        close(dir->destFD);
+    }
+    free(dir->srcPath);
+    free(dir->destPath);
+    while (dir->names != NULL)
+    {
+        nameChunk *next = dir->names->next;
+        free(dir->names);
+        dir->names = next;
+    }
+    free(dir);
+
+    pthread_mutex_lock(&openMutex);
+    openDirs--;
+    pthread_cond_signal(&dirClosed);
+    pthread_mutex_unlock(&openMutex);
+}
+
+//  Open the directory of a task, NULL on error. Queued files keep their directory open,
+//  so the number of open handles is capped to stay clear of the descriptor limit.
+static dirHandle *openTask(dirTask *task)
+{
+    pthread_mutex_lock(&openMutex);
+    while (openDirs >= maxOpenDirs) // workers close handles as they finish the files queued from them
+    {
+        pthread_cond_wait(&dirClosed, &openMutex);
+    }
+    openDirs++;
+    pthread_mutex_unlock(&openMutex);
+
+    dirHandle *dir = malloc(sizeof(dirHandle));
+    if (dir == NULL)
+    {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+    dir->srcFD = open(task->srcPath, O_RDONLY | O_DIRECTORY | O_NOFOLLOW);
+    dir->destFD = open(task->destPath, O_RDONLY | O_DIRECTORY | O_NOFOLLOW);
+    dir->srcPath = task->srcPath; // the handle takes over the task's strings
+    dir->destPath = task->destPath;
+    dir->refs = 1; // held by the scan
+    dir->names = NULL;
+    dir->userData = NULL;
+
+    if (dir->srcFD < 0 || dir->destFD < 0)
+    {
+        perror("open directory");
+        dirHandleRelease(dir);
+        return NULL;
+    }
+    return dir;
+}
+
+//  Scan one directory with getdents64, handing each entry to the callback and queuing subdirectories
+static void scanDirectory(int walker, dirHandle *dir, walkStats *local)
+{
+    local->directories++;
+
+    char *dents = malloc(WALK_DENTS_BUFFER);
+    if (dents == NULL)
+    {
+        perror("malloc");
+        return;
+    }
+
+    long bytes;
+    while ((bytes = syscall(SYS_getdents64, dir->srcFD, dents, WALK_DENTS_BUFFER)) > 0)
+    {
+        for (long offset = 0; offset < bytes;)
+        {
+            linuxDirent64 *entry = (linuxDirent64 *)(dents + offset);
+            offset += entry->d_reclen;
+            if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) // skip the current and parent directory
+            {
+                continue;
+            }
+
+            unsigned char type = entry->d_type;
+            if (type == DT_UNKNOWN) // some filesystems leave the type out, only then is a stat needed
+            {
+                struct stat statbuf;
+                local->statCalls++;
+                if (fstatat(dir->srcFD, entry->d_name, &statbuf, AT_SYMLINK_NOFOLLOW) < 0)
+                {
+                    perror("fstatat");
+                    continue;
+                }
+                type = IFTODT(statbuf.st_mode);
+            }
+
+            local->entries++;
+            if (entryCallback(dir, entry->d_name, type) && type == DT_DIR)
+            {
+                // Queued directories are kept as paths so they hold no descriptors while they wait
+                char *srcPath = malloc(strlen(dir->srcPath) + strlen(entry->d_name) + 2);
+                char *destPath = malloc(strlen(dir->destPath) + strlen(entry->d_name) + 2);
+                if (srcPath == NULL || destPath == NULL)
+                {
+                    perror("malloc");
+                    exit(EXIT_FAILURE);
+                }
+                sprintf(srcPath, "%s/%s", dir->srcPath, entry->d_name);
+                sprintf(destPath, "%s/%s", dir->destPath, entry->d_name);
+                pushTask(walker, srcPath, destPath);
+            }
+        }
+    }
+    if (bytes < 0)
+    {
+        perror("getdents64");
+    }
+
+    free(dents);
+}
+
+//  Purpose of a walker thread is to scan directories from its own deque, stealing when it runs dry
+static void *walker(void *arg)
+{
+    int self = (int)(long)arg;
+    walkStats local = {0};
+    unsigned int seed = self + 1; // rotates the first victim so thieves spread out
+
+    while (1)
+    {
+        dirTask task;
+        int found = takeTask(self, 1, &task);
+        int start = rand_r(&seed) % walkerCount;
+        for (int i = 0; !found && i < walkerCount; i++)
+        {
+            int victim = (start + i) % walkerCount;
+            if (victim != self)
+            {
+                found = takeTask(victim, 0, &task);
+                local.steals += found;
+            }
+        }
+
+        if (found)
+        {
+            dirHandle *dir = openTask(&task);
+            if (dir != NULL)
+            {
+                scanDirectory(self, dir, &local);
+                if (scanCallback != NULL)
+                {
+                    scanCallback(dir);
+                }
+                dirHandleRelease(dir); // queued entries keep it open until they are copied
+            }
+            if (__atomic_sub_fetch(&pendingDirs, 1, __ATOMIC_SEQ_CST) == 0)
+            {
+                pthread_mutex_lock(&idleMutex);
+                pthread_cond_broadcast(&workAvailable); // the walk is over, wake everyone to exit
+                pthread_mutex_unlock(&idleMutex);
+            }
+            continue;
+        }
+
+        pthread_mutex_lock(&idleMutex);
+        while (queuedDirs == 0 && __atomic_load_n(&pendingDirs, __ATOMIC_SEQ_CST) > 0)
+        {
+            pthread_cond_wait(&workAvailable, &idleMutex);
+        }
+        int finished = __atomic_load_n(&pendingDirs, __ATOMIC_SEQ_CST) == 0;
+        pthread_mutex_unlock(&idleMutex);
+        if (finished)
+        {
+            break;
+        }
+    }
+
+    pthread_mutex_lock(&idleMutex);
+    stats.directories += local.directories;
+    stats.entries += local.entries;
+    stats.statCalls += local.statCalls;
+    stats.steals += local.steals;
+    stats.names += internedNames;
+    stats.nameBytes += internedBytes;
+    stats.arenaBytes += arenaBytes;
+    pthread_mutex_unlock(&idleMutex);
+    return NULL;
+}
+
+void walkTree(const char *srcRoot, const char *destRoot, int walkers, int maxOpen, walkEntryCallback onEntry, walkScanCallback onScanned, walkCloseCallback onClose)
+{
+    walkerCount = walkers;
+    entryCallback = onEntry;
+    scanCallback = onScanned;
+    closeCallback = onClose;
+    deques = calloc(walkers, sizeof(dirDeque));
+    pthread_t *threads = malloc(walkers * sizeof(pthread_t));
+    if (deques == NULL || threads == NULL)
+    {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+    for (int i = 0; i < walkers; i++)
+    {
+        pthread_mutex_init(&deques[i].lock, NULL);
+    }
+
+    maxOpenDirs = maxOpen > 0 ? maxOpen : 1;
+    pushTask(0, strdup(srcRoot), strdup(destRoot));
+    for (int i = 0; i < walkers; i++)
+    {
+        pthread_create(&threads[i], NULL, walker, (void *)(long)i);
+    }
+    for (int i = 0; i < walkers; i++)
+    {
+        pthread_join(threads[i], NULL);
+    }
+
+    for (int i = 0; i < walkers; i++)
+    {
+        pthread_mutex_destroy(&deques[i].lock);
+        free(deques[i].tasks);
+    }
+    free(deques);
+    free(threads);
+}
+
+walkStats walkGetStats(void)
+{
+    return stats;
+}
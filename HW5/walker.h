@@ -0,0 +1,59 @@
+#ifndef WALKER_H
+#define WALKER_H
+
+#include <stddef.h>
+
+#define NAME_ARENA_FIRST 512  // bytes of a directory's first name chunk
+#define NAME_ARENA_CHUNK 16384 // largest name chunk, each new one doubles the last
+
+typedef struct nameChunk //  A block of entry names, filled front to back
+{
+    struct nameChunk *next; // previously filled chunk
+    size_t used;            // bytes handed out
+    size_t size;            // bytes in data
+    char data[];
+} nameChunk;
+
+typedef struct //  An open source directory and its destination, shared by everything queued from it.
+               //  Its paths are the common prefix of every entry, stored once; entry names live
+               //  in its arena and are freed with it.
+{
+    int srcFD;        // source directory, for openat and fstatat
+    int destFD;       // destination directory, for openat, mkdirat and mkfifoat
+    int refs;         // references held by the scan and by queued entries
+    char *srcPath;    // source directory path, for messages only
+    char *destPath;   // destination directory path, for messages only
+    nameChunk *names; // arena of entry names, only the scanning walker adds to it
+    void *userData;   // owned by the caller, handed to the close callback
+} dirHandle;
+
+// Callback for every entry under the source root, with its type as a DT_* value.
+// Returning 1 for a directory makes the walkers descend into it; the callback
+// must have created it in dir->destFD by then.
+typedef int (*walkEntryCallback)(dirHandle *dir, const char *name, unsigned char type);
+
+// Callback run by the walker that scanned a directory once its last entry was handed out,
+// while the scan still holds a reference
+typedef void (*walkScanCallback)(dirHandle *dir);
+
+// Callback run when the last reference to a directory is dropped, before it is closed
+typedef void (*walkCloseCallback)(dirHandle *dir);
+
+typedef struct // Totals over every walker
+{
+    long long directories; // directories scanned
+    long long entries;     // entries handed to the callback
+    long long statCalls;   // entries whose type getdents64 did not report
+    long long steals;      // directories taken from another walker's deque
+    long long names;       // names stored in directory arenas
+    long long nameBytes;   // bytes of those names, terminators included
+    long long arenaBytes;  // bytes of arena chunks allocated for them
+} walkStats;
+
+void walkTree(const char *srcRoot, const char *destRoot, int walkers, int maxOpen, walkEntryCallback onEntry, walkScanCallback onScanned, walkCloseCallback onClose); // Scan srcRoot with several threads and at most maxOpen open directories, returns when every directory is done
+walkStats walkGetStats(void);                                  // Totals of the last walk
+const char *dirHandleIntern(dirHandle *dir, const char *name); // Copy a name into the directory's arena, only from the walker scanning it
+dirHandle *dirHandleRetain(dirHandle *dir);                    // Take another reference to a directory
+void dirHandleRelease(dirHandle *dir);                         // Drop a reference, closing the directory after the last one
+
+#endif